@@ -40,6 +40,9 @@
 #include "kernel/assert.h"
 #include "kernel/kmalloc.h"
 #include "kernel/interrupt.h"
+#ifdef CHANGED_5
+#include "vm/tlb.h"
+#endif
 
 /**@name Metadevices
  *
@@ -264,6 +267,13 @@ void cpustatus_interrupt_handle(device_t *dev){
     iobase->command = CPU_COMMAND_CLEAR_IRQ;
     
     spinlock_release(&cpu->slock);
+
+#ifdef CHANGED_5
+    /* The only inter-cpu interrupts are TLB shootdowns. The interrupt
+       is cleared first, so that requests posted before this call are
+       handled by it. */
+    tlb_shootdown_interrupt();
+#endif
 }
 
 /** 
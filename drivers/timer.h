@@ -41,6 +41,11 @@
 
 void timer_set_ticks(uint32_t ticks);
 
+#ifdef CHANGED_5
+/* Current value of the CP0 cycle counter. */
+uint32_t _timer_get_ticks(void);
+#endif /* CHANGED_5 */
+
 #endif /* DRIVERS_POLLTTY_H */
 
 
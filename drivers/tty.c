@@ -254,7 +254,8 @@ static int tty_write(gcd_t *gcd, const void *buf, int len)
  * @param buf Character buffer to be read into.
  * @param len Maximum number of bytes to be read.
  *
- * @return Number of succesfully read characters.
+ * @return Number of succesfully read characters, zero if the thread
+ * was aborted (thread_abort) while waiting for them.
  */
 static int tty_read(gcd_t *gcd, void *buf, int len)
 {
@@ -266,7 +267,11 @@ static int tty_read(gcd_t *gcd, void *buf, int len)
     intr_status = _interrupt_disable();
     spinlock_acquire(tty_rd->slock);
 
+#ifdef CHANGED_5
+    while (tty_rd->read_count == 0 && !thread_is_aborted()) {
+#else
     while (tty_rd->read_count == 0) {
+#endif
 	/* buffer is empty, so wait it to be filled */
         sleepq_add((void *)tty_rd->read_buf);
         spinlock_release(tty_rd->slock);
@@ -290,4 +295,25 @@ static int tty_read(gcd_t *gcd, void *buf, int len)
     return i;
 }
 
+#ifdef CHANGED_5
+/**
+ * Wakes the threads waiting to read from tty-device pointed by gcd,
+ * so that aborted threads see that they were aborted.
+ *
+ * @param gcd Pointer to the tty-device.
+ */
+void tty_wake_readers(gcd_t *gcd)
+{
+    interrupt_status_t intr_status;
+    volatile tty_real_device_t *tty_rd
+        = (tty_real_device_t *)gcd->device->real_device;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(tty_rd->slock);
+    sleepq_wake_all((void *)tty_rd->read_buf);
+    spinlock_release(tty_rd->slock);
+    _interrupt_set_state(intr_status);
+}
+#endif
+
 /** @} */
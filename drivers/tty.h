@@ -103,5 +103,8 @@ typedef struct {
 
 device_t *tty_init(io_descriptor_t *desc);
 void tty_interrupt_handle(device_t *device);
+#ifdef CHANGED_5
+void tty_wake_readers(gcd_t *gcd);
+#endif
 
 #endif /* TTY_H */
@@ -557,6 +557,11 @@ fs_t * sfs_init(gbd_t *disk)
     fs->read    = sfs_read;
     fs->write   = sfs_write;
     fs->getfree  = sfs_getfree;
+#ifdef CHANGED_5
+    /* one read or write per segment */
+    fs->readv   = NULL;
+    fs->writev  = NULL;
+#endif
 
     return fs;
 }
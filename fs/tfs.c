@@ -168,6 +168,10 @@ fs_t * tfs_init(gbd_t *disk)
     fs->read    = tfs_read;
     fs->write   = tfs_write;
     fs->getfree  = tfs_getfree;
+#ifdef CHANGED_5
+    fs->readv   = tfs_readv;
+    fs->writev  = tfs_writev;
+#endif
 
     return fs;
 }
@@ -780,6 +784,197 @@ int tfs_write(fs_t *fs, int fileid, void *buffer, int datasize, int offset)
     return written;
 }
 
+#ifdef CHANGED_5
+/* Position in a list of segments (see vfs_segment_t). */
+typedef struct {
+    vfs_segment_t *segments;
+    int count;
+    int index;
+    int pos;
+} tfs_cursor_t;
+
+/* Moves the cursor forward by size bytes, past any empty segments. */
+static void tfs_cursor_skip(tfs_cursor_t *cursor, int size)
+{
+    cursor->pos += size;
+    while (cursor->index < cursor->count &&
+           cursor->pos >= cursor->segments[cursor->index].size) {
+        cursor->pos -= cursor->segments[cursor->index].size;
+        cursor->index++;
+    }
+}
+
+/* Returns the address at the cursor if size bytes follow it in the
+   same segment and the disk can transfer them there directly, NULL
+   otherwise. */
+static void *tfs_cursor_direct(tfs_cursor_t *cursor, int size)
+{
+    uint32_t addr;
+
+    if (cursor->index >= cursor->count ||
+        cursor->segments[cursor->index].size - cursor->pos < size)
+        return NULL;
+    addr = (uint32_t)cursor->segments[cursor->index].buffer + cursor->pos;
+    /* only word aligned kernel segment addresses have a known
+       physical address */
+    if ((addr & 3) != 0 || addr < 0x80000000 || addr >= 0xa0000000)
+        return NULL;
+    return (void *)addr;
+}
+
+/* Copies size bytes between the segments at the cursor and block,
+   and moves the cursor past them. */
+static void tfs_cursor_copy(tfs_cursor_t *cursor, void *block, int size,
+                            int to_block)
+{
+    char *addr;
+    int n;
+
+    while (size > 0) {
+        n = MIN(size, cursor->segments[cursor->index].size - cursor->pos);
+        addr = (char *)cursor->segments[cursor->index].buffer + cursor->pos;
+        if (to_block)
+            memcopy(n, block, addr);
+        else
+            memcopy(n, addr, block);
+        block = (char *)block + n;
+        size -= n;
+        tfs_cursor_skip(cursor, n);
+    }
+}
+
+/* Reads or writes the segments at offset of the file. Whole blocks
+   are transferred by the disk straight to or from the segments when
+   possible, other blocks go through the allocation block buffer. */
+static int tfs_transfer(fs_t *fs, int fileid, vfs_segment_t *segments,
+                        int count, int offset, int write)
+{
+    tfs_t *tfs = (tfs_t *)fs->internal;
+    gbd_request_t req;
+    tfs_cursor_t cursor;
+    void *direct;
+    int i, size, done, n, r;
+
+    size = 0;
+    for (i = 0; i < count; i++)
+        size += segments[i].size;
+
+    semaphore_P(tfs->lock);
+
+    /* fileid is blocknum so ensure that we don't read system blocks
+       or outside the disk */
+    if (fileid < 2 || fileid > (int)tfs->totalblocks) {
+        semaphore_V(tfs->lock);
+        return VFS_ERROR;
+    }
+
+    req.block = fileid;
+    req.buf   = ADDR_KERNEL_TO_PHYS((uint32_t)tfs->buffer_inode);
+    req.sem   = NULL;
+    r = tfs->disk->read_block(tfs->disk, &req);
+    if (r == 0) {
+        semaphore_V(tfs->lock);
+        return VFS_ERROR;
+    }
+
+    if (offset < 0 || offset > (int)tfs->buffer_inode->filesize) {
+        semaphore_V(tfs->lock);
+        return VFS_ERROR;
+    }
+
+    /* files have fixed sizes, also when writing */
+    size = MIN(size, ((int)tfs->buffer_inode->filesize) - offset);
+
+    cursor.segments = segments;
+    cursor.count = count;
+    cursor.index = 0;
+    cursor.pos = 0;
+    tfs_cursor_skip(&cursor, 0);
+
+    for (done = 0; done < size; done += n) {
+        n = MIN(TFS_BLOCK_SIZE - (offset + done) % TFS_BLOCK_SIZE,
+                size - done);
+        direct = NULL;
+        if (n == TFS_BLOCK_SIZE)
+            direct = tfs_cursor_direct(&cursor, n);
+
+        req.block = tfs->buffer_inode->block[(offset + done) / TFS_BLOCK_SIZE];
+        req.sem   = NULL;
+        if (direct != NULL) {
+            req.buf = ADDR_KERNEL_TO_PHYS((uint32_t)direct);
+            if (write)
+                r = tfs->disk->write_block(tfs->disk, &req);
+            else
+                r = tfs->disk->read_block(tfs->disk, &req);
+            if (r == 0) {
+                semaphore_V(tfs->lock);
+                return VFS_ERROR;
+            }
+            tfs_cursor_skip(&cursor, n);
+            continue;
+        }
+
+        req.buf = ADDR_KERNEL_TO_PHYS((uint32_t)tfs->buffer_bat);
+        /* a partially written block is read first */
+        if (!write || n < TFS_BLOCK_SIZE) {
+            r = tfs->disk->read_block(tfs->disk, &req);
+            if (r == 0) {
+                semaphore_V(tfs->lock);
+                return VFS_ERROR;
+            }
+        }
+        tfs_cursor_copy(&cursor, (char *)tfs->buffer_bat +
+                        (offset + done) % TFS_BLOCK_SIZE, n, write);
+        if (write) {
+            r = tfs->disk->write_block(tfs->disk, &req);
+            if (r == 0) {
+                semaphore_V(tfs->lock);
+                return VFS_ERROR;
+            }
+        }
+    }
+
+    semaphore_V(tfs->lock);
+    return done;
+}
+
+/**
+ * Reads to count segments as if they were one buffer, see tfs_read.
+ * Implements fs.readv().
+ *
+ * @param fs  Pointer to fs data structure of the device.
+ * @param fileid Fileid of the file.
+ * @param segments The pieces of the buffer.
+ * @param count Number of segments.
+ * @param offset Start position of reading.
+ *
+ * @return Number of bytes read, or VFS_ERROR if error occured.
+ */
+int tfs_readv(fs_t *fs, int fileid, vfs_segment_t *segments, int count,
+              int offset)
+{
+    return tfs_transfer(fs, fileid, segments, count, offset, 0);
+}
+
+/**
+ * Writes count segments as if they were one buffer, see tfs_write.
+ * Implements fs.writev().
+ *
+ * @param fs  Pointer to fs data structure of the device.
+ * @param fileid Fileid of the file.
+ * @param segments The pieces of the buffer.
+ * @param count Number of segments.
+ * @param offset Start position of writing.
+ *
+ * @return Number of bytes written, or VFS_ERROR if error occured.
+ */
+int tfs_writev(fs_t *fs, int fileid, vfs_segment_t *segments, int count,
+               int offset)
+{
+    return tfs_transfer(fs, fileid, segments, count, offset, 1);
+}
+#endif /* CHANGED_5 */
+
 /**
  * Get number of free bytes on the disk. Implements fs.getfree().
  * Reads allocation blocks and counts number of zeros in the bitmap.
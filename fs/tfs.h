@@ -109,6 +109,12 @@ int tfs_create(fs_t *fs, char *filename, int size);
 int tfs_remove(fs_t *fs, char *filename);
 int tfs_read(fs_t *fs, int fileid, void *buffer, int bufsize, int offset);
 int tfs_write(fs_t *fs, int fileid, void *buffer, int datasize, int offset);
+#ifdef CHANGED_5
+int tfs_readv(fs_t *fs, int fileid, vfs_segment_t *segments, int count,
+              int offset);
+int tfs_writev(fs_t *fs, int fileid, vfs_segment_t *segments, int count,
+               int offset);
+#endif
 int tfs_getfree(fs_t *fs);
 
 
@@ -71,6 +71,11 @@ typedef struct {
 
     /* Current seek position in the file. */
     int seek_position;
+
+#ifdef CHANGED_5
+    /* Number of holders of this open file, see vfs_dup. */
+    int refcount;
+#endif
 } openfile_entry_t;
 
 /* Table of mounted filesystems. */
@@ -111,6 +116,19 @@ static int vfs_ops;
  when halting the system. */
 static int vfs_usable = 0;
 
+#ifdef CHANGED_5
+/* Number of buckets in vfs_file_versions */
+#define VFS_VERSION_BUCKETS 64
+
+/* Write counters of files, hashed by fileid. Protected by
+   openfile_table.sem. */
+static uint32_t vfs_file_versions[VFS_VERSION_BUCKETS];
+
+/* Number of removed files. A removed fileid may be reused by a new
+   file, so removes change the version of every file. */
+static uint32_t vfs_remove_version;
+#endif
+
 /**
  * Initializes Virtual Filesystem layer. This function is called
  * before virtual memory is enabled.
@@ -267,6 +285,11 @@ void vfs_mount_all(void) {
                 continue;
             }
 
+#ifdef CHANGED_5
+            /* The swap disk has no filesystem */
+            if (i == CONFIG_SWAP_DISK)
+                continue;
+#endif
             vfs_mount_fs(gbd, NULL );
         }
     }
@@ -580,6 +603,9 @@ openfile_t vfs_open(char *pathname) {
 
     openfile_table.files[file].fileid = fileid;
     openfile_table.files[file].seek_position = 0;
+#ifdef CHANGED_5
+    openfile_table.files[file].refcount = 1;
+#endif
 
     vfs_end_op();
     return file;
@@ -654,6 +680,15 @@ int vfs_close(openfile_t file) {
 #endif
     fs = openfile->filesystem;
 
+#ifdef CHANGED_5
+    /* Other holders keep the file open */
+    if (openfile->refcount > 1) {
+        openfile->refcount--;
+        semaphore_V(openfile_table.sem);
+        vfs_end_op();
+        return VFS_OK;
+    }
+#endif
     ret = fs->close(fs, openfile->fileid);
     openfile->filesystem = NULL;
 
@@ -797,6 +832,9 @@ int vfs_write(openfile_t file, void *buffer, int datasize) {
     if (ret > 0) {
         semaphore_P(openfile_table.sem);
         openfile->seek_position += ret;
+#ifdef CHANGED_5
+        vfs_file_versions[openfile->fileid % VFS_VERSION_BUCKETS]++;
+#endif
         semaphore_V(openfile_table.sem);
     }
 
@@ -889,6 +927,14 @@ int vfs_remove(char *pathname) {
 
     ret = fs->remove(fs, filename);
 
+#ifdef CHANGED_5
+    if (ret == VFS_OK) {
+        semaphore_P(openfile_table.sem);
+        vfs_remove_version++;
+        semaphore_V(openfile_table.sem);
+    }
+#endif
+
     semaphore_V(vfs_table.sem);
 
     vfs_end_op();
@@ -930,5 +976,236 @@ int vfs_getfree(char *filesystem) {
     return ret;
 }
 
+#ifdef CHANGED_5
+/**
+ * Adds a holder to an open file. The file stays open until vfs_close
+ * has been called once for each holder. All holders share the seek
+ * position.
+ *
+ * @param file Openfile id
+ *
+ * @return VFS_OK on success, negative (VFS_*) on error.
+ */
+int vfs_dup(openfile_t file) {
+    openfile_entry_t *openfile;
+
+    semaphore_P(openfile_table.sem);
+    openfile = vfs_verify_open(file);
+    if (openfile == NULL || file <= FILEHANDLE_STDERR) {
+        semaphore_V(openfile_table.sem);
+        return VFS_ERROR;
+    }
+    openfile->refcount++;
+    semaphore_V(openfile_table.sem);
+
+    return VFS_OK;
+}
+
+/**
+ * Reads at most bufsize bytes from given position of an open file.
+ * The seek position of the file is neither used nor changed.
+ *
+ * @param file Open file
+ *
+ * @param buffer Buffer to read to
+ *
+ * @param bufsize Maximum number of bytes to read.
+ *
+ * @param offset Position in the file to read from.
+ *
+ * @return Number of bytes read. Zero indicates end of file and
+ * negative values are errors.
+ */
+int vfs_read_at(openfile_t file, void *buffer, int bufsize, int offset) {
+    openfile_entry_t *openfile;
+    fs_t *fs;
+    int ret;
+
+    if (vfs_start_op() != VFS_OK)
+        return VFS_UNUSABLE;
+
+    openfile = vfs_verify_open(file);
+    if (openfile == NULL || file <= FILEHANDLE_STDERR ||
+        bufsize < 0 || buffer == NULL || offset < 0) {
+        vfs_end_op();
+        return VFS_ERROR;
+    }
+    fs = openfile->filesystem;
+
+    ret = fs->read(fs, openfile->fileid, buffer, bufsize, offset);
+
+    vfs_end_op();
+    return ret;
+}
+
+/**
+ * Writes datasize bytes to given position of an open file. The seek
+ * position of the file is neither used nor changed.
+ *
+ * @param file Open file
+ *
+ * @param buffer Buffer to be written to the file.
+ *
+ * @param datasize Number of bytes to write.
+ *
+ * @param offset Position in the file to write to.
+ *
+ * @return Number of bytes written, negative values are errors.
+ */
+int vfs_write_at(openfile_t file, void *buffer, int datasize, int offset) {
+    openfile_entry_t *openfile;
+    fs_t *fs;
+    int ret;
+
+    if (vfs_start_op() != VFS_OK)
+        return VFS_UNUSABLE;
+
+    openfile = vfs_verify_open(file);
+    if (openfile == NULL || file <= FILEHANDLE_STDERR ||
+        datasize < 0 || buffer == NULL || offset < 0) {
+        vfs_end_op();
+        return VFS_ERROR;
+    }
+    fs = openfile->filesystem;
+
+    ret = fs->write(fs, openfile->fileid, buffer, datasize, offset);
+
+    if (ret > 0) {
+        semaphore_P(openfile_table.sem);
+        vfs_file_versions[openfile->fileid % VFS_VERSION_BUCKETS]++;
+        semaphore_V(openfile_table.sem);
+    }
+
+    vfs_end_op();
+    return ret;
+}
+
+/* Reads or writes the segments at the seek position of an open file
+   with one filesystem call, or one call per segment if the filesystem
+   has no readv/writev. */
+static int vfs_transfer_segments(openfile_t file, vfs_segment_t *segments,
+                                 int count, int write) {
+    openfile_entry_t *openfile;
+    fs_t *fs;
+    int i, ret, done;
+
+    if (vfs_start_op() != VFS_OK)
+        return VFS_UNUSABLE;
+
+    openfile = vfs_verify_open(file);
+    if (openfile == NULL || file <= FILEHANDLE_STDERR ||
+        segments == NULL || count < 0) {
+        vfs_end_op();
+        return VFS_ERROR;
+    }
+    for (i = 0; i < count; i++) {
+        if (segments[i].buffer == NULL || segments[i].size < 0) {
+            vfs_end_op();
+            return VFS_ERROR;
+        }
+    }
+    fs = openfile->filesystem;
+
+    if (write && fs->writev != NULL) {
+        ret = fs->writev(fs, openfile->fileid, segments, count,
+                         openfile->seek_position);
+    } else if (!write && fs->readv != NULL) {
+        ret = fs->readv(fs, openfile->fileid, segments, count,
+                        openfile->seek_position);
+    } else {
+        ret = 0;
+        for (i = 0; i < count; i++) {
+            if (write)
+                done = fs->write(fs, openfile->fileid, segments[i].buffer,
+                                 segments[i].size,
+                                 openfile->seek_position + ret);
+            else
+                done = fs->read(fs, openfile->fileid, segments[i].buffer,
+                                segments[i].size,
+                                openfile->seek_position + ret);
+            if (done < 0 && ret == 0)
+                ret = done;
+            if (done < 0)
+                break;
+            ret += done;
+            if (done < segments[i].size)
+                break;
+        }
+    }
+
+    if (ret > 0) {
+        semaphore_P(openfile_table.sem);
+        openfile->seek_position += ret;
+        if (write)
+            vfs_file_versions[openfile->fileid % VFS_VERSION_BUCKETS]++;
+        semaphore_V(openfile_table.sem);
+    }
+
+    vfs_end_op();
+    return ret;
+}
+
+/**
+ * Reads from an open file to a buffer scattered in count segments,
+ * like vfs_read reads to one buffer. The seek position is updated.
+ *
+ * @param file Open file
+ *
+ * @param segments The pieces of the buffer in order.
+ *
+ * @param count Number of segments.
+ *
+ * @return Number of bytes read. Zero indicates end of file and
+ * negative values are errors.
+ */
+int vfs_readv(openfile_t file, vfs_segment_t *segments, int count) {
+    return vfs_transfer_segments(file, segments, count, 0);
+}
+
+/**
+ * Writes a buffer scattered in count segments to an open file, like
+ * vfs_write writes one buffer. The seek position is updated.
+ *
+ * @param file Open file
+ *
+ * @param segments The pieces of the buffer in order.
+ *
+ * @param count Number of segments.
+ *
+ * @return Number of bytes written, negative values are errors.
+ */
+int vfs_writev(openfile_t file, vfs_segment_t *segments, int count) {
+    return vfs_transfer_segments(file, segments, count, 1);
+}
+
+/**
+ * Gets the identity of an open file. Used to recognize that two
+ * handles refer to the same unmodified file.
+ *
+ * @param file Openfile id
+ *
+ * @param identity Where the identity is stored
+ *
+ * @return VFS_OK on success, negative (VFS_*) on error.
+ */
+int vfs_get_identity(openfile_t file, vfs_file_identity_t *identity) {
+    openfile_entry_t *openfile;
+
+    openfile = vfs_verify_open(file);
+    if (openfile == NULL || file <= FILEHANDLE_STDERR) {
+        return VFS_ERROR;
+    }
+
+    semaphore_P(openfile_table.sem);
+    identity->fs = openfile->filesystem;
+    identity->fileid = openfile->fileid;
+    identity->version = vfs_remove_version +
+        vfs_file_versions[openfile->fileid % VFS_VERSION_BUCKETS];
+    semaphore_V(openfile_table.sem);
+
+    return VFS_OK;
+}
+#endif
+
 /** @} */
 
@@ -62,6 +62,15 @@
 /* Type for open file entries. This is actually index to open files table */
 typedef int openfile_t;
 
+#ifdef CHANGED_5
+/* One piece of a buffer scattered in memory, for example a user buffer
+   spanning several physical pages. The buffer is a kernel address. */
+typedef struct {
+    void *buffer;
+    int size;
+} vfs_segment_t;
+#endif
+
 /* Structure defining a filesystem driver instance for one filesystem.
    Instances of this structure are created by filesystem init-function and
    they are used only inside VFS. */
@@ -134,6 +143,17 @@ typedef struct fs_struct{
 
        Returns the number of free bytes, negative values are errors. */
     int (*getfree)(struct fs_struct *fs);
+
+#ifdef CHANGED_5
+    /* Function pointers to optional functions which read to or write
+       from count segments like read and write above, as if the
+       segments were one buffer. NULL if the filesystem does not
+       implement them. */
+    int (*readv)(struct fs_struct *fs, int fileid, vfs_segment_t *segments,
+                 int count, int offset);
+    int (*writev)(struct fs_struct *fs, int fileid, vfs_segment_t *segments,
+                  int count, int offset);
+#endif
 } fs_t;
 
 
@@ -155,4 +175,22 @@ int vfs_create(char *pathname, int size);
 int vfs_remove(char *pathname);
 int vfs_getfree(char *filesystem);
 
+#ifdef CHANGED_5
+/* Identity of an open file. All handles of the same file have the same
+   filesystem and fileid. The version changes whenever the file may have
+   been written to, or replaced by another file with the same fileid. */
+typedef struct {
+    fs_t *fs;
+    int fileid;
+    uint32_t version;
+} vfs_file_identity_t;
+
+int vfs_get_identity(openfile_t file, vfs_file_identity_t *identity);
+int vfs_dup(openfile_t file);
+int vfs_read_at(openfile_t file, void *buffer, int bufsize, int offset);
+int vfs_write_at(openfile_t file, void *buffer, int datasize, int offset);
+int vfs_readv(openfile_t file, vfs_segment_t *segments, int count);
+int vfs_writev(openfile_t file, vfs_segment_t *segments, int count);
+#endif
+
 #endif
@@ -76,6 +76,13 @@
 #   include "kernel_tests/test_filesystem.h"
 #endif
 
+#ifdef CHANGED_5
+#   include "kernel_tests/test_vm.h"
+#   include "kernel_tests/test_libc.h"
+#   include "vm/swap.h"
+#   include "kernel/kprof.h"
+#endif
+
 /**
  * Fallback function for system startup. This function is executed
  * if the initial startup program (shell or other userland process given
@@ -149,6 +156,12 @@ void init_startup_fallback(void) {
         run_nic_tests();
         run_sfs_tests();
         #endif
+        #ifdef CHANGED_5
+        kwrite("Running kernel tests for phase 5...\n");
+        run_tlb_benchmark();
+        run_user_copy_benchmark();
+        run_memcopy_benchmark();
+        #endif
     }
 #ifdef CHANGED_3
 #define PORT1 9091
@@ -183,6 +196,11 @@ void init_startup_thread(uint32_t arg)
     kprintf("Mounting filesystems\n");
     vfs_mount_all();
 
+#ifdef CHANGED_5
+    kprintf("Initializing swap\n");
+    swap_init();
+#endif
+
     kprintf("Initializing networking\n");
     network_init();
     if(bootargs_get("initprog") == NULL) {
@@ -257,6 +275,11 @@ void init(void)
     kwrite("Initializing interrupt handling\n");
     interrupt_init(numcpus);
 
+#ifdef CHANGED_5
+    kwrite("Initializing kernel profiler\n");
+    kprof_init();
+#endif
+
     kwrite("Initializing threading system\n");
     thread_table_init();
 
@@ -48,14 +48,64 @@
 #endif
 
 #ifdef CHANGED_2
+#ifdef CHANGED_5
+/* Maximum number of processes, including exited ones that have not
+   been joined yet. The process table grows up to this size. */
+#   define CONFIG_MAX_PROCESSES 128
+#else
 /* Maximum number of simultaneous processes. */
 #   define CONFIG_MAX_PROCESSES 32
+#endif
 /* Maximum length that can be given as a string parameter to a systemcall or as a read/write buffer. */
 #   define CONFIG_SYSCALL_MAX_BUFFER_SIZE 512
 /* Maximum string parameter number for execp */
 #   define CONFIG_SYSCALL_MAX_ARGC 32
 #endif
 
+#ifdef CHANGED_5
+/* Maximum number of executable images in memory (running or cached). */
+#   define CONFIG_IMAGE_CACHE_SIZE 16
+/* Milliseconds an image is kept in memory after its last process exits. */
+#   define CONFIG_IMAGE_CACHE_TIMEOUT 30000
+/* Maximum number of free pages kept zeroed in advance by the idle thread. */
+#   define CONFIG_PAGEPOOL_ZEROED_PAGES 32
+/* Number of the disk used for swap, counting from 0. The disk is not
+   mounted as a filesystem. */
+#   define CONFIG_SWAP_DISK 1
+/* Maximum number of pages in swap. */
+#   define CONFIG_SWAP_MAX_SLOTS 2048
+/* The swap writeback thread starts freeing pages when fewer than
+   CONFIG_SWAP_LOW_PAGES are free and stops at CONFIG_SWAP_HIGH_PAGES. */
+#   define CONFIG_SWAP_LOW_PAGES 8
+#   define CONFIG_SWAP_HIGH_PAGES 16
+/* Maximum number of pages written to swap at once. */
+#   define CONFIG_SWAP_BATCH 4
+/* Largest page size used for large page mappings of user memory:
+   1 = 16k, 2 = 64k, 3 = 256k, 4 = 1M, 0 disables large pages. Sizes
+   whose page pair exceeds a quarter of the memory are not used. */
+#   define CONFIG_LARGE_PAGE_MAX_SIZE 4
+/* Maximum number of pages of a user buffer given to the filesystem in
+   one read or write, at most 32. */
+#   define CONFIG_SYSCALL_MAX_PINNED_PAGES 32
+/* Default maximum number of pages in the stack of a user process, the
+   limit is kept per process. Pages beyond the first
+   CONFIG_USERLAND_STACK_SIZE are mapped when first touched. */
+#   define CONFIG_USERLAND_STACK_MAX_SIZE 256
+/* Number of pages left unmapped between the heap and the stack region,
+   so that an overflowing stack faults instead of writing to the heap. */
+#   define CONFIG_USERLAND_STACK_GUARD 16
+/* Number of pages in the stack of each additional userland thread,
+   including an unmapped guard page at the bottom. */
+#   define CONFIG_USERLAND_THREAD_STACK_SIZE 64
+/* Maximum number of asynchronous reads and writes in progress in the
+   system. Each runs in a kernel thread of its own. */
+#   define CONFIG_MAX_AIO_REQUESTS 8
+/* Maximum number of pipes in the system. */
+#   define CONFIG_MAX_PIPES 16
+/* Size of the buffer of a pipe in bytes. Writers wait when it is full. */
+#   define CONFIG_PIPE_BUFFER_SIZE 1024
+#endif
+
 
 /* Size of the stack of a kernel thread */
 #define CONFIG_THREAD_STACKSIZE 4096
@@ -37,6 +37,13 @@
 #include "drivers/metadev.h"
 #include "lib/libc.h"
 #include "fs/vfs.h"
+#ifdef CHANGED_5
+#include "vm/tlb.h"
+#include "vm/pagepool.h"
+#include "vm/swap.h"
+#include "proc/syscall.h"
+#include "kernel/kprof.h"
+#endif
 
 /**
  * Halt the kernel.
@@ -49,6 +56,14 @@ void halt_kernel(void)
     /* Unmount all filesystems */
     vfs_deinit();
 
+#ifdef CHANGED_5
+    tlb_print_stats();
+    pagepool_print_stats();
+    swap_print_stats();
+    syscall_stats_print();
+    kprof_dump();
+#endif
+
     kprintf("Kernel: System shutdown complete, powering off\n");
     shutdown(POWEROFF_SHUTDOWN_MAGIC);
 }
@@ -44,6 +44,11 @@
 #include "kernel/thread.h"
 #include "lib/libc.h"
 #include "vm/tlb.h"
+#ifdef CHANGED_5
+#include "proc/process_table.h"
+#include "proc/kdata.h"
+#include "kernel/kprof.h"
+#endif
 
 /* Interrupt vector addresses (only these three should be ever used) */
 #define INTERRUPT_VECTOR_ADDRESS1 0x80000000
@@ -178,6 +183,14 @@ void interrupt_handle(uint32_t cause) {
 	    interrupt_handlers[i].handler(interrupt_handlers[i].device);
     }
 
+#ifdef CHANGED_5
+    if (cause & INTERRUPT_CAUSE_HARDWARE_5) {
+	kdata_update();
+	process_profile_sample();
+	kprof_sample();
+    }
+#endif
+
 
     /* Timer interrupt (HW5) or requested context switch (SW0)
      * Also call scheduler if we're running the idle thread.
@@ -187,7 +200,12 @@ void interrupt_handle(uint32_t cause) {
        scheduler_current_thread[this_cpu] == IDLE_THREAD_TID) {
 	scheduler_schedule();
 	
-#ifdef CHANGED_4
+#ifdef CHANGED_5
+	if (thread_get_current_thread_entry()->pagetable != NULL) {
+	    tlb_activate(thread_get_current_thread_entry()->pagetable);
+	    process_interrupt_check();
+	}
+#elif defined(CHANGED_4)
 	if (thread_get_current_thread_entry()->pagetable != NULL) {
 	    _tlb_set_asid(thread_get_current_thread_entry()->pagetable->ASID);
 	}
@@ -0,0 +1,122 @@
+/*
+ * kprof.c
+ *
+ *  Kernel PC sampling profiler. Enabled with the boot argument "kprof".
+ *  The timer interrupt counts the PC of the thread it interrupted in
+ *  kernel mode in a table of the CPU, and the tables are printed at
+ *  shutdown for util/pcprof.
+ */
+
+#ifdef CHANGED_5
+
+#include "kernel/kprof.h"
+#include "kernel/config.h"
+#include "kernel/interrupt.h"
+#include "kernel/thread.h"
+#include "drivers/bootargs.h"
+#include "lib/libc.h"
+
+/* distinct PCs counted per CPU, a power of two */
+#define KPROF_ENTRIES 512
+/* slots looked at before a new PC is dropped */
+#define KPROF_PROBES 16
+
+extern TID_t scheduler_current_thread[CONFIG_MAX_CPUS];
+
+typedef struct {
+    uint32_t pc;
+    uint32_t count;
+} kprof_entry_t;
+
+/* Each CPU only writes its own table from the timer interrupt, so
+   the tables need no locks. */
+typedef struct {
+    /* open addressing hash table of PCs */
+    kprof_entry_t entries[KPROF_ENTRIES];
+    /* timer interrupts on the CPU */
+    uint32_t samples;
+    /* samples that found the CPU in userland */
+    uint32_t user;
+    /* samples that found the CPU idle */
+    uint32_t idle;
+    /* kernel PCs that did not fit in the table */
+    uint32_t dropped;
+} kprof_cpu_t;
+
+static kprof_cpu_t kprof_cpus[CONFIG_MAX_CPUS];
+
+static int kprof_enabled = 0;
+
+void kprof_init(void) {
+    if (bootargs_get("kprof") != NULL) {
+        memoryset(kprof_cpus, 0, sizeof(kprof_cpus));
+        kprof_enabled = 1;
+        kprintf("Kernel profiler enabled\n");
+    }
+}
+
+/* Called from the timer interrupt before the scheduler, while the
+   interrupted thread is still the current one. */
+void kprof_sample(void) {
+    kprof_cpu_t *cpu;
+    context_t *context;
+    uint32_t i, probe;
+    int this_cpu;
+
+    if (!kprof_enabled)
+        return;
+    this_cpu = _interrupt_getcpu();
+    cpu = &kprof_cpus[this_cpu];
+    cpu->samples++;
+
+    if (scheduler_current_thread[this_cpu] == IDLE_THREAD_TID) {
+        cpu->idle++;
+        return;
+    }
+    context = thread_get_current_thread_entry()->context;
+    if (context->status & USERLAND_ENABLE_BIT) {
+        cpu->user++;
+        return;
+    }
+
+    i = context->pc >> 2;
+    for (probe = 0; probe < KPROF_PROBES; probe++, i++) {
+        i &= KPROF_ENTRIES - 1;
+        if (cpu->entries[i].pc == context->pc) {
+            cpu->entries[i].count++;
+            return;
+        }
+        if (cpu->entries[i].count == 0) {
+            cpu->entries[i].pc = context->pc;
+            cpu->entries[i].count = 1;
+            return;
+        }
+    }
+    cpu->dropped++;
+}
+
+/* Prints the samples of every CPU, one "kprof 0x<pc> <count>" line
+   per PC. util/pcprof reads these from the console log. */
+void kprof_dump(void) {
+    kprof_cpu_t *cpu;
+    int i, j;
+
+    if (!kprof_enabled)
+        return;
+    kprof_enabled = 0;
+
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+        cpu = &kprof_cpus[i];
+        if (cpu->samples == 0)
+            continue;
+        kprintf("# kprof CPU %d: %d samples, %d user, %d idle, %d dropped\n",
+                i, cpu->samples, cpu->user, cpu->idle, cpu->dropped);
+        for (j = 0; j < KPROF_ENTRIES; j++) {
+            if (cpu->entries[j].count != 0)
+                kprintf("kprof 0x%.8x %d\n", cpu->entries[j].pc,
+                        cpu->entries[j].count);
+        }
+    }
+}
+
+#endif /* CHANGED_5 */
@@ -0,0 +1,18 @@
+/*
+ * kprof.h
+ *
+ *  Kernel PC sampling profiler.
+ */
+
+#ifndef BUENOS_KERNEL_KPROF_H
+#define BUENOS_KERNEL_KPROF_H
+
+#ifdef CHANGED_5
+
+void kprof_init(void);
+void kprof_sample(void);
+void kprof_dump(void);
+
+#endif /* CHANGED_5 */
+
+#endif /* BUENOS_KERNEL_KPROF_H */
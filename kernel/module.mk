@@ -6,7 +6,7 @@ MODULE := kernel
 
 FILES := cswitch.S panic.c kmalloc.c interrupt.c thread.c \
          scheduler.c _interrupt.S _spinlock.S idle.S sleepq.c semaphore.c \
-         exception.c halt.c lock_cond.c
+         exception.c halt.c lock_cond.c kprof.c
 
 SRC += $(patsubst %, $(MODULE)/%, $(FILES))
 
@@ -67,6 +67,13 @@ TID_t thread_next_sleeper_id;
 /* Thread stack areas for kernel threads */
 char thread_stack_areas[CONFIG_THREAD_STACKSIZE * CONFIG_MAX_THREADS];
 
+#ifdef CHANGED_5
+/* Stacks of the idle thread, one for each CPU, used by kernel/idle.S
+   while zeroing pages. The CPUs share the context of the idle thread,
+   and with it the stack in thread_stack_areas. */
+char thread_idle_stacks[CONFIG_THREAD_STACKSIZE * CONFIG_MAX_CPUS];
+#endif
+
 /* Import running thread id table from scheduler */
 extern TID_t scheduler_current_thread[CONFIG_MAX_CPUS];
 
@@ -116,6 +123,9 @@ void thread_table_init(void)
     #ifdef CHANGED_2
     thread_table[i].userland_pid = -1;
     #endif
+    #ifdef CHANGED_5
+    thread_table[i].aborted = 0;
+    #endif
     }
 
     thread_table[IDLE_THREAD_TID].context->cpu_regs[MIPS_REGISTER_SP] =
@@ -196,6 +206,9 @@ TID_t thread_create_with_priority(void (*func)(uint32_t), uint32_t arg, priority
     thread_table[tid].sleeps_on    = 0;
     thread_table[tid].process_id   = -1;
     thread_table[tid].next         = -1;
+#ifdef CHANGED_5
+    thread_table[tid].aborted      = 0;
+#endif
 
     /* the change */
     KERNEL_ASSERT(p == THREAD_PRIORITY_HIGH || p == THREAD_PRIORITY_NORMAL);
@@ -287,6 +300,9 @@ TID_t thread_create(void (*func)(uint32_t), uint32_t arg)
     thread_table[tid].sleeps_on    = 0;
     thread_table[tid].process_id   = -1;
     thread_table[tid].next         = -1;
+#ifdef CHANGED_5
+    thread_table[tid].aborted      = 0;
+#endif
 
     #ifdef CHANGED_ADDITIONAL_1
     /* the change */
@@ -336,6 +352,34 @@ void thread_run(TID_t t)
     scheduler_add_ready(t);
 }
 
+#ifdef CHANGED_5
+/** Asks a thread to give up waits that may never end, such as reading
+ * a pipe or the console. Such waits check thread_is_aborted() and
+ * return early; the caller still has to wake the thread from them.
+ * Used to stop the other threads of an exiting process.
+ *
+ * @param t The ID of the thread.
+ */
+void thread_abort(TID_t t)
+{
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&thread_table_slock);
+    thread_table[t].aborted = 1;
+    spinlock_release(&thread_table_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/** Returns 1 if thread_abort() has been called for the current thread,
+ * 0 otherwise.
+ */
+int thread_is_aborted(void)
+{
+    return thread_get_current_thread_entry()->aborted;
+}
+#endif
+
 
 
 /** Perform voluntary rescheduling. The current (=calling) thread will
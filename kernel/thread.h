@@ -97,7 +97,13 @@ typedef struct {
 
             #ifdef CHANGED_2
                 PID_t userland_pid;
+                #ifdef CHANGED_5
+                /* set by thread_abort() */
+                int aborted;
+                uint32_t dummy_alignment_fill[4];
+                #else
                 uint32_t dummy_alignment_fill[5];
+                #endif
             #else
                 /* pad to 64 bytes */
                 uint32_t dummy_alignment_fill[6];
@@ -106,7 +112,13 @@ typedef struct {
         #else /* use fill as in CHANGED_1 */
             #ifdef CHANGED_2
                 PID_t userland_pid;
+                #ifdef CHANGED_5
+                /* set by thread_abort() */
+                int aborted;
+                uint32_t dummy_alignment_fill[5];
+                #else
                 uint32_t dummy_alignment_fill[6];
+                #endif
             #else
                 /* pad to 64 bytes */
                 uint32_t dummy_alignment_fill[7];
@@ -130,6 +142,11 @@ TID_t thread_create_with_priority(void (*func)(uint32_t), uint32_t arg, priority
 
 void thread_run(TID_t t);
 
+#ifdef CHANGED_5
+void thread_abort(TID_t t);
+int thread_is_aborted(void);
+#endif
+
 TID_t thread_get_current_thread(void);
 thread_table_t *thread_get_current_thread_entry(void);
 
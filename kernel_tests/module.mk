@@ -5,7 +5,8 @@ MODULE := kernel_tests
 
 
 FILES := make_water.c lock_tests.c cond_tests.c thread_sleep_tests.c canal.c \
- thread_priority_tests.c test_network.c test_sfs.c
+ thread_priority_tests.c test_network.c test_sfs.c test_tlb.c test_user_copy.c \
+ test_libc.c
 
 SRC += $(patsubst %, $(MODULE)/%, $(FILES))
 
@@ -0,0 +1,154 @@
+/*
+ * test_libc.c
+ *
+ *  Benchmark of memcopy and memoryset for sizes from 16 bytes to
+ *  64 kilobytes, with aligned, equally misaligned and differently
+ *  aligned buffers. Compares them with the byte and word loops they
+ *  replaced and checks the results.
+ */
+
+#ifdef CHANGED_5
+
+#include "kernel_tests/test_libc.h"
+#include "kernel/assert.h"
+#include "drivers/timer.h"
+#include "drivers/yams.h"
+#include "vm/pagepool.h"
+#include "lib/libc.h"
+
+/* Largest size, the buffers have a page more for the offsets. */
+#define BENCH_MAX_SIZE  (64 * 1024)
+#define BENCH_PAGES     (BENCH_MAX_SIZE / PAGE_SIZE + 1)
+/* Bytes copied per measurement, at least one copy. */
+#define BENCH_BYTES     (32 * 1024)
+
+/* The old memcopy: a word loop if both buffers are aligned, a byte
+   loop otherwise. */
+static void old_memcopy(int buflen, void *target, const void *source)
+{
+    uint32_t *tgt = (uint32_t *) target;
+    const uint32_t *src = (const uint32_t *) source;
+    char *t;
+    const char *s;
+    int i;
+
+    if (((uint32_t)tgt % 4) != 0 || ((uint32_t)src % 4) != 0) {
+        t = (char *) tgt;
+        s = (const char *) src;
+        for (i = 0; i < buflen; i++)
+            t[i] = s[i];
+        return;
+    }
+    for (i = 0; i < buflen / 4; i++)
+        *tgt++ = *src++;
+    t = (char *) tgt;
+    s = (const char *) src;
+    for (i = 0; i < buflen % 4; i++)
+        t[i] = s[i];
+}
+
+/* The old memoryset: a byte loop. */
+static void old_memoryset(void *target, char value, int size)
+{
+    char *tgt = (char *) target;
+    int i;
+
+    for (i = 0; i < size; i++)
+        tgt[i] = value;
+}
+
+static void bench_copy(char *target, const char *source, int size)
+{
+    uint32_t start, old, new;
+    int rounds, i;
+
+    rounds = MAX(1, BENCH_BYTES / size);
+
+    start = _timer_get_ticks();
+    for (i = 0; i < rounds; i++)
+        old_memcopy(size, target, source);
+    old = (_timer_get_ticks() - start) / rounds;
+
+    memoryset(target, 0, size);
+    start = _timer_get_ticks();
+    for (i = 0; i < rounds; i++)
+        memcopy(size, target, source);
+    new = (_timer_get_ticks() - start) / rounds;
+
+    for (i = 0; i < size; i++)
+        KERNEL_ASSERT(target[i] == source[i]);
+
+    kprintf("  %d bytes, offsets %d/%d: %d -> %d cycles\n", size,
+            (uint32_t)target & 3, (uint32_t)source & 3, old, new);
+}
+
+static void bench_set(char *target, int size)
+{
+    uint32_t start, old, new;
+    int rounds, i;
+
+    rounds = MAX(1, BENCH_BYTES / size);
+
+    start = _timer_get_ticks();
+    for (i = 0; i < rounds; i++)
+        old_memoryset(target, 0x5a, size);
+    old = (_timer_get_ticks() - start) / rounds;
+
+    target[size] = 0;
+    start = _timer_get_ticks();
+    for (i = 0; i < rounds; i++)
+        memoryset(target, (char)0xa5, size);
+    new = (_timer_get_ticks() - start) / rounds;
+
+    for (i = 0; i < size; i++)
+        KERNEL_ASSERT(target[i] == (char)0xa5);
+    KERNEL_ASSERT(target[size] == 0);
+
+    kprintf("  %d bytes, offset %d: %d -> %d cycles\n", size,
+            (uint32_t)target & 3, old, new);
+}
+
+void run_memcopy_benchmark()
+{
+    uint32_t source_phys, target_phys;
+    char *source, *target;
+    int size, i;
+
+    kprintf("Running memcopy/memoryset benchmark..\n");
+
+    source_phys = pagepool_get_contiguous(BENCH_PAGES, 1);
+    target_phys = pagepool_get_contiguous(BENCH_PAGES, 1);
+    if (source_phys == 0 || target_phys == 0) {
+        kprintf("* not enough contiguous memory\n");
+    } else {
+        source = (char *) ADDR_PHYS_TO_KERNEL(source_phys);
+        target = (char *) ADDR_PHYS_TO_KERNEL(target_phys);
+        for (i = 0; i < BENCH_PAGES * PAGE_SIZE; i++)
+            source[i] = (char)(i * 31 + i / 256);
+
+        kprintf("* memcopy, old -> new:\n");
+        for (size = 16; size <= BENCH_MAX_SIZE; size *= 4) {
+            bench_copy(target, source, size);
+            bench_copy(target + 1, source + 1, size);
+            bench_copy(target + 2, source + 1, size);
+            /* odd sizes exercise the tails */
+            bench_copy(target + 3, source, size + 3);
+        }
+
+        kprintf("* memoryset, old -> new:\n");
+        for (size = 16; size <= BENCH_MAX_SIZE; size *= 4) {
+            bench_set(target, size);
+            bench_set(target + 1, size + 1);
+        }
+    }
+
+    for (i = 0; i < BENCH_PAGES; i++) {
+        if (source_phys != 0)
+            pagepool_free_phys_page(source_phys + i * PAGE_SIZE);
+        if (target_phys != 0)
+            pagepool_free_phys_page(target_phys + i * PAGE_SIZE);
+    }
+    kprintf("OK!\n");
+}
+
+#endif
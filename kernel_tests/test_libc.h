@@ -0,0 +1,16 @@
+/*
+ * test_libc.h
+ *
+ *  Kernel benchmarks for the kernel C library.
+ */
+
+#ifndef TEST_LIBC_H_
+#define TEST_LIBC_H_
+
+#ifdef CHANGED_5
+
+void run_memcopy_benchmark();
+
+#endif
+
+#endif /* TEST_LIBC_H_ */
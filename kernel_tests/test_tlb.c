@@ -0,0 +1,162 @@
+/*
+ * test_tlb.c
+ *
+ *  TLB refill benchmark. Maps a range of user pages that is larger
+ *  than the TLB into the current kernel thread and walks over it a
+ *  few times, once with the assembler refill handler installed and
+ *  once with the C exception path, and reports the cycle counts.
+ *  A third walk maps the range with large pages (PageMask) to compare
+ *  the TLB miss rates.
+ */
+
+#ifdef CHANGED_5
+
+#include "kernel_tests/test_vm.h"
+#include "kernel/thread.h"
+#include "kernel/assert.h"
+#include "kernel/interrupt.h"
+#include "drivers/timer.h"
+#include "vm/vm.h"
+#include "vm/tlb.h"
+#include "vm/pagepool.h"
+#include "lib/libc.h"
+
+/* Number of pages touched per round, must exceed the TLB size. */
+#define BENCH_PAGES  96
+/* Number of walks over the whole range. */
+#define BENCH_ROUNDS 20
+/* Base of the benchmark mapping. */
+#define BENCH_VADDR  0x00400000
+
+static uint32_t walk_pages(void) {
+    uint32_t start, round, i, sum = 0;
+    volatile uint32_t *word;
+
+    start = _timer_get_ticks();
+    for (round = 0; round < BENCH_ROUNDS; round++) {
+        for (i = 0; i < BENCH_PAGES; i++) {
+            word = (uint32_t *) (BENCH_VADDR + i * PAGE_SIZE);
+            sum += *word;
+        }
+    }
+    KERNEL_ASSERT(sum == 0);
+    return _timer_get_ticks() - start;
+}
+
+static void bench_refill(int fast, const char *pages) {
+    tlb_stats_t stats;
+    uint32_t cycles, misses;
+
+    tlb_set_fast_refill(fast);
+    tlb_activate(thread_get_current_thread_entry()->pagetable);
+    tlb_reset_stats();
+    cycles = walk_pages();
+    tlb_get_stats(&stats);
+
+    misses = stats.fast_refills + stats.load_exceptions;
+    kprintf("* %s refill, %s pages: %d cycles for %d page touches, "
+            "%d fast refills, %d load exceptions\n",
+            fast ? "assembler" : "C", pages, cycles,
+            BENCH_PAGES * BENCH_ROUNDS,
+            stats.fast_refills, stats.load_exceptions);
+    kprintf("  TLB miss rate %d.%d%%\n",
+            misses * 100 / (BENCH_PAGES * BENCH_ROUNDS),
+            misses * 1000 / (BENCH_PAGES * BENCH_ROUNDS) % 10);
+}
+
+/* Maps the benchmark range into a new pagetable, with large pages where
+   they fit if large is set. Returns the number of large page pairs. */
+static int bench_map(pagetable_t *pagetable, int large) {
+    interrupt_status_t intr_status;
+    uint32_t vaddr, end, base, span, phys, page;
+    int size, blocks = 0;
+
+    end = BENCH_VADDR + BENCH_PAGES * PAGE_SIZE;
+    vaddr = BENCH_VADDR;
+    while (vaddr < end) {
+        size = large ? vm_large_block(vaddr, vaddr, end, &base) : 0;
+        if (size > 0) {
+            span = 2 * PAGETABLE_LARGE_PAGE_SIZE(size);
+            phys = pagepool_get_contiguous(span / PAGE_SIZE,
+                    PAGETABLE_LARGE_PAGE_SIZE(size) / PAGE_SIZE);
+            if (phys != 0) {
+                for (page = 0; page < span; page += PAGE_SIZE)
+                    memoryset((void *) ADDR_PHYS_TO_KERNEL(phys + page), 0,
+                              PAGE_SIZE);
+                intr_status = _interrupt_disable();
+                KERNEL_ASSERT(vm_map_large(pagetable, phys, vaddr, size, 0) > 0);
+                _interrupt_set_state(intr_status);
+                blocks++;
+                vaddr += span;
+                continue;
+            }
+        }
+        phys = pagepool_get_phys_page();
+        KERNEL_ASSERT(phys != 0);
+        memoryset((void *) ADDR_PHYS_TO_KERNEL(phys), 0, PAGE_SIZE);
+        KERNEL_ASSERT(vm_map(pagetable, phys, vaddr, 0) > 0);
+        vaddr += PAGE_SIZE;
+    }
+
+    return blocks;
+}
+
+/* Releases the 4k pages of the pagetable, drops the mappings from TLB,
+   large page rows included, and destroys the table. The large pages
+   are released with the table. */
+static void bench_release(pagetable_t *pagetable) {
+    interrupt_status_t intr_status;
+    uint32_t i;
+
+    intr_status = _interrupt_disable();
+    thread_get_current_thread_entry()->pagetable = NULL;
+    for (i = 0; i < pagetable->valid_count; i++) {
+        if (pagetable->entries[i].V0)
+            pagepool_free_phys_page(pagetable->entries[i].PFN0 << 12);
+        if (pagetable->entries[i].V1)
+            pagepool_free_phys_page(pagetable->entries[i].PFN1 << 12);
+        pagetable->entries[i].V0 = pagetable->entries[i].V1 = 0;
+    }
+    tlb_flush();
+    _interrupt_set_state(intr_status);
+
+    vm_destroy_pagetable(pagetable);
+}
+
+void run_tlb_benchmark() {
+    thread_table_t *thread = thread_get_current_thread_entry();
+    pagetable_t *pagetable;
+    interrupt_status_t intr_status;
+
+    kprintf("Running TLB refill benchmark..\n");
+
+    pagetable = vm_create_pagetable();
+    KERNEL_ASSERT(pagetable != NULL);
+    bench_map(pagetable, 0);
+
+    intr_status = _interrupt_disable();
+    thread->pagetable = pagetable;
+    _interrupt_set_state(intr_status);
+
+    bench_refill(0, "4k");
+    bench_refill(1, "4k");
+    bench_release(pagetable);
+
+    /* the same walk with the range mapped with large pages */
+    pagetable = vm_create_pagetable();
+    KERNEL_ASSERT(pagetable != NULL);
+    if (bench_map(pagetable, 1) > 0) {
+        intr_status = _interrupt_disable();
+        thread->pagetable = pagetable;
+        _interrupt_set_state(intr_status);
+        bench_refill(1, "large");
+    } else {
+        kprintf("* no large pages (not supported or no contiguous memory)\n");
+    }
+    bench_release(pagetable);
+
+    tlb_reset_stats();
+    kprintf("OK!\n");
+}
+
+#endif
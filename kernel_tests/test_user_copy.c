@@ -0,0 +1,151 @@
+/*
+ * test_user_copy.c
+ *
+ *  Benchmark of copying system call arguments from and to user
+ *  memory. Compares copy_from_user and copy_string_from_user with a
+ *  byte by byte copy that translates each page through the pagetable
+ *  first, as the syscall helpers used to do, and checks that bad
+ *  addresses make the copies fail instead of killing the thread.
+ */
+
+#ifdef CHANGED_5
+
+#include "kernel_tests/test_vm.h"
+#include "kernel/thread.h"
+#include "kernel/assert.h"
+#include "kernel/interrupt.h"
+#include "drivers/timer.h"
+#include "proc/syscall.h"
+#include "vm/vm.h"
+#include "vm/tlb.h"
+#include "vm/pagepool.h"
+#include "lib/libc.h"
+
+/* Number of mapped user pages. */
+#define COPY_PAGES   8
+/* Base of the mapping. */
+#define COPY_VADDR   0x00400000
+/* Number of copies per measurement. */
+#define COPY_ROUNDS  20
+
+static char copy_buffer[COPY_PAGES * PAGE_SIZE];
+
+/* The old way: a translation per page and a byte at a time. */
+static int byte_copy_from_user(pagetable_t *pagetable, void *target,
+                               const void *source, int size) {
+    uint32_t i, vaddr, physoff, virtoff;
+
+    i = 0;
+    while (i < (uint32_t)size) {
+        vaddr = (uint32_t)source + i;
+        if (!vm_get_vaddr_page_offsets(pagetable, vaddr, &physoff, &virtoff))
+            return RETVAL_SYSCALL_HELPERS_NOK;
+        for (; vaddr < virtoff + PAGE_SIZE && i < (uint32_t)size;
+             i++, vaddr++) {
+            ((char *)target)[i] = ((const char *)source)[i];
+        }
+    }
+    return RETVAL_SYSCALL_HELPERS_OK;
+}
+
+static void bench_copy(pagetable_t *pagetable, int offset, int size) {
+    uint32_t start, bytes, words;
+    int i;
+
+    start = _timer_get_ticks();
+    for (i = 0; i < COPY_ROUNDS; i++) {
+        KERNEL_ASSERT(byte_copy_from_user(pagetable, copy_buffer,
+                (void *)(COPY_VADDR + offset), size)
+                == RETVAL_SYSCALL_HELPERS_OK);
+    }
+    bytes = _timer_get_ticks() - start;
+
+    start = _timer_get_ticks();
+    for (i = 0; i < COPY_ROUNDS; i++) {
+        KERNEL_ASSERT(copy_from_user(copy_buffer,
+                (void *)(COPY_VADDR + offset), size)
+                == RETVAL_SYSCALL_HELPERS_OK);
+    }
+    words = _timer_get_ticks() - start;
+
+    kprintf("* %d bytes at offset %d: %d cycles per copy byte by byte, "
+            "%d with copy_from_user\n", size, offset,
+            bytes / COPY_ROUNDS, words / COPY_ROUNDS);
+}
+
+void run_user_copy_benchmark() {
+    thread_table_t *thread = thread_get_current_thread_entry();
+    pagetable_t *pagetable;
+    interrupt_status_t intr_status;
+    uint32_t i, phys, start;
+    char *string;
+    int ret;
+
+    kprintf("Running syscall argument copy benchmark..\n");
+
+    pagetable = vm_create_pagetable();
+    KERNEL_ASSERT(pagetable != NULL);
+    for (i = 0; i < COPY_PAGES; i++) {
+        phys = pagepool_get_phys_page();
+        KERNEL_ASSERT(phys != 0);
+        memoryset((void *) ADDR_PHYS_TO_KERNEL(phys), 'a' + i, PAGE_SIZE);
+        KERNEL_ASSERT(vm_map(pagetable, phys,
+                             COPY_VADDR + i * PAGE_SIZE, 1) > 0);
+    }
+
+    intr_status = _interrupt_disable();
+    thread->pagetable = pagetable;
+    _interrupt_set_state(intr_status);
+    tlb_activate(pagetable);
+
+    bench_copy(pagetable, 0, 16);
+    bench_copy(pagetable, 0, 256);
+    bench_copy(pagetable, 3, 256);
+    bench_copy(pagetable, 0, 4 * PAGE_SIZE);
+    bench_copy(pagetable, 100, 4 * PAGE_SIZE);
+
+    /* a path name crossing a page boundary */
+    string = (char *)(COPY_VADDR + PAGE_SIZE - 20);
+    KERNEL_ASSERT(copy_to_user(string + 39, "", 1)
+                  == RETVAL_SYSCALL_HELPERS_OK);
+    start = _timer_get_ticks();
+    for (i = 0; i < COPY_ROUNDS; i++) {
+        ret = copy_string_from_user(copy_buffer, string, 256);
+        KERNEL_ASSERT(ret == 40);
+    }
+    kprintf("* 40 byte string: %d cycles per copy\n",
+            (_timer_get_ticks() - start) / COPY_ROUNDS);
+
+    /* data must survive the round trip */
+    KERNEL_ASSERT(copy_from_user(copy_buffer, (void *)COPY_VADDR + 5,
+                  PAGE_SIZE) == RETVAL_SYSCALL_HELPERS_OK);
+    KERNEL_ASSERT(copy_buffer[0] == 'a' && copy_buffer[PAGE_SIZE - 1] == 'b');
+
+    /* bad addresses fail the copy */
+    KERNEL_ASSERT(copy_from_user(copy_buffer,
+                  (void *)(COPY_VADDR + COPY_PAGES * PAGE_SIZE - 8), 16)
+                  == RETVAL_SYSCALL_HELPERS_NOK);
+    KERNEL_ASSERT(copy_to_user((void *)0x10, copy_buffer, 4)
+                  == RETVAL_SYSCALL_HELPERS_NOK);
+    KERNEL_ASSERT(copy_from_user(copy_buffer, copy_buffer, 4)
+                  == RETVAL_SYSCALL_HELPERS_NOK);
+    KERNEL_ASSERT(copy_string_from_user(copy_buffer, string, 10)
+                  == RETVAL_SYSCALL_HELPERS_NOK);
+
+    intr_status = _interrupt_disable();
+    thread->pagetable = NULL;
+    for (i = 0; i < pagetable->valid_count; i++) {
+        if (pagetable->entries[i].V0)
+            pagepool_free_phys_page(pagetable->entries[i].PFN0 << 12);
+        if (pagetable->entries[i].V1)
+            pagepool_free_phys_page(pagetable->entries[i].PFN1 << 12);
+        pagetable->entries[i].V0 = pagetable->entries[i].V1 = 0;
+    }
+    tlb_flush();
+    _interrupt_set_state(intr_status);
+
+    vm_destroy_pagetable(pagetable);
+    kprintf("OK!\n");
+}
+
+#endif
@@ -0,0 +1,17 @@
+/*
+ * test_vm.h
+ *
+ *  Kernel tests and benchmarks for the virtual memory subsystem.
+ */
+
+#ifndef TEST_VM_H_
+#define TEST_VM_H_
+
+#ifdef CHANGED_5
+
+void run_tlb_benchmark();
+void run_user_copy_benchmark();
+
+#endif
+
+#endif /* TEST_VM_H_ */
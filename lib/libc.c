@@ -177,6 +177,85 @@ char *stringcopy(char *target, const char *source, int buflen)
  * @param source The source buffer to be copied.
  *
  */
+#ifdef CHANGED_5
+void memcopy(int buflen, void *target, const void *source)
+{
+    uint8_t *t;
+    const uint8_t *s;
+    uint32_t *tw;
+    const uint32_t *sw;
+    uint32_t w0, w1;
+    int shift;
+
+    t = (uint8_t *) target;
+    s = (const uint8_t *) source;
+
+    /* bytes up to the first word of the target */
+    while (buflen > 0 && ((uint32_t)t & 3) != 0) {
+        *t++ = *s++;
+        buflen--;
+    }
+    tw = (uint32_t *) t;
+
+    if (((uint32_t)s & 3) == 0) {
+        /* both aligned, a 32 byte cache line per round */
+        sw = (const uint32_t *) s;
+        while (buflen >= 32) {
+            tw[0] = sw[0];
+            tw[1] = sw[1];
+            tw[2] = sw[2];
+            tw[3] = sw[3];
+            tw[4] = sw[4];
+            tw[5] = sw[5];
+            tw[6] = sw[6];
+            tw[7] = sw[7];
+            tw += 8;
+            sw += 8;
+            buflen -= 32;
+        }
+        while (buflen >= 4) {
+            *tw++ = *sw++;
+            buflen -= 4;
+        }
+        s = (const uint8_t *) sw;
+    } else if (buflen >= 4) {
+        /* differently aligned: each target word is merged from two
+           aligned source words. MIPS in YAMS is big-endian, so the
+           first bytes are the high bits. Reading the whole words
+           never crosses a page beyond the source. */
+        shift = ((uint32_t)s & 3) * 8;
+        sw = (const uint32_t *) ((uint32_t)s & ~3);
+        w0 = *sw++;
+        while (buflen >= 16) {
+            w1 = sw[0];
+            tw[0] = (w0 << shift) | (w1 >> (32 - shift));
+            w0 = sw[1];
+            tw[1] = (w1 << shift) | (w0 >> (32 - shift));
+            w1 = sw[2];
+            tw[2] = (w0 << shift) | (w1 >> (32 - shift));
+            w0 = sw[3];
+            tw[3] = (w1 << shift) | (w0 >> (32 - shift));
+            tw += 4;
+            sw += 4;
+            buflen -= 16;
+        }
+        while (buflen >= 4) {
+            w1 = *sw++;
+            *tw++ = (w0 << shift) | (w1 >> (32 - shift));
+            w0 = w1;
+            buflen -= 4;
+        }
+        s = (const uint8_t *) sw - 4 + shift / 8;
+    }
+
+    /* the tail */
+    t = (uint8_t *) tw;
+    while (buflen > 0) {
+        *t++ = *s++;
+        buflen--;
+    }
+}
+#else
 void memcopy(int buflen, void *target, const void *source)
 {
     int i;
@@ -215,6 +294,7 @@ void memcopy(int buflen, void *target, const void *source)
 
     return;
 }
+#endif /* CHANGED_5 */
 
 
 /**
@@ -227,6 +307,46 @@ void memcopy(int buflen, void *target, const void *source)
  * @param size How many bytes to set.
  *
  */
+#ifdef CHANGED_5
+void memoryset(void *target, char value, int size)
+{
+    uint8_t *t;
+    uint32_t *tw;
+    uint32_t word;
+
+    t = (uint8_t *) target;
+    while (size > 0 && ((uint32_t)t & 3) != 0) {
+        *t++ = value;
+        size--;
+    }
+
+    /* a 32 byte cache line per round */
+    word = (uint8_t)value * 0x01010101;
+    tw = (uint32_t *) t;
+    while (size >= 32) {
+        tw[0] = word;
+        tw[1] = word;
+        tw[2] = word;
+        tw[3] = word;
+        tw[4] = word;
+        tw[5] = word;
+        tw[6] = word;
+        tw[7] = word;
+        tw += 8;
+        size -= 32;
+    }
+    while (size >= 4) {
+        *tw++ = word;
+        size -= 4;
+    }
+
+    t = (uint8_t *) tw;
+    while (size > 0) {
+        *t++ = value;
+        size--;
+    }
+}
+#else
 void memoryset(void *target, char value, int size)
 {
     int i;
@@ -236,6 +356,7 @@ void memoryset(void *target, char value, int size)
     for(i = 0; i < size; i++)
         tgt[i] = value;
 }
+#endif /* CHANGED_5 */
 
 /** Converts the initial portion of a string to an integer
  * (e.g. "-23av34" converts to -23 and "a123" to 0). Works just like
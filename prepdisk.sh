@@ -3,6 +3,10 @@
 # remove previous filesystem
 rm store.file
 
+echo "Creating swap disk..."
+# the second disk in yams.conf, 4MB of zeroes
+dd if=/dev/zero of=swap.file bs=512 count=8192 2> /dev/null
+
 echo "Creating file system storage..."
 # create new filesystem
 ./util/tfstool create store.file 2048 disk1
@@ -25,4 +29,17 @@ util/tfstool write store.file tests/bigfile.txt bigfile.txt
 util/tfstool write store.file tests/run_all_tests run_all_tests
 
 util/tfstool write store.file tests/test_malloc test_malloc
+util/tfstool write store.file tests/test_churn test_churn
 util/tfstool write store.file tests/test_memlimit test_memlimit
+util/tfstool write store.file tests/test_fork test_fork
+util/tfstool write store.file tests/test_swap test_swap
+util/tfstool write store.file tests/test_mmap test_mmap
+util/tfstool write store.file tests/test_stack test_stack
+util/tfstool write store.file tests/test_big test_big
+util/tfstool write store.file tests/test_threads test_threads
+util/tfstool write store.file tests/test_ring test_ring
+util/tfstool write store.file tests/test_aio test_aio
+util/tfstool write store.file tests/test_kdata test_kdata
+util/tfstool write store.file tests/test_stats test_stats
+util/tfstool write store.file tests/test_prof test_prof
+util/tfstool write store.file tests/test_pipe test_pipe
@@ -0,0 +1,261 @@
+/*
+ * aio.c
+ *
+ *  Asynchronous file reads and writes of user processes.
+ */
+
+#ifdef CHANGED_5
+
+#include "proc/aio.h"
+#include "proc/syscall.h"
+#include "kernel/thread.h"
+#include "kernel/interrupt.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleepq.h"
+#include "kernel/config.h"
+#include "lib/libc.h"
+
+#define AIO_FREE 0
+#define AIO_PENDING 1
+#define AIO_DONE 2
+
+/**
+ * An asynchronous request. The user buffer is pinned when the request
+ * is submitted and a kernel thread of its own runs the transfer, so
+ * the submitting thread does not wait for the disk and requests of one
+ * thread are on the disk at the same time.
+ */
+typedef struct {
+    /* AIO_FREE, AIO_PENDING or AIO_DONE */
+    int state;
+
+    /* process that submitted the request */
+    PID_t pid;
+
+    /* 1 for a write, 0 for a read */
+    int write;
+
+    /* duplicate of the file handle, closed when the request is done */
+    openfile_t file;
+
+    /* position in the file */
+    int offset;
+
+    /* bytes transferred or a negative VFS error, when done */
+    int result;
+
+    /* address space of the process, for unpinning the buffer */
+    pagetable_t *pagetable;
+
+    /* the user buffer as kernel addresses */
+    user_buffer_t buffer;
+} aio_request_t;
+
+static aio_request_t aio_requests[CONFIG_MAX_AIO_REQUESTS];
+
+/* Protects the states of the requests. Threads waiting for any request
+   to finish sleep on aio_requests. */
+static spinlock_t aio_slock;
+
+void aio_init(void) {
+    spinlock_reset(&aio_slock);
+    memoryset(aio_requests, 0, sizeof(aio_requests));
+}
+
+/* Kernel thread running one request */
+static void aio_worker(uint32_t arg) {
+    aio_request_t *request = &aio_requests[arg];
+    vfs_segment_t *segment;
+    interrupt_status_t intr_status;
+    int i, done, offset, result;
+
+    offset = request->offset;
+    result = 0;
+    for (i = 0 ; i < request->buffer.count ; i++) {
+        segment = &request->buffer.segments[i];
+        if (request->write)
+            done = vfs_write_at(request->file, segment->buffer,
+                                segment->size, offset);
+        else
+            done = vfs_read_at(request->file, segment->buffer,
+                               segment->size, offset);
+        if (done < 0) {
+            if (result == 0)
+                result = done;
+            break;
+        }
+        result += done;
+        offset += done;
+        // end of file
+        if (done < segment->size)
+            break;
+    }
+    unpin_user_buffer(request->pagetable, &request->buffer);
+    vfs_close(request->file);
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&aio_slock);
+    request->result = result;
+    request->state = AIO_DONE;
+    sleepq_wake_all(aio_requests);
+    spinlock_release(&aio_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* Frees a request that was reserved but could not be started */
+static void aio_free(aio_request_t *request) {
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&aio_slock);
+    request->state = AIO_FREE;
+    spinlock_release(&aio_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Starts reading or writing a buffer of the current process at given
+ * position of an open file. At most CONFIG_SYSCALL_MAX_PINNED_PAGES
+ * pages of the buffer are transferred.
+ *
+ * @param file Open file of the process.
+ * @param buffer Buffer in the process.
+ * @param length Size of the buffer.
+ * @param offset Position in the file.
+ * @param write 1 to write the buffer to the file, 0 to read.
+ *
+ * @return A token for the request, -1 if there are too many requests
+ * or the file is not open, or -2 if the buffer is not in the address
+ * space of the process.
+ */
+int aio_submit(openfile_t file, void *buffer, int length, int offset,
+               int write) {
+    interrupt_status_t intr_status;
+    aio_request_t *request;
+    TID_t worker;
+    int i, token;
+
+    if (length < 0 || offset < 0)
+        return -1;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&aio_slock);
+    token = -1;
+    for (i = 0 ; i < CONFIG_MAX_AIO_REQUESTS ; i++) {
+        if (aio_requests[i].state == AIO_FREE) {
+            aio_requests[i].state = AIO_PENDING;
+            aio_requests[i].pid = get_current_process_pid();
+            token = i;
+            break;
+        }
+    }
+    spinlock_release(&aio_slock);
+    _interrupt_set_state(intr_status);
+    if (token < 0)
+        return -1;
+
+    request = &aio_requests[token];
+    request->write = write;
+    request->offset = offset;
+    request->pagetable = thread_get_current_thread_entry()->pagetable;
+    if (vfs_dup(file) != VFS_OK) {
+        aio_free(request);
+        return -1;
+    }
+    request->file = file;
+    // reading from the file writes to the buffer
+    if (pin_user_buffer(request->pagetable, &request->buffer, buffer,
+                        length, !write) == RETVAL_SYSCALL_HELPERS_NOK) {
+        vfs_close(file);
+        aio_free(request);
+        return -2;
+    }
+
+    worker = thread_create(aio_worker, token);
+    if (worker < 0) {
+        unpin_user_buffer(request->pagetable, &request->buffer);
+        vfs_close(file);
+        aio_free(request);
+        return -1;
+    }
+    thread_run(worker);
+    return token;
+}
+
+/**
+ * Waits until any request of the current process is done and frees it.
+ *
+ * @param result Where the result of the request is stored, the number
+ * of bytes transferred or a negative VFS error.
+ *
+ * @return Token of the request, or -1 if the process has no requests.
+ */
+int aio_wait_any(int *result) {
+    interrupt_status_t intr_status;
+    PID_t pid = get_current_process_pid();
+    int i, token, pending;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&aio_slock);
+    while (1) {
+        token = -1;
+        pending = 0;
+        for (i = 0 ; i < CONFIG_MAX_AIO_REQUESTS ; i++) {
+            if (aio_requests[i].state == AIO_FREE ||
+                    aio_requests[i].pid != pid)
+                continue;
+            if (aio_requests[i].state == AIO_DONE) {
+                token = i;
+                break;
+            }
+            pending = 1;
+        }
+        if (token >= 0 || !pending)
+            break;
+        sleepq_add(aio_requests);
+        spinlock_release(&aio_slock);
+        thread_switch();
+        spinlock_acquire(&aio_slock);
+    }
+    if (token >= 0) {
+        *result = aio_requests[token].result;
+        aio_requests[token].state = AIO_FREE;
+    }
+    spinlock_release(&aio_slock);
+    _interrupt_set_state(intr_status);
+    return token;
+}
+
+/**
+ * Waits for all requests of an exiting process and frees them, so that
+ * no request uses the memory of the process after it has been freed.
+ */
+void aio_wait_process(PID_t pid) {
+    interrupt_status_t intr_status;
+    int i, pending;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&aio_slock);
+    do {
+        pending = 0;
+        for (i = 0 ; i < CONFIG_MAX_AIO_REQUESTS ; i++) {
+            if (aio_requests[i].state == AIO_FREE ||
+                    aio_requests[i].pid != pid)
+                continue;
+            if (aio_requests[i].state == AIO_DONE)
+                aio_requests[i].state = AIO_FREE;
+            else
+                pending = 1;
+        }
+        if (pending) {
+            sleepq_add(aio_requests);
+            spinlock_release(&aio_slock);
+            thread_switch();
+            spinlock_acquire(&aio_slock);
+        }
+    } while (pending);
+    spinlock_release(&aio_slock);
+    _interrupt_set_state(intr_status);
+}
+
+#endif /* CHANGED_5 */
@@ -0,0 +1,25 @@
+/*
+ * aio.h
+ *
+ *  Asynchronous file reads and writes of user processes.
+ */
+
+#ifndef BUENOS_PROC_AIO_H
+#define BUENOS_PROC_AIO_H
+
+#ifdef CHANGED_5
+
+#include "lib/types.h"
+#include "fs/vfs.h"
+#include "proc/process.h"
+
+void aio_init(void);
+
+int aio_submit(openfile_t file, void *buffer, int length, int offset,
+               int write);
+int aio_wait_any(int *result);
+void aio_wait_process(PID_t pid);
+
+#endif /* CHANGED_5 */
+
+#endif /* BUENOS_PROC_AIO_H */
@@ -0,0 +1,256 @@
+/*
+ * image.c
+ *
+ *  Cache of executable images shared by the processes running them.
+ */
+
+#ifdef CHANGED_5
+
+#include "proc/image.h"
+#include "kernel/lock_cond.h"
+#include "kernel/assert.h"
+#include "drivers/metadev.h"
+#include "drivers/yams.h"
+#include "vm/pagepool.h"
+#include "lib/libc.h"
+
+/* Maximum number of pages in the RO segment of an executable */
+#define IMAGE_MAX_RO_PAGES (PAGE_SIZE / sizeof(uint32_t))
+
+static image_t images[CONFIG_IMAGE_CACHE_SIZE];
+
+/* Protects the image table. Loading of pages is serialized by it as
+   well, because the seek position of the shared file handle must not
+   change between seek and read. */
+static lock_t *image_lock;
+
+void image_init(void) {
+    image_lock = lock_create();
+    KERNEL_ASSERT(image_lock != NULL);
+    memoryset(images, 0, sizeof(images));
+}
+
+/* Frees an image nobody is using. Called with image_lock held. */
+static void image_free(image_t *image) {
+    uint32_t i;
+
+    KERNEL_ASSERT(image->used && image->refcount == 0);
+    for (i = 0; i < image->elf.ro_pages; i++) {
+        if (image->ro_pages[i] != 0)
+            pagepool_free_phys_page(image->ro_pages[i]);
+    }
+    pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS((uint32_t)image->ro_pages));
+    vfs_close(image->file);
+    image->used = 0;
+}
+
+static int image_matches(image_t *image, vfs_file_identity_t *identity) {
+    return image->identity.fs == identity->fs &&
+        image->identity.fileid == identity->fileid;
+}
+
+/**
+ * Opens the executable image of given file. If the unmodified file is
+ * already in the cache, the cached image is shared, otherwise a new
+ * image is created. Unused images which have timed out or whose file
+ * has changed are freed on the way.
+ *
+ * @param path Executable file, including mountpoint.
+ *
+ * @return The image, or NULL if the file could not be opened, was not
+ * a valid executable or the cache is full of running images.
+ */
+image_t *image_open(const char *path) {
+    openfile_t file;
+    vfs_file_identity_t identity;
+    image_t *image, *victim;
+    uint32_t now, page;
+    int i;
+
+    file = vfs_open((char *)path);
+    if (file < 0)
+        return NULL;
+    if (vfs_get_identity(file, &identity) != VFS_OK) {
+        vfs_close(file);
+        return NULL;
+    }
+
+    lock_acquire(image_lock);
+    now = rtc_get_msec();
+
+    victim = NULL;
+    for (i = 0; i < CONFIG_IMAGE_CACHE_SIZE; i++) {
+        image = images + i;
+        if (!image->used) {
+            victim = image;
+            continue;
+        }
+        if (image_matches(image, &identity)) {
+            if (image->identity.version == identity.version) {
+                // cache hit, our own handle is not needed
+                image->refcount++;
+                lock_release(image_lock);
+                vfs_close(file);
+                return image;
+            }
+            // file has changed since the image was loaded
+            if (image->refcount == 0) {
+                image_free(image);
+                victim = image;
+            }
+            continue;
+        }
+        if (image->refcount == 0 &&
+                now - image->released >= CONFIG_IMAGE_CACHE_TIMEOUT) {
+            image_free(image);
+            victim = image;
+        }
+    }
+
+    // no free entry, replace the least recently used cached image
+    if (victim == NULL) {
+        for (i = 0; i < CONFIG_IMAGE_CACHE_SIZE; i++) {
+            image = images + i;
+            if (image->refcount == 0 && (victim == NULL ||
+                    now - image->released > now - victim->released)) {
+                victim = image;
+            }
+        }
+        if (victim == NULL) {
+            lock_release(image_lock);
+            vfs_close(file);
+            return NULL;
+        }
+        image_free(victim);
+    }
+
+    image = victim;
+    page = pagepool_get_zeroed_phys_page();
+    if (page == 0 || !elf_parse_header(&image->elf, file) ||
+            image->elf.ro_pages > IMAGE_MAX_RO_PAGES) {
+        if (page != 0)
+            pagepool_free_phys_page(page);
+        lock_release(image_lock);
+        vfs_close(file);
+        return NULL;
+    }
+
+    image->ro_pages = (uint32_t *)ADDR_PHYS_TO_KERNEL(page);
+    image->identity = identity;
+    image->file = file;
+    image->refcount = 1;
+    image->used = 1;
+
+    lock_release(image_lock);
+    return image;
+}
+
+/**
+ * Adds a process to the users of an open image.
+ */
+void image_ref(image_t *image) {
+    lock_acquire(image_lock);
+    KERNEL_ASSERT(image->used && image->refcount > 0);
+    image->refcount++;
+    lock_release(image_lock);
+}
+
+/**
+ * Releases an image opened with image_open or image_ref. The image
+ * stays cached after the last user has released it.
+ */
+void image_close(image_t *image) {
+    lock_acquire(image_lock);
+    KERNEL_ASSERT(image->used && image->refcount > 0);
+    if (--image->refcount == 0)
+        image->released = rtc_get_msec();
+    lock_release(image_lock);
+}
+
+/**
+ * Returns given page of the RO segment, loading it from the executable
+ * if this is the first use of the page. The page gets a reference for
+ * the caller, which must free it with pagepool_free_phys_page.
+ *
+ * @param image An open image.
+ *
+ * @param index Page number from the beginning of the RO segment.
+ *
+ * @return Physical address of the page, 0 on failure.
+ */
+uint32_t image_get_ro_page(image_t *image, uint32_t index) {
+    uint32_t phys, offset, length;
+
+    lock_acquire(image_lock);
+    KERNEL_ASSERT(index < image->elf.ro_pages);
+
+    phys = image->ro_pages[index];
+    if (phys == 0) {
+        phys = pagepool_get_phys_page();
+        if (phys == 0) {
+            lock_release(image_lock);
+            return 0;
+        }
+
+        offset = index * PAGE_SIZE;
+        length = 0;
+        if (offset < image->elf.ro_size) {
+            length = image->elf.ro_size - offset;
+            if (length > PAGE_SIZE)
+                length = PAGE_SIZE;
+        }
+        if (length < PAGE_SIZE)
+            memoryset((void *)(ADDR_PHYS_TO_KERNEL(phys) + length), 0,
+                      PAGE_SIZE - length);
+        if (length > 0 &&
+                (vfs_seek(image->file, image->elf.ro_location + offset) != VFS_OK ||
+                 vfs_read(image->file, (void *)ADDR_PHYS_TO_KERNEL(phys),
+                          length) != (int)length)) {
+            pagepool_free_phys_page(phys);
+            lock_release(image_lock);
+            return 0;
+        }
+        image->ro_pages[index] = phys;
+    }
+
+    pagepool_ref_phys_page(phys);
+    lock_release(image_lock);
+    return phys;
+}
+
+/**
+ * Reads data from the executable of an open image.
+ *
+ * @return 1 if all data was read, 0 on failure.
+ */
+int image_read(image_t *image, uint32_t offset, void *buffer, int length) {
+    int ok;
+
+    lock_acquire(image_lock);
+    ok = vfs_seek(image->file, offset) == VFS_OK &&
+        vfs_read(image->file, buffer, length) == length;
+    lock_release(image_lock);
+    return ok;
+}
+
+/**
+ * Frees all cached images that no process is using. Called when memory
+ * runs out.
+ *
+ * @return Number of images freed.
+ */
+int image_cache_shrink(void) {
+    int i, freed = 0;
+
+    lock_acquire(image_lock);
+    for (i = 0; i < CONFIG_IMAGE_CACHE_SIZE; i++) {
+        if (images[i].used && images[i].refcount == 0) {
+            image_free(images + i);
+            freed++;
+        }
+    }
+    lock_release(image_lock);
+    return freed;
+}
+
+#endif /* CHANGED_5 */
@@ -0,0 +1,62 @@
+/*
+ * image.h
+ *
+ *  Cache of executable images shared by the processes running them.
+ */
+
+#ifndef BUENOS_PROC_IMAGE_H
+#define BUENOS_PROC_IMAGE_H
+
+#ifdef CHANGED_5
+
+#include "lib/types.h"
+#include "fs/vfs.h"
+#include "proc/elf.h"
+#include "kernel/config.h"
+
+/**
+ * Executable image. The RO segment pages of an image are loaded once and
+ * mapped read-only into every process running the executable. An image
+ * stays in the cache for CONFIG_IMAGE_CACHE_TIMEOUT milliseconds after the
+ * last process using it has exited, so that running the same program
+ * again finds its code already in memory.
+ */
+typedef struct {
+    /* number of processes using the image, 0 if only cached */
+    int refcount;
+
+    /* 1 if this cache entry holds an image */
+    int used;
+
+    /* identity of the executable, never matched if file has changed */
+    vfs_file_identity_t identity;
+
+    /* the executable, kept open while the image is cached */
+    openfile_t file;
+
+    /* segment information of the executable */
+    elf_info_t elf;
+
+    /* physical pages of the RO segment, 0 if not loaded yet.
+       Stored on a page of its own, so RO segment can have at most
+       PAGE_SIZE / 4 pages. */
+    uint32_t *ro_pages;
+
+    /* rtc_get_msec() time when the image was last released */
+    uint32_t released;
+} image_t;
+
+void image_init(void);
+
+image_t *image_open(const char *path);
+void image_ref(image_t *image);
+void image_close(image_t *image);
+
+uint32_t image_get_ro_page(image_t *image, uint32_t index);
+int image_read(image_t *image, uint32_t offset, void *buffer, int length);
+
+int image_cache_shrink(void);
+
+#endif /* CHANGED_5 */
+
+#endif /* BUENOS_PROC_IMAGE_H */
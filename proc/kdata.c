@@ -0,0 +1,85 @@
+/*
+ * kdata.c
+ *
+ *  Kernel data pages mapped read-only into every process.
+ */
+
+#ifdef CHANGED_5
+
+#include "proc/kdata.h"
+#include "proc/syscall.h"
+#include "kernel/assert.h"
+#include "kernel/interrupt.h"
+#include "drivers/metadev.h"
+#include "vm/vm.h"
+#include "vm/pagepool.h"
+#include "vm/swap.h"
+#include "lib/libc.h"
+
+/* The page shared by all processes, physical and kernel address */
+static uint32_t kdata_phys;
+static syscall_kdata_t *kdata;
+
+void kdata_init(void) {
+    kdata_phys = pagepool_get_phys_page();
+    KERNEL_ASSERT(kdata_phys != 0);
+    kdata = (syscall_kdata_t *)ADDR_PHYS_TO_KERNEL(kdata_phys);
+    memoryset(kdata, 0, PAGE_SIZE);
+    kdata->cpus = cpustatus_count();
+    kdata->msec = rtc_get_msec();
+}
+
+/* Called on every timer interrupt. Only CPU 0 writes the page, so the
+   counter needs no lock. The values are single words, so a process
+   never sees half of an update. */
+void kdata_update(void) {
+    if (_interrupt_getcpu() != 0)
+        return;
+    kdata->msec = rtc_get_msec();
+    kdata->ticks++;
+    kdata->free_pages = pagepool_get_free_pages();
+}
+
+/**
+ * Maps the kernel data pages read-only at SYSCALL_KDATA_ADDR: the page
+ * shared by all processes, and a new page of the process itself. A
+ * page of another process, copied by fork, is replaced.
+ *
+ * @param pagetable Address space of the process.
+ * @param pid PID of the process as seen by userland.
+ *
+ * @return 0, or -1 if there is no memory for the pages.
+ */
+int kdata_map(pagetable_t *pagetable, PID_t pid) {
+    interrupt_status_t intr_status;
+    syscall_kdata_process_t *data;
+    uint32_t phys, physoff, virtoff;
+    int ret = 0;
+
+    // not given to the swap, as the pages have no owner
+    phys = swap_get_page(1);
+    if (phys == 0)
+        return -1;
+    data = (syscall_kdata_process_t *)ADDR_PHYS_TO_KERNEL(phys);
+    data->pid = pid;
+
+    intr_status = _interrupt_disable();
+    if (!vm_get_vaddr_page_offsets(pagetable, SYSCALL_KDATA_ADDR,
+                                   &physoff, &virtoff)) {
+        pagepool_ref_phys_page(kdata_phys);
+        if (vm_map(pagetable, kdata_phys, SYSCALL_KDATA_ADDR, 0) < 0) {
+            pagepool_free_phys_page(kdata_phys);
+            ret = -1;
+        }
+    }
+    vm_unmap(pagetable, SYSCALL_KDATA_ADDR + PAGE_SIZE);
+    if (ret == 0 &&
+            vm_map(pagetable, phys, SYSCALL_KDATA_ADDR + PAGE_SIZE, 0) < 0)
+        ret = -1;
+    if (ret < 0)
+        pagepool_free_phys_page(phys);
+    _interrupt_set_state(intr_status);
+    return ret;
+}
+
+#endif /* CHANGED_5 */
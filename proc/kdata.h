@@ -0,0 +1,22 @@
+/*
+ * kdata.h
+ *
+ *  Kernel data pages mapped read-only into every process.
+ */
+
+#ifndef BUENOS_PROC_KDATA_H
+#define BUENOS_PROC_KDATA_H
+
+#ifdef CHANGED_5
+
+#include "lib/types.h"
+#include "vm/pagetable.h"
+#include "proc/process.h"
+
+void kdata_init(void);
+void kdata_update(void);
+int kdata_map(pagetable_t *pagetable, PID_t pid);
+
+#endif /* CHANGED_5 */
+
+#endif /* BUENOS_PROC_KDATA_H */
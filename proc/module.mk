@@ -5,7 +5,7 @@ MODULE := proc
 
 
 FILES := exception.c elf.c process.c syscall.c syscall_handler_fs.c syscall_handler_proc.c \
-		syscall_helpers.c
+		syscall_helpers.c image.c aio.c kdata.c pipe.c _user_copy.S
 
 SRC += $(patsubst %, $(MODULE)/%, $(FILES))
 
@@ -0,0 +1,258 @@
+/*
+ * pipe.c
+ *
+ *  Anonymous pipes between user processes.
+ */
+
+#ifdef CHANGED_5
+
+#include "proc/pipe.h"
+#include "kernel/interrupt.h"
+#include "kernel/spinlock.h"
+#include "kernel/sleepq.h"
+#include "kernel/thread.h"
+#include "lib/libc.h"
+
+#define PIPE_READ_END 0
+#define PIPE_WRITE_END 1
+
+/**
+ * A pipe is a ring buffer in the kernel. Readers wait on the pipe for
+ * data and writers wait on its buffer for space. The pipe is free when
+ * both ends are closed.
+ */
+typedef struct {
+    /* open handles to each end, indexed by PIPE_READ_END and
+       PIPE_WRITE_END */
+    int ends[2];
+
+    /* position of the first unread byte in buffer */
+    int head;
+
+    /* number of unread bytes */
+    int count;
+
+    char buffer[CONFIG_PIPE_BUFFER_SIZE];
+} pipe_t;
+
+static pipe_t pipes[CONFIG_MAX_PIPES];
+
+/* Protects all pipes */
+static spinlock_t pipe_slock;
+
+void pipe_init(void) {
+    spinlock_reset(&pipe_slock);
+    memoryset(pipes, 0, sizeof(pipes));
+}
+
+/* Returns the pipe of an open handle to given end, or NULL. Called
+   with pipe_slock held. */
+static pipe_t *pipe_get(openfile_t handle, int end) {
+    pipe_t *pipe;
+
+    if (!PIPE_IS_HANDLE(handle) || (handle - PIPE_HANDLE_BASE) % 2 != end)
+        return NULL;
+    pipe = &pipes[(handle - PIPE_HANDLE_BASE) / 2];
+    if (pipe->ends[end] == 0)
+        return NULL;
+    return pipe;
+}
+
+/**
+ * Creates a pipe with one handle to each end.
+ *
+ * @param read_end The handle of the read end is stored here.
+ * @param write_end The handle of the write end is stored here.
+ *
+ * @return 0, or -1 if all pipes are in use.
+ */
+int pipe_create(openfile_t *read_end, openfile_t *write_end) {
+    interrupt_status_t intr_status;
+    int i;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pipe_slock);
+    for (i = 0 ; i < CONFIG_MAX_PIPES ; i++) {
+        if (pipes[i].ends[PIPE_READ_END] == 0 &&
+                pipes[i].ends[PIPE_WRITE_END] == 0) {
+            pipes[i].ends[PIPE_READ_END] = 1;
+            pipes[i].ends[PIPE_WRITE_END] = 1;
+            pipes[i].head = 0;
+            pipes[i].count = 0;
+            break;
+        }
+    }
+    spinlock_release(&pipe_slock);
+    _interrupt_set_state(intr_status);
+
+    if (i == CONFIG_MAX_PIPES)
+        return -1;
+    *read_end = PIPE_HANDLE_BASE + 2 * i + PIPE_READ_END;
+    *write_end = PIPE_HANDLE_BASE + 2 * i + PIPE_WRITE_END;
+    return 0;
+}
+
+/* Opens another handle to the same end of a pipe. Returns 0, or -1
+   if the handle is not open. */
+int pipe_dup(openfile_t handle) {
+    interrupt_status_t intr_status;
+    pipe_t *pipe;
+    int end = (handle - PIPE_HANDLE_BASE) % 2;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pipe_slock);
+    pipe = pipe_get(handle, end);
+    if (pipe != NULL)
+        pipe->ends[end]++;
+    spinlock_release(&pipe_slock);
+    _interrupt_set_state(intr_status);
+    return pipe != NULL ? 0 : -1;
+}
+
+/* Closes a handle to a pipe. When the last handle to the write end is
+   closed, readers get end of file after the data left in the pipe.
+   When the last handle to the read end is closed, writes fail. */
+void pipe_close(openfile_t handle) {
+    interrupt_status_t intr_status;
+    pipe_t *pipe;
+    int end = (handle - PIPE_HANDLE_BASE) % 2;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pipe_slock);
+    pipe = pipe_get(handle, end);
+    if (pipe != NULL && --pipe->ends[end] == 0) {
+        if (end == PIPE_WRITE_END)
+            sleepq_wake_all(pipe);
+        else
+            sleepq_wake_all(pipe->buffer);
+    }
+    spinlock_release(&pipe_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Reads from a pipe to kernel buffers. Waits until there is data in
+ * the pipe, then reads as much of it as fits.
+ *
+ * @param handle Read end of the pipe.
+ * @param segments Buffers to read to, in order.
+ * @param count Number of segments.
+ *
+ * @return Number of bytes read, 0 at end of file (the pipe is empty
+ * and the write end closed), or -1 if the handle is not a read end or
+ * the thread was aborted (thread_abort) while waiting.
+ */
+int pipe_readv(openfile_t handle, vfs_segment_t *segments, int count) {
+    interrupt_status_t intr_status;
+    pipe_t *pipe;
+    int i, n, done, total = -1;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pipe_slock);
+    pipe = pipe_get(handle, PIPE_READ_END);
+    while (pipe != NULL && pipe->count == 0 &&
+            pipe->ends[PIPE_WRITE_END] > 0) {
+        if (thread_is_aborted()) {
+            pipe = NULL;
+            break;
+        }
+        sleepq_add(pipe);
+        spinlock_release(&pipe_slock);
+        thread_switch();
+        spinlock_acquire(&pipe_slock);
+    }
+
+    if (pipe != NULL) {
+        total = 0;
+        for (i = 0 ; i < count && pipe->count > 0 ; i++) {
+            done = 0;
+            while (done < segments[i].size && pipe->count > 0) {
+                n = MIN(segments[i].size - done,
+                        MIN(pipe->count, CONFIG_PIPE_BUFFER_SIZE - pipe->head));
+                memcopy(n, (char *)segments[i].buffer + done,
+                        pipe->buffer + pipe->head);
+                pipe->head = (pipe->head + n) % CONFIG_PIPE_BUFFER_SIZE;
+                pipe->count -= n;
+                done += n;
+            }
+            total += done;
+        }
+        if (total > 0)
+            sleepq_wake_all(pipe->buffer);
+    }
+    spinlock_release(&pipe_slock);
+    _interrupt_set_state(intr_status);
+    return total;
+}
+
+/**
+ * Writes kernel buffers to a pipe. Waits for space in the pipe until
+ * everything is written, the read end is closed or the thread is
+ * aborted (thread_abort).
+ *
+ * @param handle Write end of the pipe.
+ * @param segments Buffers to write, in order.
+ * @param count Number of segments.
+ *
+ * @return Number of bytes written, 0 if nothing was to be written, or
+ * -1 if the handle is not a write end or nothing could be written
+ * because the read end is closed.
+ */
+int pipe_writev(openfile_t handle, vfs_segment_t *segments, int count) {
+    interrupt_status_t intr_status;
+    pipe_t *pipe;
+    int i, n, tail, done, total = 0;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pipe_slock);
+    pipe = pipe_get(handle, PIPE_WRITE_END);
+    for (i = 0 ; pipe != NULL && i < count ; i++) {
+        done = 0;
+        while (done < segments[i].size && pipe->ends[PIPE_READ_END] > 0) {
+            if (pipe->count == CONFIG_PIPE_BUFFER_SIZE) {
+                if (thread_is_aborted())
+                    break;
+                sleepq_add(pipe->buffer);
+                spinlock_release(&pipe_slock);
+                thread_switch();
+                spinlock_acquire(&pipe_slock);
+                continue;
+            }
+            tail = (pipe->head + pipe->count) % CONFIG_PIPE_BUFFER_SIZE;
+            n = MIN(segments[i].size - done,
+                    MIN(CONFIG_PIPE_BUFFER_SIZE - pipe->count,
+                        CONFIG_PIPE_BUFFER_SIZE - tail));
+            memcopy(n, pipe->buffer + tail,
+                    (char *)segments[i].buffer + done);
+            pipe->count += n;
+            done += n;
+            sleepq_wake_all(pipe);
+        }
+        total += done;
+        if (done < segments[i].size)
+            break;
+    }
+    if (pipe == NULL || (total == 0 && i < count))
+        total = -1;
+    spinlock_release(&pipe_slock);
+    _interrupt_set_state(intr_status);
+    return total;
+}
+
+/* Wakes every thread waiting on a pipe, so that aborted threads see
+   that they were aborted. The others wait again. */
+void pipe_wake_all(void) {
+    interrupt_status_t intr_status;
+    int i;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pipe_slock);
+    for (i = 0 ; i < CONFIG_MAX_PIPES ; i++) {
+        sleepq_wake_all(&pipes[i]);
+        sleepq_wake_all(pipes[i].buffer);
+    }
+    spinlock_release(&pipe_slock);
+    _interrupt_set_state(intr_status);
+}
+
+#endif /* CHANGED_5 */
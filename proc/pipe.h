@@ -0,0 +1,33 @@
+/*
+ * pipe.h
+ *
+ *  Anonymous pipes between user processes.
+ */
+
+#ifndef BUENOS_PROC_PIPE_H
+#define BUENOS_PROC_PIPE_H
+
+#ifdef CHANGED_5
+
+#include "lib/types.h"
+#include "fs/vfs.h"
+#include "kernel/config.h"
+
+/* Pipe handles are numbered after the VFS open files, so that they can
+   be kept with the files of a process. Pipe i has the read end
+   PIPE_HANDLE_BASE + 2 * i and the write end one above it. */
+#define PIPE_HANDLE_BASE CONFIG_MAX_OPEN_FILES
+#define PIPE_IS_HANDLE(handle) ((handle) >= PIPE_HANDLE_BASE && \
+        (handle) < PIPE_HANDLE_BASE + 2 * CONFIG_MAX_PIPES)
+
+void pipe_init(void);
+int pipe_create(openfile_t *read_end, openfile_t *write_end);
+int pipe_dup(openfile_t handle);
+void pipe_close(openfile_t handle);
+int pipe_readv(openfile_t handle, vfs_segment_t *segments, int count);
+int pipe_writev(openfile_t handle, vfs_segment_t *segments, int count);
+void pipe_wake_all(void);
+
+#endif /* CHANGED_5 */
+
+#endif /* BUENOS_PROC_PIPE_H */
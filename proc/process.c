@@ -44,6 +44,11 @@
 #include "drivers/yams.h"
 #include "vm/vm.h"
 #include "vm/pagepool.h"
+#ifdef CHANGED_5
+#include "vm/tlb.h"
+#include "vm/swap.h"
+#include "lib/libc.h"
+#endif
 
 
 /** @name Process startup
@@ -56,8 +61,27 @@
 
 #include "proc/process_table.h"
 
-
+#ifdef CHANGED_5
+#include "kernel/sleepq.h"
+#include "kernel/spinlock.h"
+#include "drivers/device.h"
+#include "drivers/tty.h"
+#include "proc/aio.h"
+#include "proc/kdata.h"
+#include "proc/pipe.h"
+#include "proc/syscall.h"
+
+/* Pages of process table entries, process_table_size entries in all.
+   Entries are never given back to the pagepool. */
+static process_table_t *process_chunks[PROCESS_MAX_CHUNKS];
+static PID_t process_table_size;
+/* first free entry, linked through next_free */
+static PID_t process_free_list;
+/* protects the process table, the child lists and the entry states */
+static spinlock_t process_table_slock;
+#else
 process_table_t process_table[CONFIG_MAX_PROCESSES];
+#endif
 lock_t* process_table_lock;
 
 static void init_process_filehandle(process_table_t* entry){
@@ -75,20 +99,1001 @@ static void free_process_table_entry(process_table_t* entry) {
     entry->retval             = PROCESS_NO_RETVAL;
 #ifdef CHANGED_4
     entry->heap_vaddr         = 0;
+#endif
+#ifdef CHANGED_5
+    entry->heap_end           = 0;
+    entry->heap_pages         = 0;
+    entry->stack_bottom       = 0;
+    entry->stack_max_pages    = 0;
+    entry->prev               = PROCESS_NO_PARENT_PID;
+    entry->pagetable          = NULL;
+    entry->thread_count       = 0;
+    entry->exiting            = PROCESS_NO_OWNER_TID;
+    memoryset(entry->threads, 0, sizeof(entry->threads));
+    entry->ring               = 0;
+    entry->stats              = 0;
+    entry->profile            = 0;
+    entry->stdio[FILEHANDLE_STDIN]  = FILEHANDLE_STDIN;
+    entry->stdio[FILEHANDLE_STDOUT] = FILEHANDLE_STDOUT;
+    entry->image              = NULL;
+    entry->entry_point        = 0;
+    memoryset(entry->regions, 0, sizeof(entry->regions));
 #endif
     init_process_filehandle(entry);
 }
 
+#ifdef CHANGED_5
+static int add_process_region(process_table_t *entry, uint32_t vaddr,
+        uint32_t pages, int writable, image_t *image, int shared,
+        uint32_t file_offset, uint32_t file_size) {
+    int i;
+    process_region_t *region;
+
+    if (pages == 0)
+        return 1;
+    if (vaddr < PAGE_SIZE || (vaddr & ~PAGE_SIZE_MASK) != 0 ||
+            file_size > pages * PAGE_SIZE)
+        return 0;
+
+    for (i = 0 ; i < PROCESS_MAX_REGIONS ; i++) {
+        region = entry->regions + i;
+        if (region->vaddr == 0) {
+            region->vaddr       = vaddr;
+            region->pages       = pages;
+            region->writable    = writable;
+            region->image       = image;
+            region->shared      = shared;
+            region->file_offset = file_offset;
+            region->file_size   = file_size;
+            region->mapped      = 0;
+            region->file        = -1;
+            region->stack_pages = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Writes the pages of a file mapping the process has written back to
+ * the file and unmaps the region. Other processes sharing the pages
+ * copy-on-write keep their copies. The region is unmapped even if
+ * some pages could not be read back from swap or written; returns -1
+ * in that case and 0 otherwise. */
+static int unmap_file_region(process_table_t *entry, pagetable_t *pagetable,
+        int i) {
+    process_region_t region;
+    interrupt_status_t intr_status;
+    uint32_t offset, page, length, physoff, virtoff, phys;
+    int ret = 0;
+
+    intr_status = _interrupt_disable();
+    region = entry->regions[i];
+    // no more pages of the region are loaded after this
+    memoryset(entry->regions + i, 0, sizeof(process_region_t));
+
+    for (offset = 0 ; offset < region.pages * PAGE_SIZE ; offset += PAGE_SIZE) {
+        page = region.vaddr + offset;
+        // a written page in swap is read back to be written to the file
+        if (!vm_is_clean(pagetable, page) &&
+                swap_page_in(pagetable, page) < 0) {
+            kprintf("mmap: could not read back page 0x%8.8x from swap\n",
+                    page);
+            ret = -1;
+        }
+        if (!vm_is_clean(pagetable, page) &&
+                vm_get_vaddr_page_offsets(pagetable, page, &physoff, &virtoff)) {
+            length = MIN(region.file_size - offset, PAGE_SIZE);
+            phys = physoff << 12;
+            // the page stays allocated while it is written
+            pagepool_ref_phys_page(phys);
+            _interrupt_enable();
+            if (vfs_write_at(region.file, (void *)ADDR_PHYS_TO_KERNEL(phys),
+                             length, region.file_offset + offset)
+                    != (int)length)
+                ret = -1;
+            _interrupt_disable();
+            pagepool_free_phys_page(phys);
+        }
+        vm_unmap(pagetable, page);
+    }
+    _interrupt_set_state(intr_status);
+
+    vfs_close(region.file);
+    return ret;
+}
+
+/**
+ * Maps a range of an open file into the address space of the current
+ * process. The pages are read from the file when they are first
+ * touched. The mapping holds its own reference to the file, so the
+ * file may be closed while it is mapped.
+ *
+ * @param file Open file to map.
+ * @param offset Start of the range in the file, page aligned.
+ * @param length Length of the range in bytes.
+ * @return Virtual address of the mapping, 0 on error.
+ */
+uint32_t process_map_file(openfile_t file, uint32_t offset, uint32_t length) {
+    process_table_t *entry;
+    process_region_t *region;
+    interrupt_status_t intr_status;
+    uint32_t vaddr, pages;
+    int i;
+
+    entry = get_current_process_entry();
+    if (entry == NULL || length == 0 || (offset & ~PAGE_SIZE_MASK) != 0 ||
+            offset > 0x7fffffff ||
+            length > PROCESS_MMAP_END - PROCESS_MMAP_BASE)
+        return 0;
+    pages = (length + PAGE_SIZE - 1) / PAGE_SIZE;
+
+    if (vfs_dup(file) != VFS_OK)
+        return 0;
+
+    intr_status = _interrupt_disable();
+    // first fit in the mmap area
+    vaddr = PROCESS_MMAP_BASE;
+    i = 0;
+    while (i < PROCESS_MAX_REGIONS &&
+            vaddr + pages * PAGE_SIZE <= PROCESS_MMAP_END) {
+        region = entry->regions + i;
+        if (region->vaddr != 0 &&
+                region->vaddr < vaddr + pages * PAGE_SIZE &&
+                vaddr < region->vaddr + region->pages * PAGE_SIZE) {
+            vaddr = region->vaddr + region->pages * PAGE_SIZE;
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    if (vaddr + pages * PAGE_SIZE > PROCESS_MMAP_END ||
+            !add_process_region(entry, vaddr, pages, 1, NULL, 0,
+                                offset, length)) {
+        _interrupt_set_state(intr_status);
+        vfs_close(file);
+        return 0;
+    }
+    for (i = 0 ; i < PROCESS_MAX_REGIONS ; i++) {
+        if (entry->regions[i].vaddr == vaddr) {
+            entry->regions[i].mapped = 1;
+            entry->regions[i].file = file;
+        }
+    }
+    _interrupt_set_state(intr_status);
+
+    return vaddr;
+}
+
+/**
+ * Removes a file mapping of the current process created with
+ * process_map_file. Pages the process has written are written back to
+ * the file first.
+ *
+ * @param vaddr Address returned by process_map_file.
+ * @return 0 on success, -1 if there is no such mapping or some written
+ * pages could not be written back. The mapping is removed in both
+ * cases.
+ */
+int process_unmap_file(uint32_t vaddr) {
+    process_table_t *entry;
+    int i;
+
+    entry = get_current_process_entry();
+    if (entry == NULL || vaddr == 0)
+        return -1;
+
+    for (i = 0 ; i < PROCESS_MAX_REGIONS ; i++) {
+        if (entry->regions[i].mapped && entry->regions[i].vaddr == vaddr) {
+            return unmap_file_region(entry,
+                    thread_get_current_thread_entry()->pagetable, i);
+        }
+    }
+    return -1;
+}
+
+/**
+ * Removes all file mappings of the current process, see
+ * process_unmap_file. Called when the process exits.
+ */
+void process_unmap_all_files(void) {
+    process_table_t *entry;
+    int i;
+
+    entry = get_current_process_entry();
+    if (entry == NULL)
+        return;
+
+    for (i = 0 ; i < PROCESS_MAX_REGIONS ; i++) {
+        if (entry->regions[i].mapped) {
+            unmap_file_region(entry,
+                    thread_get_current_thread_entry()->pagetable, i);
+        }
+    }
+}
+
+/* Releases the executable image of an exited process, it stays cached
+ * for a while. Pages of the regions are released together with the rest
+ * of the page table. */
+void process_free_image(process_table_t *entry) {
+    image_t *image = entry->image;
+
+    entry->image = NULL;
+    memoryset(entry->regions, 0, sizeof(entry->regions));
+    if (image != NULL)
+        image_close(image);
+}
+#endif /* CHANGED_5 */
+
 #ifdef CHANGED_4
 /* this must be called before free_process_table_entry if heap is wanted to
  * be freed e.g. in initialization function this is not required
  */
 static void free_process_heap(process_table_t *proc, pagetable_t *pagetable) {
+#ifdef CHANGED_5
+    process_resize_heap(proc, pagetable, 0);
+#else
     if (proc->heap_vaddr)
         vm_unmap(pagetable, proc->heap_vaddr);
+#endif
 }
 #endif
 
+#ifdef CHANGED_5
+/* Loads the page at given offset of a private region to given physical
+ * page: the part backed by the file or the executable is read and the
+ * rest is cleared, unless the whole page is known to be zeroed already.
+ * Returns 1 on success and 0 if reading failed. */
+static int load_region_page(process_region_t *region, uint32_t offset,
+        uint32_t phys, int zeroed) {
+    uint32_t length;
+    int read;
+
+    length = 0;
+    if (offset < region->file_size) {
+        length = region->file_size - offset;
+        if (length > PAGE_SIZE)
+            length = PAGE_SIZE;
+    }
+    if (region->mapped && length > 0) {
+        // the file may end before the mapping does
+        read = vfs_read_at(region->file, (void *)ADDR_PHYS_TO_KERNEL(phys),
+                           length, region->file_offset + offset);
+        if (read < 0)
+            return 0;
+        length = read;
+    } else if (length > 0 && !image_read(region->image,
+                region->file_offset + offset,
+                (void *)ADDR_PHYS_TO_KERNEL(phys), length)) {
+        return 0;
+    }
+    if (!zeroed && length < PAGE_SIZE)
+        memoryset((void *)(ADDR_PHYS_TO_KERNEL(phys) + length), 0,
+                  PAGE_SIZE - length);
+    return 1;
+}
+
+/* Maps the aligned block at base with a large page pair of given size
+ * (see vm_large_block). The pages are taken physically contiguous and
+ * filled from the region, or zeroed if region is NULL (heap), before
+ * the block is mapped. Returns 1 if the block was mapped and 0 if some
+ * page of it is mapped already or there is no contiguous memory for it.
+ * Must be called with interrupts enabled. */
+static int map_large_block(pagetable_t *pagetable, process_region_t *region,
+        uint32_t base, int size) {
+    interrupt_status_t intr_status;
+    uint32_t span, block, page, physoff, virtoff, slot;
+    int ok;
+
+    span = 2 * PAGETABLE_LARGE_PAGE_SIZE(size);
+    ok = 1;
+    intr_status = _interrupt_disable();
+    for (page = base; page < base + span && ok; page += PAGE_SIZE) {
+        if (vm_get_vaddr_page_offsets(pagetable, page, &physoff, &virtoff) ||
+                vm_get_swap_slot(pagetable, page, &slot))
+            ok = 0;
+    }
+    _interrupt_set_state(intr_status);
+    if (!ok)
+        return 0;
+
+    block = pagepool_get_contiguous(span / PAGE_SIZE,
+            PAGETABLE_LARGE_PAGE_SIZE(size) / PAGE_SIZE);
+    if (block == 0)
+        return 0;
+    for (page = 0; page < span && ok; page += PAGE_SIZE) {
+        if (region == NULL)
+            memoryset((void *)ADDR_PHYS_TO_KERNEL(block + page), 0, PAGE_SIZE);
+        else
+            ok = load_region_page(region, base - region->vaddr + page,
+                                  block + page, 0);
+    }
+    if (ok) {
+        intr_status = _interrupt_disable();
+        ok = vm_map_large(pagetable, block, base, size,
+                          region == NULL || region->writable) > 0;
+        _interrupt_set_state(intr_status);
+    }
+    if (!ok) {
+        for (page = 0; page < span; page += PAGE_SIZE)
+            pagepool_free_phys_page(block + page);
+    }
+    return ok;
+}
+
+/* number of heap pages taken from the pagepool before they are mapped */
+#define HEAP_MAP_BATCH 32
+
+/* Makes the heap of the process given number of pages long. Aligned
+ * blocks of the new part that fit a large page are mapped with one
+ * directly from contiguous memory, the rest is mapped in batches of 4k
+ * pages all taken before any of them is mapped. New pages are zeroed.
+ * Returns 0 on success and -1 if there is not enough memory, in which
+ * case the heap keeps its old size. */
+int process_resize_heap(process_table_t *entry, pagetable_t *pagetable,
+                        uint32_t pages) {
+    interrupt_status_t intr_status;
+    uint32_t phys[HEAP_MAP_BATCH];
+    uint32_t old_pages, vaddr, end, base, n, got, mapped;
+    int size;
+
+    old_pages = entry->heap_pages;
+    end = entry->heap_vaddr + pages * PAGE_SIZE;
+    while (entry->heap_pages < pages) {
+        vaddr = entry->heap_vaddr + entry->heap_pages * PAGE_SIZE;
+        size = vm_large_block(vaddr, vaddr, end, &base);
+        if (size > 0 && map_large_block(pagetable, NULL, base, size)) {
+            entry->heap_pages += 2 * PAGETABLE_LARGE_PAGE_SIZE(size) / PAGE_SIZE;
+            continue;
+        }
+
+        // 4k pages up to the next block a large page could start at
+        n = pages - entry->heap_pages;
+        if (n > HEAP_MAP_BATCH)
+            n = HEAP_MAP_BATCH;
+        for (got = 1; got < n; got++) {
+            if (vm_large_block(vaddr + got * PAGE_SIZE,
+                               vaddr + got * PAGE_SIZE, end, &base) > 0)
+                break;
+        }
+        n = got;
+        // may sleep until swap has freed pages
+        for (got = 0; got < n; got++) {
+            phys[got] = swap_get_page(1);
+            if (phys[got] == 0)
+                break;
+        }
+
+        intr_status = _interrupt_disable();
+        mapped = 0;
+        if (got == n) {
+            for (; mapped < n; mapped++) {
+                vaddr = entry->heap_vaddr +
+                    (entry->heap_pages + mapped) * PAGE_SIZE;
+                if (vm_map(pagetable, phys[mapped], vaddr, 1) < 0)
+                    break;
+                pagepool_set_owner(phys[mapped], pagetable, vaddr);
+            }
+        }
+        entry->heap_pages += mapped;
+        _interrupt_set_state(intr_status);
+
+        if (mapped < n) {
+            while (mapped < got)
+                pagepool_free_phys_page(phys[mapped++]);
+            process_resize_heap(entry, pagetable, old_pages);
+            return -1;
+        }
+    }
+
+    intr_status = _interrupt_disable();
+    while (entry->heap_pages > pages) {
+        entry->heap_pages--;
+        vm_unmap(pagetable, entry->heap_vaddr + entry->heap_pages * PAGE_SIZE);
+    }
+    _interrupt_set_state(intr_status);
+    return 0;
+}
+#endif /* CHANGED_5 */
+
+#ifdef CHANGED_5
+void process_table_init() {
+    interrupt_status_t stat;
+    stat = _interrupt_disable();
+    process_table_lock = lock_create();
+    spinlock_reset(&process_table_slock);
+    image_init();
+    aio_init();
+    kdata_init();
+    syscall_stats_init();
+    pipe_init();
+    // entries are allocated when processes are started
+    process_table_size = 0;
+    process_free_list = PROCESS_NO_PARENT_PID;
+    _interrupt_set_state(stat);
+}
+
+process_table_t *process_get_entry(PID_t pid) {
+    if (pid < 0 || pid >= process_table_size)
+        return NULL;
+    return process_chunks[pid / PROCESS_CHUNK_ENTRIES] +
+        pid % PROCESS_CHUNK_ENTRIES;
+}
+
+/* Returns the index of an entry of the process table */
+static PID_t process_entry_pid(process_table_t *entry) {
+    PID_t i;
+    for (i = 0 ; i * (PID_t)PROCESS_CHUNK_ENTRIES < process_table_size ; i++) {
+        if (entry >= process_chunks[i] &&
+                entry < process_chunks[i] + PROCESS_CHUNK_ENTRIES)
+            return i * PROCESS_CHUNK_ENTRIES + (entry - process_chunks[i]);
+    }
+    return PROCESS_NO_PARENT_PID;
+}
+
+/* Returns the PID of a process as seen by userland */
+PID_t process_user_pid(PID_t pid) {
+    return PROCESS_USER_PID(pid, process_get_entry(pid)->generation);
+}
+
+/* Takes an entry from the free list, growing the table by a page of
+ * entries if there are no free entries. Returns the index of the entry
+ * or PROCESS_NO_PARENT_PID if the table is full. Must be called with
+ * process_table_slock held. */
+static PID_t alloc_process_entry(void) {
+    process_table_t *chunk;
+    uint32_t phys;
+    PID_t pid;
+    int i;
+
+    if (process_free_list == PROCESS_NO_PARENT_PID) {
+        if (process_table_size >=
+                (PID_t)(PROCESS_MAX_CHUNKS * PROCESS_CHUNK_ENTRIES))
+            return PROCESS_NO_PARENT_PID;
+        phys = pagepool_get_phys_page();
+        if (phys == 0)
+            return PROCESS_NO_PARENT_PID;
+        chunk = (process_table_t *)ADDR_PHYS_TO_KERNEL(phys);
+        process_chunks[process_table_size / PROCESS_CHUNK_ENTRIES] = chunk;
+        for (i = PROCESS_CHUNK_ENTRIES - 1 ; i >= 0 ; i--) {
+            free_process_table_entry(chunk + i);
+            chunk[i].generation = 1;
+            chunk[i].next_free = process_free_list;
+            process_free_list = process_table_size + i;
+        }
+        process_table_size += PROCESS_CHUNK_ENTRIES;
+    }
+    pid = process_free_list;
+    process_free_list = process_get_entry(pid)->next_free;
+    return pid;
+}
+
+/* Adds a new entry to the front of the child list of its parent. Must
+ * be called with process_table_slock held. */
+static void link_child_process(process_table_t *parent, PID_t pid) {
+    process_table_t *entry = process_get_entry(pid);
+
+    entry->prev = PROCESS_NO_PARENT_PID;
+    entry->next = parent->last_child_pid;
+    if (parent->last_child_pid != PROCESS_NO_PARENT_PID)
+        process_get_entry(parent->last_child_pid)->prev = pid;
+    parent->last_child_pid = pid;
+}
+
+/* Removes an entry from the child list of its parent, if it has one,
+ * and puts it to the free list. The generation of the entry changes, so
+ * old PIDs of it are no longer valid. Must be called with
+ * process_table_slock held. */
+static void release_process_entry(PID_t pid) {
+    process_table_t *entry = process_get_entry(pid);
+    process_table_t *parent = process_get_entry(entry->parent_pid);
+    uint32_t generation;
+
+    if (parent != NULL) {
+        if (entry->prev != PROCESS_NO_PARENT_PID)
+            process_get_entry(entry->prev)->next = entry->next;
+        else
+            parent->last_child_pid = entry->next;
+        if (entry->next != PROCESS_NO_PARENT_PID)
+            process_get_entry(entry->next)->prev = entry->prev;
+    }
+    generation = entry->generation + 1;
+    if (generation > PROCESS_MAX_GENERATION)
+        generation = 1;
+    free_process_table_entry(entry);
+    entry->generation = generation;
+    entry->next_free = process_free_list;
+    process_free_list = pid;
+}
+
+/* Tells the parent waiting in process_wait_created that the child has
+ * started, or failed to start if pid is PROCESS_NO_PARENT_PID. The data
+ * is on the stack of the parent and must not be used after this. */
+static void process_created(child_process_create_data_t *data, PID_t pid) {
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    data->child_pid = pid;
+    data->ready = 1;
+    sleepq_wake(data);
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* Sleeps until the child process being created with the data has
+ * started or failed to start. */
+void process_wait_created(child_process_create_data_t *data) {
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    while (!data->ready) {
+        sleepq_add(data);
+        spinlock_release(&process_table_slock);
+        thread_switch();
+        spinlock_acquire(&process_table_slock);
+    }
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* Marks the process as exited with given return value. Its children
+ * become orphans, and those that have already exited are freed. The
+ * entry itself is freed if nobody can join it, otherwise the parent is
+ * woken up if it is waiting for its children in process_join. */
+void process_finish(process_table_t *entry, int retval) {
+    interrupt_status_t intr_status;
+    process_table_t *child_entry;
+    PID_t child, next;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    for (child = entry->last_child_pid ; child != PROCESS_NO_PARENT_PID ;
+         child = next) {
+        child_entry = process_get_entry(child);
+        next = child_entry->next;
+        child_entry->parent_pid = PROCESS_NO_PARENT_PID;
+        if (child_entry->tid == PROCESS_NO_OWNER_TID)
+            release_process_entry(child);
+    }
+    entry->last_child_pid = PROCESS_NO_PARENT_PID;
+    entry->tid = PROCESS_NO_OWNER_TID;
+    entry->retval = retval;
+    if (entry->parent_pid == PROCESS_NO_PARENT_PID)
+        release_process_entry(process_entry_pid(entry));
+    else
+        sleepq_wake_all(process_get_entry(entry->parent_pid));
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* Waits until the child process with given (userland) PID exits and
+ * frees its entry. The process sleeps on its own entry, so an exiting
+ * child wakes only its parent. Returns the return value of the child or
+ * -1 if the PID is not a child of the current process or the process is
+ * exiting. */
+int process_join(PID_t pid) {
+    interrupt_status_t intr_status;
+    process_table_t *my_entry, *child_entry;
+    PID_t my_pid;
+    int retval;
+
+    my_pid = get_current_process_pid();
+    if (my_pid < 0 || pid <= 0)
+        return -1;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    my_entry = process_get_entry(my_pid);
+    while (1) {
+        // checked again after every wakeup, the entry may have been
+        // joined by another thread of the process
+        child_entry = process_get_entry(PROCESS_PID_INDEX(pid));
+        if (thread_is_aborted() || child_entry == NULL ||
+                child_entry->generation != PROCESS_PID_GENERATION(pid) ||
+                child_entry->parent_pid != my_pid) {
+            retval = -1;
+            break;
+        }
+        if (child_entry->tid == PROCESS_NO_OWNER_TID) {
+            retval = child_entry->retval;
+            release_process_entry(PROCESS_PID_INDEX(pid));
+            break;
+        }
+        sleepq_add(my_entry);
+        spinlock_release(&process_table_slock);
+        thread_switch();
+        spinlock_acquire(&process_table_slock);
+    }
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+    return retval;
+}
+
+/* Returns the slot of the current thread in the thread table of the
+ * process, or -1. Must be called with process_table_slock held. */
+static int current_thread_slot(process_table_t *entry) {
+    TID_t tid = thread_get_current_thread();
+    int i;
+
+    for (i = 0 ; i < PROCESS_MAX_THREADS ; i++) {
+        if (entry->threads[i].state == PROCESS_THREAD_RUNNING &&
+                entry->threads[i].tid == tid)
+            return i;
+    }
+    return -1;
+}
+
+/* Returns the lowest address of the stack of a thread slot other than 0 */
+static uint32_t thread_stack_base(process_table_t *entry, int slot) {
+    return entry->stack_bottom +
+        (slot - 1) * CONFIG_USERLAND_THREAD_STACK_SIZE * PAGE_SIZE;
+}
+
+/* Ends the current thread of the process. The pages of its stack are
+ * freed, and joining threads and a thread waiting to exit the process
+ * are woken up. Must be called with interrupts disabled and
+ * process_table_slock held. Does not return. */
+static void finish_thread(process_table_t *entry, int slot, int retval) {
+    thread_table_t *my_thread = thread_get_current_thread_entry();
+    uint32_t vaddr, base;
+
+    if (slot > 0) {
+        // vm_unmap waits for the other CPUs, which cannot be done with
+        // a spinlock held. The slot and the pagetable stay ours until
+        // the thread is counted out below.
+        spinlock_release(&process_table_slock);
+        base = thread_stack_base(entry, slot);
+        for (vaddr = base + PAGE_SIZE ;
+             vaddr < base + CONFIG_USERLAND_THREAD_STACK_SIZE * PAGE_SIZE ;
+             vaddr += PAGE_SIZE)
+            vm_unmap(entry->pagetable, vaddr);
+        spinlock_acquire(&process_table_slock);
+    }
+    if (slot >= 0) {
+        entry->threads[slot].state = PROCESS_THREAD_EXITED;
+        entry->threads[slot].retval = retval;
+        sleepq_wake_all(&entry->threads[slot]);
+    }
+    entry->thread_count--;
+    if (entry->exiting != PROCESS_NO_OWNER_TID)
+        sleepq_wake(&entry->thread_count);
+    spinlock_release(&process_table_slock);
+
+    // the pagetable belongs to the process, it is freed by the thread
+    // that exits the process
+    my_thread->pagetable = NULL;
+    my_thread->userland_pid = -1;
+    thread_finish();
+}
+
+/* Kernel thread running a new userland thread. The argument is the
+ * index of the process times PROCESS_MAX_THREADS plus the slot. */
+static void process_thread_start(uint32_t arg) {
+    thread_table_t *my_thread = thread_get_current_thread_entry();
+    process_table_t *entry = process_get_entry(arg / PROCESS_MAX_THREADS);
+    process_thread_t *thread = &entry->threads[arg % PROCESS_MAX_THREADS];
+    context_t user_context;
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    my_thread->pagetable = entry->pagetable;
+    my_thread->userland_pid = arg / PROCESS_MAX_THREADS;
+    _interrupt_set_state(intr_status);
+
+    // the process may have started to exit before this thread ran
+    process_thread_check_exit();
+    tlb_activate(entry->pagetable);
+
+    memoryset(&user_context, 0, sizeof(user_context));
+    user_context.cpu_regs[MIPS_REGISTER_SP] =
+        thread_stack_base(entry, arg % PROCESS_MAX_THREADS) +
+        CONFIG_USERLAND_THREAD_STACK_SIZE * PAGE_SIZE - 16;
+    user_context.cpu_regs[MIPS_REGISTER_A0] = thread->start_a0;
+    user_context.cpu_regs[MIPS_REGISTER_A1] = thread->start_a1;
+    user_context.pc = thread->start_pc;
+
+    thread_goto_userland(&user_context);
+}
+
+/* Starts a new userland thread in the current process at pc with a0
+ * and a1 as its arguments. Returns the id of the thread (its slot) or
+ * -1 if the process has no free thread slots or threads. */
+int process_thread_create(uint32_t pc, uint32_t a0, uint32_t a1) {
+    interrupt_status_t intr_status;
+    process_table_t *entry;
+    PID_t my_pid;
+    TID_t tid;
+    int i, slot;
+
+    my_pid = get_current_process_pid();
+    entry = process_get_entry(my_pid);
+    if (entry == NULL)
+        return -1;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    slot = -1;
+    for (i = 1 ; i < PROCESS_MAX_THREADS ; i++) {
+        if (entry->threads[i].state == PROCESS_THREAD_FREE &&
+                entry->exiting == PROCESS_NO_OWNER_TID) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot > 0) {
+        entry->threads[slot].state    = PROCESS_THREAD_RUNNING;
+        entry->threads[slot].tid      = PROCESS_NO_OWNER_TID;
+        entry->threads[slot].start_pc = pc;
+        entry->threads[slot].start_a0 = a0;
+        entry->threads[slot].start_a1 = a1;
+        entry->thread_count++;
+    }
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+    if (slot < 0)
+        return -1;
+
+    tid = thread_create(process_thread_start,
+                        my_pid * PROCESS_MAX_THREADS + slot);
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    if (tid < 0) {
+        entry->threads[slot].state = PROCESS_THREAD_FREE;
+        entry->thread_count--;
+        if (entry->exiting != PROCESS_NO_OWNER_TID)
+            sleepq_wake(&entry->thread_count);
+        slot = -1;
+    } else {
+        entry->threads[slot].tid = tid;
+    }
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+
+    if (tid >= 0)
+        thread_run(tid);
+    return slot;
+}
+
+/* Waits until given thread of the current process exits and frees its
+ * slot. Returns the return value of the thread, or -1 if there is no
+ * such thread, it is the calling thread, or the process is exiting. */
+int process_thread_join(int thread) {
+    interrupt_status_t intr_status;
+    process_table_t *entry;
+    process_thread_t *joined;
+    int retval;
+
+    entry = get_current_process_entry();
+    if (entry == NULL || thread < 0 || thread >= PROCESS_MAX_THREADS)
+        return -1;
+    joined = &entry->threads[thread];
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    while (1) {
+        if (joined->state == PROCESS_THREAD_FREE ||
+                thread == current_thread_slot(entry) ||
+                entry->exiting != PROCESS_NO_OWNER_TID) {
+            retval = -1;
+            break;
+        }
+        if (joined->state == PROCESS_THREAD_EXITED) {
+            retval = joined->retval;
+            joined->state = PROCESS_THREAD_FREE;
+            break;
+        }
+        sleepq_add(joined);
+        spinlock_release(&process_table_slock);
+        thread_switch();
+        spinlock_acquire(&process_table_slock);
+    }
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+    return retval;
+}
+
+/* Ends the current userland thread with given return value. Returns 0
+ * only if it is the last thread of the process, which must then exit
+ * as a whole. */
+int process_thread_exit(int retval) {
+    interrupt_status_t intr_status;
+    process_table_t *entry;
+
+    entry = get_current_process_entry();
+    if (entry == NULL)
+        return 0;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    if (entry->thread_count > 1 || entry->exiting != PROCESS_NO_OWNER_TID)
+        finish_thread(entry, current_thread_slot(entry), retval);
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+    return 0;
+}
+
+/* Called by the thread exiting the process before the resources of the
+ * process are freed. Waits until the other threads of the process have
+ * stopped. They are aborted and woken from joins, pipes and console
+ * reads, which might never end. If another thread is already exiting
+ * the process, the calling thread just ends. */
+void process_stop_threads(process_table_t *entry) {
+    interrupt_status_t intr_status;
+    device_t *dev;
+    TID_t tid;
+    int i;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    if (entry->exiting != PROCESS_NO_OWNER_TID)
+        finish_thread(entry, current_thread_slot(entry), 0);
+    entry->exiting = thread_get_current_thread();
+    for (i = 0 ; i < PROCESS_MAX_THREADS ; i++) {
+        tid = entry->threads[i].tid;
+        if (entry->threads[i].state == PROCESS_THREAD_RUNNING && tid >= 0 &&
+                tid != entry->exiting)
+            thread_abort(tid);
+        sleepq_wake_all(&entry->threads[i]);
+    }
+    sleepq_wake_all(entry);
+    spinlock_release(&process_table_slock);
+
+    pipe_wake_all();
+    dev = device_get(YAMS_TYPECODE_TTY, 0);
+    if (dev != NULL)
+        tty_wake_readers((gcd_t *)dev->generic_device);
+
+    spinlock_acquire(&process_table_slock);
+    while (entry->thread_count > 1) {
+        sleepq_add(&entry->thread_count);
+        spinlock_release(&process_table_slock);
+        thread_switch();
+        spinlock_acquire(&process_table_slock);
+    }
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* Ends the current thread if another thread is exiting the process.
+ * Called when a thread is about to return to userland. */
+void process_thread_check_exit(void) {
+    interrupt_status_t intr_status;
+    process_table_t *entry;
+
+    entry = get_current_process_entry();
+    if (entry == NULL || entry->exiting == PROCESS_NO_OWNER_TID)
+        return;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    if (entry->exiting != PROCESS_NO_OWNER_TID &&
+            entry->exiting != thread_get_current_thread())
+        finish_thread(entry, current_thread_slot(entry), 0);
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* A thread stopped in userland continues here, see below */
+static void process_thread_abort(void) {
+    process_thread_check_exit();
+    KERNEL_PANIC("process_thread_abort: process is not exiting");
+}
+
+/* Called from the interrupt handler before the current thread
+ * continues. A thread of an exiting process interrupted in userland
+ * would not enter the kernel again if it does not make system calls, so
+ * it is made to continue in the kernel in process_thread_abort instead,
+ * on its kernel stack below the saved context, as a new kernel thread
+ * would start. */
+void process_interrupt_check(void) {
+    thread_table_t *my_thread = thread_get_current_thread_entry();
+    process_table_t *entry = process_get_entry(my_thread->userland_pid);
+    context_t *context = my_thread->context;
+
+    if (entry == NULL || entry->exiting == PROCESS_NO_OWNER_TID ||
+            entry->exiting == thread_get_current_thread() ||
+            !(context->status & USERLAND_ENABLE_BIT))
+        return;
+
+    context->pc = (uint32_t)process_thread_abort;
+    context->status = INTERRUPT_MASK_ALL | INTERRUPT_MASK_MASTER;
+    context->cpu_regs[MIPS_REGISTER_SP] = (uint32_t)context - 16;
+    context->cpu_regs[MIPS_REGISTER_RA] = (uint32_t)thread_finish;
+}
+
+/* Number of processes being profiled, so that the timer interrupt
+   does nothing more when none are. Protected by process_table_slock. */
+static int process_profiling = 0;
+
+/* Starts sampling the PC of the current process on the timer
+   interrupts into a histogram of SYSCALL_PROFILE_BUCKETS buckets from
+   base on, each of 1 << shift bytes. Returns 0, or -1 if the process
+   is already profiled or there is no memory for the histogram. */
+int process_profile_start(uint32_t base, uint32_t shift) {
+    interrupt_status_t intr_status;
+    process_table_t *entry;
+    syscall_profile_t *profile;
+    uint32_t phys;
+    int ret = -1;
+
+    entry = get_current_process_entry();
+    if (entry == NULL || shift > 31)
+        return -1;
+    phys = pagepool_get_zeroed_phys_page();
+    if (phys == 0)
+        return -1;
+    profile = (syscall_profile_t *)ADDR_PHYS_TO_KERNEL(phys);
+    profile->base = base;
+    profile->shift = shift;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    if (entry->profile == 0) {
+        entry->profile = (uint32_t)profile;
+        process_profiling++;
+        ret = 0;
+    }
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+
+    if (ret < 0)
+        pagepool_free_phys_page(phys);
+    return ret;
+}
+
+/* Stops profiling given process. Returns the kernel address of its
+   histogram page, which the caller frees, or 0 if it was not
+   profiled. */
+uint32_t process_profile_stop(process_table_t *entry) {
+    interrupt_status_t intr_status;
+    uint32_t profile;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+    profile = entry->profile;
+    entry->profile = 0;
+    if (profile != 0)
+        process_profiling--;
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+    return profile;
+}
+
+/* Called from the timer interrupt before the scheduler. Counts the PC
+   of the interrupted thread if it was running a profiled process in
+   userland. */
+void process_profile_sample(void) {
+    thread_table_t *my_thread;
+    process_table_t *entry;
+    syscall_profile_t *profile;
+    uint32_t pc;
+
+    if (process_profiling == 0)
+        return;
+    my_thread = thread_get_current_thread_entry();
+    if (!(my_thread->context->status & USERLAND_ENABLE_BIT))
+        return;
+    entry = process_get_entry(my_thread->userland_pid);
+    if (entry == NULL)
+        return;
+
+    spinlock_acquire(&process_table_slock);
+    if (entry->profile != 0) {
+        profile = (syscall_profile_t *)entry->profile;
+        pc = my_thread->context->pc;
+        profile->samples++;
+        if (pc >= profile->base &&
+                ((pc - profile->base) >> profile->shift)
+                < SYSCALL_PROFILE_BUCKETS)
+            profile->buckets[(pc - profile->base) >> profile->shift]++;
+        else
+            profile->missed++;
+    }
+    spinlock_release(&process_table_slock);
+}
+#else
 void process_table_init() {
     size_t i;
     interrupt_status_t stat;
@@ -102,6 +1107,7 @@ void process_table_init() {
     }
     _interrupt_set_state(stat);
 }
+#endif /* CHANGED_5 */
 
 
 
@@ -124,29 +1130,158 @@ process_table_t* get_current_process_entry() {
     PID_t pid;
     interrupt_status_t stat = _interrupt_disable();
     pid = get_current_process_pid();
+#ifdef CHANGED_5
+    found = process_get_entry(pid);
+#else
     if (pid >= 0 && pid < CONFIG_MAX_PROCESSES) {
         found = process_table + pid;
     }
+#endif
     _interrupt_set_state(stat);
     return found;
 }
 
+#ifdef CHANGED_5
+int process_handle_page_fault(uint32_t vaddr, int write) {
+    thread_table_t *my_thread;
+    process_table_t *my_entry;
+    process_region_t region;
+    pagetable_t *pagetable;
+    uint32_t page, phys, offset, base, physoff, virtoff, slot;
+    int i, found, ok, size, zeroed;
+
+    my_thread = thread_get_current_thread_entry();
+    my_entry = get_current_process_entry();
+    pagetable = my_thread->pagetable;
+    if (my_entry == NULL || pagetable == NULL)
+        return 0;
+
+    // reading the page blocks, which is not possible if the faulting
+    // code was running with interrupts disabled
+    if (!(my_thread->context->status & INTERRUPT_MASK_MASTER))
+        return 0;
+
+    // any page of the process, including stack and heap, may be in swap
+    ok = swap_page_in(pagetable, vaddr);
+    if (ok != 0) {
+        _tlb_set_asid(pagetable->ASID);
+        return ok > 0;
+    }
+
+    page = vaddr & PAGE_SIZE_MASK;
+    found = 0;
+    for (i = 0 ; i < PROCESS_MAX_REGIONS ; i++) {
+        region = my_entry->regions[i];
+        if (region.vaddr != 0 && page >= region.vaddr &&
+                page < region.vaddr + region.pages * PAGE_SIZE) {
+            found = 1;
+            break;
+        }
+    }
+    if (!found || (write && !region.writable))
+        return 0;
+    // guard pages of thread stacks are never mapped
+    if (region.stack_pages != 0 &&
+            ((page - region.vaddr) / PAGE_SIZE) % region.stack_pages == 0)
+        return 0;
+
+    // a valid mapping means that the access itself was not allowed
+    if (vm_get_vaddr_page_offsets(pagetable, page, &physoff, &virtoff))
+        return 0;
+
+    offset = page - region.vaddr;
+
+    // a private segment is loaded a large page at a time where possible
+    size = 0;
+    if (region.image != NULL && !region.shared)
+        size = vm_large_block(page, region.vaddr,
+                              region.vaddr + region.pages * PAGE_SIZE, &base);
+    if (size > 0) {
+        _interrupt_enable();
+        ok = map_large_block(pagetable, &region, base, size);
+        _interrupt_disable();
+        if (ok) {
+            _tlb_set_asid(pagetable->ASID);
+            return 1;
+        }
+    }
+
+    _interrupt_enable();
+    if (region.shared) {
+        // the page is shared with other processes running the same
+        // executable, the image gives us a reference to it
+        phys = image_get_ro_page(region.image, offset / PAGE_SIZE);
+        if (phys == 0 && image_cache_shrink() > 0)
+            phys = image_get_ro_page(region.image, offset / PAGE_SIZE);
+        ok = phys != 0;
+    } else {
+        // pages with nothing from the file (bss) come pre-zeroed
+        zeroed = offset >= region.file_size;
+        phys = swap_get_page(zeroed);
+        if (phys == 0 && image_cache_shrink() > 0)
+            phys = swap_get_page(zeroed);
+        ok = phys != 0;
+        if (ok && !load_region_page(&region, offset, phys, zeroed)) {
+            pagepool_free_phys_page(phys);
+            ok = 0;
+        }
+    }
+    _interrupt_disable();
+    if (!ok)
+        return 0;
+
+    // someone else may have mapped the page while we were reading
+    if (vm_get_vaddr_page_offsets(pagetable, page, &physoff, &virtoff)) {
+        pagepool_free_phys_page(phys);
+        return 1;
+    }
+    // pages of a file mapping are written back only if they are written
+    if (region.mapped && !write)
+        ok = vm_map_clean(pagetable, phys, page) >= 0;
+    else
+        ok = vm_map(pagetable, phys, page, region.writable) >= 0;
+    if (!ok) {
+        // another thread may have mapped or swapped the page meanwhile
+        pagepool_free_phys_page(phys);
+        return vm_get_vaddr_page_offsets(pagetable, page, &physoff, &virtoff)
+            || vm_get_swap_slot(pagetable, page, &slot);
+    }
+    if (!region.shared)
+        pagepool_set_owner(phys, pagetable, page);
+
+    tlb_write_entry(vm_get_entry_by_vaddr(pagetable, page));
+    _tlb_set_asid(pagetable->ASID);
+    return 1;
+}
+#endif /* CHANGED_5 */
+
 
 
 static void restore_process_state(child_process_create_data_t* data, process_table_t* entry,
         int release_page_table, openfile_t executable_filehandle) {
     interrupt_status_t intr_stat;
+#ifndef CHANGED_5
     uint32_t i;
     process_table_t* parent_entry;
+#endif
     thread_table_t* thread_entry;
     thread_entry = thread_get_current_thread_entry();
     if (entry != NULL) {
+#ifdef CHANGED_5
+        process_free_image(entry);
+#endif
         intr_stat = _interrupt_disable();
         // process table entry has been created, we must free it
 #ifdef CHANGED_4
         free_process_heap(entry,thread_entry->pagetable);
 #endif
+#ifdef CHANGED_5
+        spinlock_acquire(&process_table_slock);
+        release_process_entry(process_entry_pid(entry));
+        spinlock_release(&process_table_slock);
+#else
         free_process_table_entry(entry);
+#endif
         if (thread_entry != NULL) {
             thread_entry->userland_pid = -1;
         }
@@ -155,6 +1290,10 @@ static void restore_process_state(child_process_create_data_t* data, process_tab
     if (thread_entry && thread_entry->pagetable != NULL && release_page_table) {
         intr_stat = _interrupt_disable();
         // release page table if exists
+#ifdef CHANGED_5
+        // the pages are freed by vm_destroy_pagetable under the pagetable
+        // lock, as the swap writer may be moving them meanwhile
+#else
         for (i = 0 ; i < thread_entry->pagetable->valid_count ; i++) {
             if (thread_entry->pagetable->entries[i].V0) {
                 pagepool_free_phys_page(thread_entry->pagetable->entries[i].PFN0 << 12);
@@ -163,16 +1302,22 @@ static void restore_process_state(child_process_create_data_t* data, process_tab
                 pagepool_free_phys_page(thread_entry->pagetable->entries[i].PFN1 << 12);
             }
         }
+#endif
         vm_destroy_pagetable(thread_entry->pagetable);
         thread_entry->pagetable = NULL;
         _interrupt_set_state(intr_stat);
     }
     if (data != NULL) {
+#ifdef CHANGED_5
+        // we have parent process waiting, we must inform the failure to our parent
+        process_created(data, PROCESS_NO_PARENT_PID);
+#else
         parent_entry = process_table + data->parent_pid;
         data->ready = 1;
         // we have parent process waiting, we must inform the failure to our parent
         condition_broadcast(parent_entry->die_cond, parent_entry->die_lock);
         lock_release(parent_entry->die_lock);
+#endif
     }
     if (executable_filehandle >= 0) {
         vfs_close(executable_filehandle);
@@ -204,7 +1349,9 @@ void process_start(const char *executable, child_process_create_data_t* data)
     pagetable_t *pagetable;
     uint32_t phys_page;
     context_t user_context;
+#ifndef CHANGED_5
     uint32_t stack_bottom;
+#endif
     elf_info_t elf;
     openfile_t file;
 
@@ -227,9 +1374,14 @@ void process_start(const char *executable, child_process_create_data_t* data)
         argc = data->argc;
         argv = data->argv;
         parent_pid = data->parent_pid;
+#ifdef CHANGED_5
+        // parent process is waiting until child is created
+        parent_proc_entry = process_get_entry(parent_pid);
+#else
         parent_proc_entry = process_table + parent_pid;
         // parent process is waiting until child is created
         lock_acquire(parent_proc_entry->die_lock);
+#endif
     } else {
         argc = 0;
         argv = NULL;
@@ -240,6 +1392,29 @@ void process_start(const char *executable, child_process_create_data_t* data)
 
     my_entry = thread_get_current_thread_entry();
 
+#ifdef CHANGED_5
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+
+    my_pid = alloc_process_entry();
+    if (my_pid != PROCESS_NO_PARENT_PID) {
+        my_proc_entry                   = process_get_entry(my_pid);
+        my_proc_entry->tid              = thread_get_current_thread();
+        my_proc_entry->parent_pid       = parent_pid;
+        my_proc_entry->last_child_pid   = PROCESS_NO_PARENT_PID;
+        my_proc_entry->retval           = PROCESS_NO_RETVAL;
+        stringcopy(my_proc_entry->name, "foobar", PROCESS_NAME_MAX_LENGTH);
+        my_proc_entry->threads[0].state = PROCESS_THREAD_RUNNING;
+        my_proc_entry->threads[0].tid   = my_proc_entry->tid;
+        my_proc_entry->thread_count     = 1;
+        my_entry->userland_pid = my_pid;
+        if (parent_proc_entry != NULL)
+            link_child_process(parent_proc_entry, my_pid);
+    }
+
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+#else
     intr_status = _interrupt_disable();
     lock_acquire(process_table_lock);
 
@@ -269,6 +1444,7 @@ void process_start(const char *executable, child_process_create_data_t* data)
 
     lock_release(process_table_lock);
     _interrupt_set_state(intr_status);
+#endif /* CHANGED_5 */
 
     if (my_proc_entry == NULL) {
         // no free process entries found, restore state and release possible locks
@@ -286,7 +1462,11 @@ void process_start(const char *executable, child_process_create_data_t* data)
         return;
     }
 
+#ifdef CHANGED_5
+    pagetable = vm_create_pagetable();
+#else
     pagetable = vm_create_pagetable(thread_get_current_thread());
+#endif
     if(pagetable == NULL) {
         restore_process_state(data, my_proc_entry, 1, file);
         return;
@@ -294,8 +1474,22 @@ void process_start(const char *executable, child_process_create_data_t* data)
 
     intr_status = _interrupt_disable();
     my_entry->pagetable = pagetable;
+#ifdef CHANGED_5
+    my_proc_entry->pagetable = pagetable;
+#endif
     _interrupt_set_state(intr_status);
 
+#ifdef CHANGED_5
+    /* The image is shared with other processes running the same
+       executable, and it has already been checked to be a valid ELF
+       file. */
+    my_proc_entry->image = image_open(executable);
+    if (my_proc_entry->image == NULL) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+    elf = my_proc_entry->image->elf;
+#else
     file = vfs_open((char *)executable);
 
     /* Make sure the file existed and was a valid ELF file */
@@ -303,6 +1497,7 @@ void process_start(const char *executable, child_process_create_data_t* data)
         restore_process_state(data, my_proc_entry, 1, file);
         return;
     }
+#endif
 
     /* Trivial and naive sanity check for entry point: */
     if(elf.entry_point < PAGE_SIZE) {
@@ -310,6 +1505,18 @@ void process_start(const char *executable, child_process_create_data_t* data)
         return;
     }
 
+#ifdef CHANGED_5
+    /* Pages are mapped on demand and the TLB is filled by the TLB
+       exception handlers, so the process does not have to fit in the
+       TLB. The segments must stay below the mmap area and the stack. */
+    if(elf.ro_pages > PROCESS_MMAP_BASE / PAGE_SIZE ||
+       elf.rw_pages > PROCESS_MMAP_BASE / PAGE_SIZE ||
+       elf.ro_vaddr + elf.ro_pages*PAGE_SIZE > PROCESS_MMAP_BASE ||
+       elf.rw_vaddr + elf.rw_pages*PAGE_SIZE > PROCESS_MMAP_BASE) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+#else
     /* Calculate the number of pages needed by the whole process
        (including userland stack). Since we don't have proper tlb
        handling code, all these pages must fit into TLB. */
@@ -318,10 +1525,15 @@ void process_start(const char *executable, child_process_create_data_t* data)
         restore_process_state(data, my_proc_entry, 1, file);
         return;
     }
+#endif
 
     /* Allocate and map stack */
     for(i = 0; i < CONFIG_USERLAND_STACK_SIZE; i++) {
+#ifdef CHANGED_5
+        phys_page = swap_get_page(1);
+#else
         phys_page = pagepool_get_phys_page();
+#endif
         if(phys_page == 0) {
             restore_process_state(data, my_proc_entry, 1, file);
             return;
@@ -331,8 +1543,63 @@ void process_start(const char *executable, child_process_create_data_t* data)
             restore_process_state(data, my_proc_entry, 1, file);
             return;
         }
+#ifdef CHANGED_5
+        pagepool_set_owner(phys_page, my_entry->pagetable,
+                           (USERLAND_STACK_TOP & PAGE_SIZE_MASK) - i*PAGE_SIZE);
+#endif
+    }
+
+#ifdef CHANGED_5
+    // the time, the PID etc. for userland, see proc/kdata.c
+    if (kdata_map(my_entry->pagetable, process_user_pid(my_pid)) < 0) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
     }
 
+    /* The segments are not loaded here. Their pages are mapped and
+       filled from the executable when the process first touches them
+       (see process_handle_page_fault). RO pages are shared through the
+       image. We still assume that segments begin at page boundary. */
+    my_proc_entry->entry_point = elf.entry_point;
+    if (!add_process_region(my_proc_entry, elf.ro_vaddr, elf.ro_pages, 0,
+                            my_proc_entry->image, 1,
+                            elf.ro_location, elf.ro_size) ||
+        !add_process_region(my_proc_entry, elf.rw_vaddr, elf.rw_pages, 1,
+                            my_proc_entry->image, 0,
+                            elf.rw_location, elf.rw_size)) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+
+    /* The rest of the stack is reserved below the mapped pages and
+       grows on demand, the pages are zero filled when first touched. */
+    my_proc_entry->stack_max_pages = CONFIG_USERLAND_STACK_MAX_SIZE;
+    my_proc_entry->stack_bottom = (USERLAND_STACK_TOP & PAGE_SIZE_MASK) -
+        (my_proc_entry->stack_max_pages - 1) * PAGE_SIZE;
+    if (!add_process_region(my_proc_entry, my_proc_entry->stack_bottom,
+                            my_proc_entry->stack_max_pages, 1,
+                            NULL, 0, 0, 0)) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+
+    /* Stacks of the other userland threads are below the main stack,
+       one unmapped page apart from it. */
+    my_proc_entry->stack_bottom -= PAGE_SIZE +
+        (PROCESS_MAX_THREADS - 1) * CONFIG_USERLAND_THREAD_STACK_SIZE * PAGE_SIZE;
+    if (!add_process_region(my_proc_entry, my_proc_entry->stack_bottom,
+                            (PROCESS_MAX_THREADS - 1) *
+                            CONFIG_USERLAND_THREAD_STACK_SIZE, 1,
+                            NULL, 0, 0, 0)) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+    for (i = 0 ; i < PROCESS_MAX_REGIONS ; i++) {
+        if (my_proc_entry->regions[i].vaddr == my_proc_entry->stack_bottom)
+            my_proc_entry->regions[i].stack_pages =
+                CONFIG_USERLAND_THREAD_STACK_SIZE;
+    }
+#else /* CHANGED_5 */
     /* Allocate and map pages for the segments. We assume that
        segments begin at page boundary. (The linker script in tests
        directory creates this kind of segments) */
@@ -362,8 +1629,14 @@ void process_start(const char *executable, child_process_create_data_t* data)
         }
     }
 
+#endif /* CHANGED_5 */
+
 #ifdef CHANGED_4
+#ifdef CHANGED_5
+    /* heap is allocated one page above rw-segment and starts zeroed */
+#else
     /* heap is allocated one page above rw-segment and is left uninitialized */
+#endif
     intr_status =_interrupt_disable();
     lock_acquire(process_table_lock);
 
@@ -372,6 +1645,13 @@ void process_start(const char *executable, child_process_create_data_t* data)
     lock_release(process_table_lock);
     _interrupt_set_state(intr_status);
 
+#ifdef CHANGED_5
+    my_proc_entry->heap_end = my_proc_entry->heap_vaddr;
+    if (process_resize_heap(my_proc_entry, my_entry->pagetable, 1) < 0) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+#else
     phys_page = pagepool_get_phys_page();
     if(phys_page == 0) {
         restore_process_state(data, my_proc_entry, 1, file);
@@ -382,6 +1662,7 @@ void process_start(const char *executable, child_process_create_data_t* data)
         restore_process_state(data, my_proc_entry, 1, file);
         return;
     }
+#endif
 #endif /*CHANGED_4*/
 
 #ifndef CHANGED_4
@@ -395,20 +1676,27 @@ void process_start(const char *executable, child_process_create_data_t* data)
     tlb_fill(my_entry->pagetable);
     _interrupt_set_state(intr_status);
     /* Now we may use the virtual addresses of the segments. */
+#elif defined(CHANGED_5)
+    tlb_activate(pagetable);
 #else
     intr_status = _interrupt_disable();
     _tlb_set_asid(pagetable->ASID);
     _interrupt_set_state(intr_status);
 #endif /*CHANGED_4*/
 
+#ifndef CHANGED_5
     /* Zero the pages. */
     memoryset((void *)elf.ro_vaddr, 0, elf.ro_pages*PAGE_SIZE);
     memoryset((void *)elf.rw_vaddr, 0, elf.rw_pages*PAGE_SIZE);
+#endif
 
+#ifndef CHANGED_5
     stack_bottom = (USERLAND_STACK_TOP & PAGE_SIZE_MASK) -
         (CONFIG_USERLAND_STACK_SIZE-1)*PAGE_SIZE;
     memoryset((void *)stack_bottom, 0, CONFIG_USERLAND_STACK_SIZE*PAGE_SIZE);
+#endif
 
+#ifndef CHANGED_5
     /* Copy segments */
 
     if (elf.ro_size > 0) {
@@ -470,13 +1758,17 @@ void process_start(const char *executable, child_process_create_data_t* data)
     _interrupt_set_state(intr_status);
 #endif /* CHANGED_4 */
 
+#endif /* CHANGED_5 */
+
     /* Initialize the user context. (Status register is handled by
        thread_goto_userland) */
     memoryset(&user_context, 0, sizeof(user_context));
     user_context.cpu_regs[MIPS_REGISTER_SP] = USERLAND_STACK_TOP;
     user_context.pc = elf.entry_point;
 
+#ifndef CHANGED_5
     vfs_close(file);
+#endif
 
     // add main arguments
     for (i = 0 ; i < argc ; i++) {
@@ -518,12 +1810,20 @@ void process_start(const char *executable, child_process_create_data_t* data)
     user_context.cpu_regs[MIPS_REGISTER_SP] -= 2 * sizeof(uint32_t);
 
     if (data != NULL) {
+#ifdef CHANGED_5
+        // the parent is still waiting, so its stdin and stdout stay open
+        if (parent_proc_entry != NULL)
+            syscall_inherit_stdio(parent_proc_entry, my_proc_entry);
+        // all ok, let parent process to resume
+        process_created(data, process_user_pid(my_pid));
+#else
         //kprintf("start: %d\n", my_pid);
         // all ok, let parent process to resume (+1 so that pid is never 0)
         data->child_pid = my_pid + 1;
         data->ready = 1;
         condition_broadcast(parent_proc_entry->die_cond, parent_proc_entry->die_lock);
         lock_release(parent_proc_entry->die_lock);
+#endif
     }
 
     thread_goto_userland(&user_context);
@@ -532,6 +1832,121 @@ void process_start(const char *executable, child_process_create_data_t* data)
     //KERNEL_PANIC("thread_goto_userland failed.");
 }
 
+#ifdef CHANGED_5
+void process_fork(child_process_create_data_t* data)
+{
+    thread_table_t *my_entry;
+    pagetable_t *pagetable;
+    context_t user_context;
+    openfile_t file;
+    interrupt_status_t intr_status;
+    process_table_t* parent_proc_entry;
+    process_table_t* my_proc_entry;
+    PID_t my_pid;
+    int i;
+
+    file = -1;
+    my_pid = PROCESS_NO_PARENT_PID;
+    my_proc_entry = NULL;
+    // parent process is waiting until child is created
+    parent_proc_entry = process_get_entry(data->parent_pid);
+
+    my_entry = thread_get_current_thread_entry();
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&process_table_slock);
+
+    my_pid = alloc_process_entry();
+    if (my_pid != PROCESS_NO_PARENT_PID) {
+        my_proc_entry                   = process_get_entry(my_pid);
+        my_proc_entry->tid              = thread_get_current_thread();
+        my_proc_entry->parent_pid       = data->parent_pid;
+        my_proc_entry->last_child_pid   = PROCESS_NO_PARENT_PID;
+        my_proc_entry->retval           = PROCESS_NO_RETVAL;
+        stringcopy(my_proc_entry->name, parent_proc_entry->name,
+                   PROCESS_NAME_MAX_LENGTH);
+        // only the thread calling fork is copied to the child
+        my_proc_entry->threads[0].state = PROCESS_THREAD_RUNNING;
+        my_proc_entry->threads[0].tid   = my_proc_entry->tid;
+        my_proc_entry->thread_count     = 1;
+        my_entry->userland_pid = my_pid;
+        link_child_process(parent_proc_entry, my_pid);
+    }
+
+    spinlock_release(&process_table_slock);
+    _interrupt_set_state(intr_status);
+
+    if (my_proc_entry == NULL || my_entry->pagetable != NULL) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+
+    pagetable = vm_create_pagetable();
+    if (pagetable == NULL) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+
+    intr_status = _interrupt_disable();
+    my_entry->pagetable = pagetable;
+    my_proc_entry->pagetable = pagetable;
+    _interrupt_set_state(intr_status);
+
+#ifdef CHANGED_5
+    // the other threads of the parent may run meanwhile, the copy
+    // holds the lock of the parent's pagetable
+#else
+    // the parent is blocked in the fork syscall, so its address space
+    // does not change while it is copied
+#endif
+    if (vm_copy_pagetable(data->pagetable, pagetable) < 0) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+    // the child gets its own process data page
+    if (kdata_map(pagetable, process_user_pid(my_pid)) < 0) {
+        restore_process_state(data, my_proc_entry, 1, file);
+        return;
+    }
+
+    // share the executable image, pages not loaded yet are loaded by
+    // the child itself
+    if (parent_proc_entry->image != NULL)
+        image_ref(parent_proc_entry->image);
+    my_proc_entry->image = parent_proc_entry->image;
+    my_proc_entry->entry_point = parent_proc_entry->entry_point;
+    for (i = 0 ; i < PROCESS_MAX_REGIONS ; i++) {
+        my_proc_entry->regions[i] = parent_proc_entry->regions[i];
+        // file mappings are inherited with copies of the pages
+        if (my_proc_entry->regions[i].mapped)
+            vfs_dup(my_proc_entry->regions[i].file);
+    }
+    my_proc_entry->heap_vaddr = parent_proc_entry->heap_vaddr;
+    my_proc_entry->heap_end = parent_proc_entry->heap_end;
+    my_proc_entry->heap_pages = parent_proc_entry->heap_pages;
+    my_proc_entry->stack_bottom = parent_proc_entry->stack_bottom;
+    my_proc_entry->stack_max_pages = parent_proc_entry->stack_max_pages;
+    my_proc_entry->ring = parent_proc_entry->ring;
+
+    tlb_activate(pagetable);
+
+    /* The child continues on (a copy of) the stack of the parent. _start
+       in tests/crt.S calls the function in a3 instead of main if it is
+       given, and exits when the function returns. */
+    memoryset(&user_context, 0, sizeof(user_context));
+    user_context.cpu_regs[MIPS_REGISTER_SP] = data->sp;
+    user_context.cpu_regs[MIPS_REGISTER_A0] = data->arg;
+    user_context.cpu_regs[MIPS_REGISTER_A3] = data->func;
+    user_context.pc = my_proc_entry->entry_point;
+
+    syscall_inherit_stdio(parent_proc_entry, my_proc_entry);
+    // all ok, let parent process to resume
+    process_created(data, process_user_pid(my_pid));
+
+    thread_goto_userland(&user_context);
+}
+#endif /* CHANGED_5 */
+
 #else
 void process_start(const char *executable)
 {
@@ -611,9 +2026,11 @@ void process_start(const char *executable)
     
     /* Now we may use the virtual addresses of the segments. */
 
+#ifndef CHANGED_5
     /* Zero the pages. */
     memoryset((void *)elf.ro_vaddr, 0, elf.ro_pages*PAGE_SIZE);
     memoryset((void *)elf.rw_vaddr, 0, elf.rw_pages*PAGE_SIZE);
+#endif
 
     stack_bottom = (USERLAND_STACK_TOP & PAGE_SIZE_MASK) - 
         (CONFIG_USERLAND_STACK_SIZE-1)*PAGE_SIZE;
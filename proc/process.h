@@ -40,6 +40,13 @@
 
 typedef int process_id_t;
 
+#ifdef CHANGED_5
+#include "lib/types.h"
+
+/* Forward declare pagetable_t (== struct pagetable_struct_t) */
+struct pagetable_struct_t;
+#endif
+
 #ifdef CHANGED_2
 
 
@@ -81,11 +88,41 @@ typedef struct {
     const char* filename;
     int argc;
     char** argv;
+#ifdef CHANGED_5
+    /* fork: address space to copy, and where the child starts running */
+    struct pagetable_struct_t *pagetable;
+    uint32_t func;
+    uint32_t arg;
+    uint32_t sp;
+#endif
 } child_process_create_data_t;
 
 
 void process_start(const char *executable, child_process_create_data_t* data);
 
+#ifdef CHANGED_5
+/**
+ * Starts a copy of the parent process given in data. The thread calling
+ * this function runs the new process and never returns, except when
+ * the process could not be created.
+ */
+void process_fork(child_process_create_data_t* data);
+
+/**
+ * Maps the page containing given address if it belongs to a demand paged
+ * region of the current process. Called from TLB exception handlers
+ * when the address has no valid mapping.
+ *
+ * @param vaddr
+ *          Faulting virtual address.
+ * @param write
+ *          1 if the fault was caused by a store.
+ * @returns
+ *          1 if the page is now mapped, 0 if the access is invalid.
+ */
+int process_handle_page_fault(uint32_t vaddr, int write);
+#endif /* CHANGED_5 */
+
 
 #else
 
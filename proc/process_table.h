@@ -25,6 +25,79 @@
 
 #define FILEHANDLE_UNUSED -1
 
+#ifdef CHANGED_5
+#include "proc/image.h"
+#include "drivers/yams.h"
+#include "kernel/config.h"
+
+/** Maximum number of demand paged memory regions in one process,
+    including the two segments of the executable */
+#define PROCESS_MAX_REGIONS 8
+
+/** Virtual address range where files are mapped with mmap. The heap
+    may not grow past its beginning. */
+#define PROCESS_MMAP_BASE 0x40000000
+#define PROCESS_MMAP_END  0x60000000
+
+/**
+ * Memory region of a process whose pages are mapped on demand when the
+ * process first touches them. The first file_size bytes of the region
+ * are read from the executable (or the mapped file), the rest of the
+ * region is zero filled.
+ */
+typedef struct {
+    /* first virtual address of the region (page aligned), 0 if unused */
+    uint32_t vaddr;
+    /* length of the region in pages */
+    uint32_t pages;
+    /* 1 if the pages are mapped writable */
+    int writable;
+    /* executable image backing the region */
+    image_t *image;
+    /* 1 if the region maps the shared RO segment pages of the image,
+       0 if the pages are private and filled from the executable */
+    int shared;
+    /* position of the region data in the executable */
+    uint32_t file_offset;
+    /* number of bytes backed by the executable */
+    uint32_t file_size;
+    /* 1 if the region is a file mapped with mmap. Pages written by the
+       process are written back to the file when it is unmapped. */
+    int mapped;
+    /* the mapped file, the region holds a reference to it (vfs_dup) */
+    openfile_t file;
+    /* if not 0, the region holds thread stacks of this many pages. The
+       lowest page of each stack is a guard and is never mapped. */
+    uint32_t stack_pages;
+} process_region_t;
+
+/** Maximum number of userland threads in a process, including the
+    thread that started the process */
+#define PROCESS_MAX_THREADS 8
+
+#define PROCESS_THREAD_FREE    0
+#define PROCESS_THREAD_RUNNING 1
+#define PROCESS_THREAD_EXITED  2
+
+/**
+ * Userland thread of a process. Every userland thread runs on its own
+ * kernel thread, and all of them share the pagetable of the process.
+ * The thread id seen by userland is the index of the slot.
+ */
+typedef struct {
+    /* PROCESS_THREAD_FREE, RUNNING or EXITED (and not joined yet) */
+    int state;
+    /* kernel thread running the userland thread */
+    TID_t tid;
+    /* return value of an exited thread */
+    int retval;
+    /* where the thread starts in userland, and its arguments */
+    uint32_t start_pc;
+    uint32_t start_a0;
+    uint32_t start_a1;
+} process_thread_t;
+#endif /* CHANGED_5 */
+
 typedef struct {
     /* Owner thread id. -1 if process is not running (associated to any thread) */
     TID_t tid;
@@ -36,11 +109,13 @@ typedef struct {
      * process, then this links to next sibling process. */
     PID_t next;
 
+#ifndef CHANGED_5
     /* Condition variable which is waited when other process stops to join another process. */
     cond_t* die_cond;
 
     /* lock for ensuring that dying process handles its child process entries properly and vice versa */
     lock_t* die_lock;
+#endif
 
     /* When process finishes, its return value is stored into this variable. */
     int retval;
@@ -63,8 +138,91 @@ typedef struct {
     uint32_t heap_vaddr;
 #endif
 
+#ifdef CHANGED_5
+    /* current end of the heap, as set with memlimit */
+    uint32_t heap_end;
+
+    /* number of pages mapped for the heap starting from heap_vaddr */
+    uint32_t heap_pages;
+
+    /* lowest address the stack may grow to */
+    uint32_t stack_bottom;
+
+    /* maximum number of pages in the stack, set when the process
+       starts and inherited by fork */
+    uint32_t stack_max_pages;
+
+    /* previous sibling in the child list of the parent */
+    PID_t prev;
+
+    /* next entry in the list of free entries */
+    PID_t next_free;
+
+    /* generation of the entry, changed every time the entry is freed */
+    uint32_t generation;
+
+    /* address space shared by all threads of the process */
+    pagetable_t *pagetable;
+
+    /* userland threads, slot 0 is the thread that started the process */
+    process_thread_t threads[PROCESS_MAX_THREADS];
+
+    /* number of threads in state PROCESS_THREAD_RUNNING */
+    int thread_count;
+
+    /* thread exiting the whole process, PROCESS_NO_OWNER_TID if none.
+       The other threads stop when they next enter the kernel. */
+    TID_t exiting;
+
+    /* user address of the syscall_ring_t registered with
+       SYSCALL_RING_SETUP, 0 if none */
+    uint32_t ring;
+
+    /* kernel address of the page of syscall_stats_t of the process, 0
+       until the process first asks for its statistics */
+    uint32_t stats;
+
+    /* kernel address of the syscall_profile_t page of the process, 0
+       if it is not profiled */
+    uint32_t profile;
+
+    /* handles that FILEHANDLE_STDIN and FILEHANDLE_STDOUT refer to,
+       themselves unless redirected. Inherited by exec and fork. */
+    openfile_t stdio[2];
+#endif
+
+#ifdef CHANGED_5
+    /* executable image of the process, used for demand paging */
+    image_t *image;
+
+    /* entry point (_start) of the executable */
+    uint32_t entry_point;
+
+    /* demand paged regions (segments of the executable) */
+    process_region_t regions[PROCESS_MAX_REGIONS];
+#endif
+
 } process_table_t;
 
+#ifdef CHANGED_5
+/* The process table grows one page of entries at a time, up to
+   CONFIG_MAX_PROCESSES entries. */
+#define PROCESS_CHUNK_ENTRIES (PAGE_SIZE / sizeof(process_table_t))
+#define PROCESS_MAX_CHUNKS ((CONFIG_MAX_PROCESSES + PROCESS_CHUNK_ENTRIES - 1) \
+                            / PROCESS_CHUNK_ENTRIES)
+
+/* PIDs given to userland contain the generation of the entry above the
+   index of the entry, so a PID of an entry that has been freed and
+   reused does not refer to the new process. */
+#define PROCESS_INDEX_BITS 12
+#define PROCESS_USER_PID(index, generation) \
+    ((PID_t)(((generation) << PROCESS_INDEX_BITS) | (index)))
+#define PROCESS_PID_INDEX(pid) ((pid) & ((1 << PROCESS_INDEX_BITS) - 1))
+#define PROCESS_PID_GENERATION(pid) ((uint32_t)(pid) >> PROCESS_INDEX_BITS)
+/* generations wrap before the PID would become negative */
+#define PROCESS_MAX_GENERATION ((1 << (31 - PROCESS_INDEX_BITS)) - 1)
+#endif
+
 
 
 void process_table_init();
@@ -72,6 +230,41 @@ void process_table_init();
 PID_t get_current_process_pid();
 process_table_t* get_current_process_entry();
 
+#ifdef CHANGED_5
+/* Releases the executable image (demand paged regions) of a process */
+void process_free_image(process_table_t *entry);
+
+/* File mappings of the current process (SYSCALL_MMAP) */
+uint32_t process_map_file(openfile_t file, uint32_t offset, uint32_t length);
+int process_unmap_file(uint32_t vaddr);
+void process_unmap_all_files(void);
+
+/* Process table entries by index, and PIDs for userland */
+process_table_t *process_get_entry(PID_t pid);
+PID_t process_user_pid(PID_t pid);
+
+/* Creating, exiting and joining processes */
+void process_wait_created(child_process_create_data_t *data);
+void process_finish(process_table_t *entry, int retval);
+int process_join(PID_t pid);
+
+/* Userland threads of the current process */
+int process_thread_create(uint32_t pc, uint32_t a0, uint32_t a1);
+int process_thread_join(int thread);
+int process_thread_exit(int retval);
+void process_stop_threads(process_table_t *entry);
+void process_thread_check_exit(void);
+void process_interrupt_check(void);
+
+int process_profile_start(uint32_t base, uint32_t shift);
+uint32_t process_profile_stop(process_table_t *entry);
+void process_profile_sample(void);
+
+/* Maps or unmaps heap pages of a process (SYSCALL_MEMLIMIT) */
+int process_resize_heap(process_table_t *entry, pagetable_t *pagetable,
+                        uint32_t pages);
+#endif
+
 #endif
 
 
@@ -46,6 +46,17 @@
 #   include "vm/vm.h"
 #endif
 
+#ifdef CHANGED_5
+#   include "kernel/interrupt.h"
+#   include "kernel/spinlock.h"
+#   include "drivers/timer.h"
+#   include "vm/pagepool.h"
+#endif
+
+#if defined(CHANGED_2) && !defined(CHANGED_5)
+#   define USER_PAGE_OFFSETS vm_get_vaddr_page_offsets
+#endif
+
 #ifdef CHANGED_2
 
 static void handle_execp(context_t *user_context, thread_table_t *my_entry) {
@@ -57,20 +68,25 @@ static void handle_execp(context_t *user_context, thread_table_t *my_entry) {
     int used, total_used, i, argc, readed_args;
     char** virt_argv;
     char* virt_filename;
+#ifndef CHANGED_5
     // this is not actually used, vm_get_vaddr_page_offsets just needs it
     uint32_t dummy;
+#endif
     PID_t created_child;
 
     // ===== FILENAME ======
 
     virt_filename = (char*) user_context->cpu_regs[MIPS_REGISTER_A1];
-    if (!vm_get_vaddr_page_offsets(my_entry->pagetable,
+#ifndef CHANGED_5
+    // the copy below fails on a bad address by itself
+    if (!USER_PAGE_OFFSETS(my_entry->pagetable,
             (uint32_t) virt_filename, &dummy, &dummy)) {
         // filename address not inside userland memory
         user_context->cpu_regs[MIPS_REGISTER_V0] =
                 (uint32_t) RETVAL_SYSCALL_USERLAND_NOK;
         return;
     }
+#endif
 
     if (read_string_from_vm(my_entry->pagetable, virt_filename, filename,
             CONFIG_SYSCALL_MAX_BUFFER_SIZE) == RETVAL_SYSCALL_HELPERS_NOK) {
@@ -84,8 +100,34 @@ static void handle_execp(context_t *user_context, thread_table_t *my_entry) {
 
     argc = (int) user_context->cpu_regs[MIPS_REGISTER_A2];
     virt_argv = (char**) user_context->cpu_regs[MIPS_REGISTER_A3];
+#ifdef CHANGED_5
+    // the pointers to the arguments are copied to argv first, and
+    // replaced with pointers to the copies of the strings
+    if (argc < 0 || argc >= CONFIG_SYSCALL_MAX_ARGC ||
+            copy_from_user(argv, virt_argv, argc * sizeof(char*))
+            == RETVAL_SYSCALL_HELPERS_NOK) {
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) RETVAL_SYSCALL_USERLAND_NOK;
+        return;
+    }
+    total_used = 0;
+    readed_args = 0;
+
+    for (i = 0; i < argc; i++) {
+        used = copy_string_from_user(temp + total_used, argv[i],
+                CONFIG_SYSCALL_MAX_BUFFER_SIZE - total_used);
+        if (used == RETVAL_SYSCALL_HELPERS_NOK) {
+            // bad pointer or overflow
+            user_context->cpu_regs[MIPS_REGISTER_V0] =
+                    (uint32_t) RETVAL_SYSCALL_USERLAND_NOK;
+            return;
+        }
+        argv[readed_args++] = temp + total_used;
+        total_used += used;
+    }
+#else
     if (argc
-            < 0|| (argc > 0 && !vm_get_vaddr_page_offsets(my_entry->pagetable, (uint32_t)virt_argv,
+            < 0|| (argc > 0 && !USER_PAGE_OFFSETS(my_entry->pagetable, (uint32_t)virt_argv,
                             &dummy, &dummy)) || argc >= CONFIG_SYSCALL_MAX_ARGC) {
     // negative number of arguments or string argument array is not inside userland memory
     // or too many arguments
@@ -96,7 +138,7 @@ user_context    ->cpu_regs[MIPS_REGISTER_V0] = (uint32_t)RETVAL_SYSCALL_USERLAND
     readed_args = 0;
 
     for (i = 0; i < argc; i++) {
-        if (!vm_get_vaddr_page_offsets(my_entry->pagetable,
+        if (!USER_PAGE_OFFSETS(my_entry->pagetable,
                 (uint32_t) virt_argv + i, &dummy, &dummy)) {
             // i'th argument pointer not inside userland memory
             user_context->cpu_regs[MIPS_REGISTER_V0] =
@@ -116,6 +158,7 @@ user_context    ->cpu_regs[MIPS_REGISTER_V0] = (uint32_t)RETVAL_SYSCALL_USERLAND
         argv[readed_args++] = temp + total_used;
         total_used += used;
     }
+#endif
 
     // all data readed successfully, we can start our the child process
     created_child = syscall_handle_execp(filename, argc, argv);
@@ -132,6 +175,146 @@ user_context    ->cpu_regs[MIPS_REGISTER_V0] = (uint32_t)RETVAL_SYSCALL_USERLAND
 
 #endif
 
+#ifdef CHANGED_5
+/* Statistics of the system calls of all processes. The statistics of
+   a process are kept on a page of its own, allocated when the process
+   first asks for them with SYSCALL_STATS. Both are protected by
+   syscall_stats_slock. */
+static syscall_stats_t syscall_stats[SYSCALL_STATS_SLOTS];
+static spinlock_t syscall_stats_slock;
+
+/* The statistics of a process must fit on its page; fails to compile
+   otherwise */
+typedef char syscall_stats_page_check
+    [SYSCALL_STATS_SLOTS * sizeof(syscall_stats_t) <= PAGE_SIZE ? 1 : -1];
+
+void syscall_stats_init(void) {
+    spinlock_reset(&syscall_stats_slock);
+    memoryset(syscall_stats, 0, sizeof(syscall_stats));
+}
+
+static void add_stats(syscall_stats_t *stats, int error, int bucket) {
+    stats->calls++;
+    if (error)
+        stats->errors++;
+    stats->latency[bucket]++;
+}
+
+/* Records a system call that returned retval after given number of
+   cycles in the kernel */
+static void record_syscall(uint32_t num, uint32_t retval, uint32_t cycles) {
+    process_table_t *entry = get_current_process_entry();
+    interrupt_status_t intr_status;
+    int slot, bucket, error;
+
+    if ((num >> 8) < 1 || (num >> 8) > 2
+            || (num & 0xff) >= SYSCALL_STATS_GROUP)
+        return;
+    slot = SYSCALL_STATS_SLOT(num);
+    for (bucket = 0 ; bucket < SYSCALL_STATS_BUCKETS - 1 &&
+             (cycles >> (bucket + 1)) != 0 ; bucket++)
+        ;
+    error = (int)retval < 0 ||
+        (retval == 0 && (num == SYSCALL_MEMLIMIT || num == SYSCALL_MMAP));
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&syscall_stats_slock);
+    add_stats(&syscall_stats[slot], error, bucket);
+    // processes that have not asked for their statistics have no page
+    if (entry != NULL && entry->stats != 0)
+        add_stats((syscall_stats_t *)entry->stats + slot, error, bucket);
+    spinlock_release(&syscall_stats_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/* Gives the current process a page for its statistics if it has none.
+   Returns 0 on success, -1 if no page is free. */
+static int enable_process_stats(process_table_t *entry) {
+    interrupt_status_t intr_status;
+    uint32_t phys;
+
+    if (entry->stats != 0)
+        return 0;
+    phys = pagepool_get_zeroed_phys_page();
+    if (phys == 0)
+        return -1;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&syscall_stats_slock);
+    if (entry->stats == 0) {
+        entry->stats = ADDR_PHYS_TO_KERNEL(phys);
+        phys = 0;
+    }
+    spinlock_release(&syscall_stats_slock);
+    _interrupt_set_state(intr_status);
+
+    // another thread of the process was first
+    if (phys != 0)
+        pagepool_free_phys_page(phys);
+    return 0;
+}
+
+/* Frees the statistics of an exiting process */
+void syscall_stats_release(process_table_t *entry) {
+    interrupt_status_t intr_status;
+    uint32_t stats;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&syscall_stats_slock);
+    stats = entry->stats;
+    entry->stats = 0;
+    spinlock_release(&syscall_stats_slock);
+    _interrupt_set_state(intr_status);
+
+    if (stats != 0)
+        pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS(stats));
+}
+
+/* Prints the statistics of all processes, called at shutdown */
+void syscall_stats_print(void) {
+    int slot, b;
+
+    for (slot = 0 ; slot < SYSCALL_STATS_SLOTS ; slot++) {
+        if (syscall_stats[slot].calls == 0)
+            continue;
+        kprintf("Syscall 0x%x: %d calls, %d errors, cycles:",
+                (slot / SYSCALL_STATS_GROUP + 1) * 0x100
+                + slot % SYSCALL_STATS_GROUP,
+                syscall_stats[slot].calls, syscall_stats[slot].errors);
+        for (b = 0 ; b < SYSCALL_STATS_BUCKETS ; b++) {
+            if (syscall_stats[slot].latency[b] != 0)
+                kprintf(" 2^%d:%d", b, syscall_stats[slot].latency[b]);
+        }
+        kprintf("\n");
+    }
+}
+
+/* Copies the statistics of the calling process, or of all processes if
+   global is non-zero, to SYSCALL_STATS_SLOTS entries at stats. The
+   first request for the statistics of the process starts collecting
+   them, so they count the calls from that call on. */
+int syscall_handle_stats(syscall_stats_t *stats, int global) {
+    process_table_t *entry = get_current_process_entry();
+    syscall_stats_t *source;
+    int slot;
+
+    if (entry == NULL)
+        return RETVAL_SYSCALL_USERLAND_NOK;
+    if (!global && enable_process_stats(entry) < 0)
+        return RETVAL_SYSCALL_USERLAND_NOK;
+    for (slot = 0 ; slot < SYSCALL_STATS_SLOTS ; slot++) {
+        if (global)
+            source = &syscall_stats[slot];
+        else
+            source = (syscall_stats_t *)entry->stats + slot;
+        if (copy_to_user(stats + slot, source, sizeof(syscall_stats_t))
+                == RETVAL_SYSCALL_HELPERS_NOK)
+            return RETVAL_SYSCALL_USERLAND_NOK;
+    }
+    return 0;
+}
+#endif
+
 /**
  * Handle system calls. Interrupts are enabled when this function is
  * called.
@@ -151,6 +334,9 @@ void syscall_handle(context_t *user_context) {
      */
 #ifdef CHANGED_2
 
+#ifdef CHANGED_5
+    uint32_t start_cycles = _timer_get_ticks();
+#endif
     thread_table_t *my_entry;
     my_entry = thread_get_current_thread_entry();
     int return_value;
@@ -162,6 +348,10 @@ void syscall_handle(context_t *user_context) {
         handle_execp(user_context, my_entry);
         break;
     case SYSCALL_EXIT:
+#ifdef CHANGED_5
+        // exit does not return, so it is counted when it is entered
+        record_syscall(SYSCALL_EXIT, 0, _timer_get_ticks() - start_cycles);
+#endif
         syscall_handle_exit((int) user_context->cpu_regs[MIPS_REGISTER_A1]);
         break;
     case SYSCALL_JOIN:
@@ -169,6 +359,32 @@ void syscall_handle(context_t *user_context) {
                 (uint32_t) syscall_handle_join(
                         (PID_t) user_context->cpu_regs[MIPS_REGISTER_A1]);
         break;
+#ifdef CHANGED_5
+    case SYSCALL_FORK:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_fork(
+                        user_context->cpu_regs[MIPS_REGISTER_A1],
+                        user_context->cpu_regs[MIPS_REGISTER_A2]);
+        break;
+    case SYSCALL_THREAD_CREATE:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_thread_create(
+                        user_context->cpu_regs[MIPS_REGISTER_A1],
+                        user_context->cpu_regs[MIPS_REGISTER_A2],
+                        user_context->cpu_regs[MIPS_REGISTER_A3]);
+        break;
+    case SYSCALL_THREAD_JOIN:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_thread_join(
+                        (int) user_context->cpu_regs[MIPS_REGISTER_A1]);
+        break;
+    case SYSCALL_THREAD_EXIT:
+        record_syscall(SYSCALL_THREAD_EXIT, 0,
+                       _timer_get_ticks() - start_cycles);
+        syscall_handle_thread_exit(
+                (int) user_context->cpu_regs[MIPS_REGISTER_A1]);
+        break;
+#endif
 #ifdef CHANGED_4
     case SYSCALL_MEMLIMIT:
         user_context->cpu_regs[MIPS_REGISTER_V0] =
@@ -214,11 +430,81 @@ void syscall_handle(context_t *user_context) {
         return_value = syscall_handle_delete((char*) user_context->cpu_regs[MIPS_REGISTER_A1]);
         user_context->cpu_regs[MIPS_REGISTER_V0] = return_value;
         break;
+#ifdef CHANGED_5
+    case SYSCALL_MMAP:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_mmap(
+                        user_context->cpu_regs[MIPS_REGISTER_A1],
+                        user_context->cpu_regs[MIPS_REGISTER_A2],
+                        user_context->cpu_regs[MIPS_REGISTER_A3]);
+        break;
+    case SYSCALL_MUNMAP:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_munmap(
+                        (void *) user_context->cpu_regs[MIPS_REGISTER_A1]);
+        break;
+    case SYSCALL_RING_SETUP:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_ring_setup(
+                        (syscall_ring_t *) user_context->cpu_regs[MIPS_REGISTER_A1]);
+        break;
+    case SYSCALL_SUBMIT:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_submit();
+        break;
+    case SYSCALL_AREAD:
+    case SYSCALL_AWRITE:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_aio(
+                        (const syscall_aio_t *) user_context->cpu_regs[MIPS_REGISTER_A1],
+                        user_context->cpu_regs[MIPS_REGISTER_A0] == SYSCALL_AWRITE);
+        break;
+    case SYSCALL_AWAIT:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_await(
+                        (int *) user_context->cpu_regs[MIPS_REGISTER_A1]);
+        break;
+    case SYSCALL_PIPE:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_pipe(
+                        (openfile_t *) user_context->cpu_regs[MIPS_REGISTER_A1]);
+        break;
+    case SYSCALL_REDIRECT:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_redirect(
+                        (int) user_context->cpu_regs[MIPS_REGISTER_A1],
+                        (openfile_t) user_context->cpu_regs[MIPS_REGISTER_A2]);
+        break;
+    case SYSCALL_STATS:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_stats(
+                        (syscall_stats_t *) user_context->cpu_regs[MIPS_REGISTER_A1],
+                        (int) user_context->cpu_regs[MIPS_REGISTER_A2]);
+        break;
+    case SYSCALL_PROFILE_START:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_profile_start(
+                        user_context->cpu_regs[MIPS_REGISTER_A1],
+                        user_context->cpu_regs[MIPS_REGISTER_A2]);
+        break;
+    case SYSCALL_PROFILE_STOP:
+        user_context->cpu_regs[MIPS_REGISTER_V0] =
+                (uint32_t) syscall_handle_profile_stop(
+                        (syscall_profile_t *) user_context->cpu_regs[MIPS_REGISTER_A1]);
+        break;
+#endif
     default:
         user_context->cpu_regs[MIPS_REGISTER_V0] = RETVAL_SYSCALL_USERLAND_NOK;
         break;
         //KERNEL_PANIC("Unhandled system call\n");
     }
+#ifdef CHANGED_5
+    record_syscall(user_context->cpu_regs[MIPS_REGISTER_A0],
+                   user_context->cpu_regs[MIPS_REGISTER_V0],
+                   _timer_get_ticks() - start_cycles);
+    /* another thread may have started to exit the process */
+    process_thread_check_exit();
+#endif
 
 #else
     switch(user_context->cpu_regs[MIPS_REGISTER_A0]) {
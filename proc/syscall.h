@@ -37,6 +37,124 @@
 #ifndef BUENOS_PROC_SYSCALL
 #define BUENOS_PROC_SYSCALL
 
+#ifdef CHANGED_5
+#include "lib/types.h"
+
+/* Submission and completion rings, which a process keeps in its own
+ * memory and registers with SYSCALL_RING_SETUP. The process adds
+ * requests at sq_tail and SYSCALL_SUBMIT runs them from sq_head on,
+ * adding a completion for each at cq_tail, as long as there is room
+ * in the completion ring. The process takes completions from cq_head.
+ * The indices only grow, the slot of an index is the index modulo
+ * SYSCALL_RING_ENTRIES.
+ */
+#define SYSCALL_RING_ENTRIES 32
+
+typedef struct {
+    /* SYSCALL_OPEN, CLOSE, SEEK, READ, WRITE, CREATE or DELETE */
+    uint32_t opcode;
+    /* arguments as for the system call itself */
+    uint32_t arg1;
+    uint32_t arg2;
+    uint32_t arg3;
+    /* copied to the completion */
+    uint32_t user_data;
+} syscall_sqe_t;
+
+typedef struct {
+    uint32_t user_data;
+    /* return value of the request */
+    int result;
+} syscall_cqe_t;
+
+typedef struct {
+    /* next request the kernel runs, written by the kernel */
+    uint32_t sq_head;
+    /* next free request slot, written by the process */
+    uint32_t sq_tail;
+    /* next completion the process takes, written by the process */
+    uint32_t cq_head;
+    /* next free completion slot, written by the kernel */
+    uint32_t cq_tail;
+    syscall_sqe_t sq[SYSCALL_RING_ENTRIES];
+    syscall_cqe_t cq[SYSCALL_RING_ENTRIES];
+} syscall_ring_t;
+
+/* An asynchronous read or write, see SYSCALL_AREAD */
+typedef struct {
+    int filehandle;
+    void *buffer;
+    int length;
+    /* position in the file, the seek position is not used */
+    int offset;
+} syscall_aio_t;
+
+/* Kernel data pages, mapped read-only at SYSCALL_KDATA_ADDR in every
+ * process, so that userland can read them without a system call. The
+ * first page is shared by all processes and updated by the kernel on
+ * every timer interrupt, the next one belongs to the process.
+ */
+#define SYSCALL_KDATA_ADDR 0x60000000
+
+typedef struct {
+    /* rtc_get_msec() at the last timer interrupt */
+    uint32_t msec;
+    /* timer interrupts of CPU 0 since boot */
+    uint32_t ticks;
+    /* number of CPUs */
+    uint32_t cpus;
+    /* free physical pages at the last timer interrupt */
+    uint32_t free_pages;
+} syscall_kdata_t;
+
+typedef struct {
+    /* PID of the process, as returned by exec and fork */
+    int pid;
+} syscall_kdata_process_t;
+
+/* Statistics of a system call, see SYSCALL_STATS. Each of the two
+ * groups of system calls, 0x1kk and 0x2kk, has SYSCALL_STATS_GROUP
+ * slots, enough for its highest number (SYSCALL_PROC_LAST and
+ * SYSCALL_FS_LAST). SYSCALL_STATS_SLOT gives the slot of a number.
+ * Exit and thread exit are counted when they are entered, halt is not
+ * counted.
+ */
+#define SYSCALL_STATS_GROUP                                     \
+    (((SYSCALL_PROC_LAST & 0xff) > (SYSCALL_FS_LAST & 0xff)     \
+      ? (SYSCALL_PROC_LAST & 0xff) : (SYSCALL_FS_LAST & 0xff)) + 1)
+#define SYSCALL_STATS_SLOTS (2 * SYSCALL_STATS_GROUP)
+#define SYSCALL_STATS_BUCKETS 24
+#define SYSCALL_STATS_SLOT(num) \
+    ((((num) >> 8) - 1) * SYSCALL_STATS_GROUP + ((num) & 0xff))
+
+typedef struct {
+    uint32_t calls;
+    /* calls that returned a negative value, or NULL for memlimit and
+       mmap */
+    uint32_t errors;
+    /* calls by cycles from entering to leaving the kernel. Bucket b
+       counts calls of 2^b to 2^(b+1)-1 cycles, the last bucket all
+       longer ones too. */
+    uint32_t latency[SYSCALL_STATS_BUCKETS];
+} syscall_stats_t;
+
+/* PC histogram of a process profiled with SYSCALL_PROFILE_START. One
+ * page in size.
+ */
+#define SYSCALL_PROFILE_BUCKETS 1020
+
+typedef struct {
+    /* address counted in bucket 0 */
+    uint32_t base;
+    /* bucket i counts PCs from base + (i << shift) on */
+    uint32_t shift;
+    /* timer interrupts that found the process running in userland */
+    uint32_t samples;
+    /* samples with the PC outside the buckets */
+    uint32_t missed;
+    uint32_t buckets[SYSCALL_PROFILE_BUCKETS];
+} syscall_profile_t;
+#endif /* CHANGED_5 */
 
 #ifdef CHANGED_2
 
@@ -103,6 +221,102 @@ int read_data_from_vm(pagetable_t* pagetable, const void* virtual_source,
 int write_data_to_vm(pagetable_t* pagetable, const void* physical_source,
         void* virtual_target, int size);
 
+#ifdef CHANGED_5
+/**
+ * Same as vm_get_vaddr_page_offsets, but loads the page first if it
+ * belongs to the calling process and has not been touched yet.
+ */
+int get_user_page_offsets(pagetable_t* pagetable, uint32_t vaddr,
+        uint32_t* p_physpageoff, uint32_t* p_virtpageoff);
+
+/* Copy routines in proc/_user_copy.S, see copy_from_user. */
+int _user_copy(void *target, const void *source, int size);
+int _user_copy_string(char *target, const char *source, int max_length);
+void _user_copy_start(void);
+void _user_copy_end(void);
+void _user_copy_fault(void);
+
+/**
+ * Copies data from the memory of the calling process. The data is
+ * read through the TLB with the address space of the process active,
+ * so pages are loaded on demand. A bad address does not kill the
+ * process but makes the copy fail.
+ *
+ * @param target Kernel buffer, at least size bytes.
+ * @param user_source VIRTUAL address in the calling process.
+ * @param size Number of bytes to copy.
+ * @return RETVAL_SYSCALL_HELPERS_OK, or RETVAL_SYSCALL_HELPERS_NOK if
+ *         the source is not readable memory of the process.
+ */
+int copy_from_user(void *target, const void *user_source, int size);
+
+/**
+ * Copies data to the memory of the calling process, see
+ * copy_from_user. Copy-on-write pages are copied as needed.
+ *
+ * @param user_target VIRTUAL address in the calling process.
+ * @param source Kernel buffer, at least size bytes.
+ * @param size Number of bytes to copy.
+ * @return RETVAL_SYSCALL_HELPERS_OK, or RETVAL_SYSCALL_HELPERS_NOK if
+ *         the target is not writable memory of the process.
+ */
+int copy_to_user(void *user_target, const void *source, int size);
+
+/**
+ * Copies a string from the memory of the calling process, see
+ * copy_from_user.
+ *
+ * @param target Kernel buffer, at least max_length bytes.
+ * @param user_source VIRTUAL address of the string in the calling process.
+ * @param max_length Maximum length of the string including the
+ *        terminating zero.
+ * @return Length of the string including the terminating zero, or
+ *         RETVAL_SYSCALL_HELPERS_NOK if the string is not readable or
+ *         too long.
+ */
+int copy_string_from_user(char *target, const char *user_source,
+        int max_length);
+
+/** A user buffer pinned in memory, see pin_user_buffer. */
+typedef struct {
+    /* The buffer as kernel addresses, one segment per physically
+       contiguous piece */
+    vfs_segment_t segments[CONFIG_SYSCALL_MAX_PINNED_PAGES];
+    int count;
+    /* Virtual address of the first page */
+    uint32_t vaddr;
+    /* Physical addresses of the pages */
+    uint32_t phys[CONFIG_SYSCALL_MAX_PINNED_PAGES];
+    int pages;
+    /* Bit i is set if page i was owned by the pagetable when pinned */
+    uint32_t owned;
+} user_buffer_t;
+
+/**
+ * Pins the pages of a buffer of the calling process so that they stay
+ * in memory, and describes the buffer as segments the kernel can
+ * access directly. At most CONFIG_SYSCALL_MAX_PINNED_PAGES pages are
+ * pinned at once. Must be released with unpin_user_buffer.
+ *
+ * @param pagetable Page table of the process.
+ * @param buffer The pinned buffer.
+ * @param virtual_buffer VIRTUAL address of the buffer in the process.
+ * @param size Size of the buffer.
+ * @param write Non-zero if the kernel writes to the buffer. The pages
+ *        are then made writable first, shared pages are copied.
+ * @return Number of bytes of the buffer pinned, RETVAL_SYSCALL_HELPERS_NOK
+ *         if the buffer is not in the address space of the process or
+ *         write is set and a page is read-only.
+ */
+int pin_user_buffer(pagetable_t* pagetable, user_buffer_t* buffer,
+        void* virtual_buffer, int size, int write);
+
+/**
+ * Releases the pages pinned by pin_user_buffer.
+ */
+void unpin_user_buffer(pagetable_t* pagetable, user_buffer_t* buffer);
+#endif
+
 
 
 /* SYSCALL HANDLER DEFINITIONS */
@@ -117,6 +331,28 @@ int syscall_handle_join(PID_t pid);
 void * syscall_handle_memlimit(void *heap_end);
 #endif /*CHANGED_4*/
 
+#ifdef CHANGED_5
+PID_t syscall_handle_fork(uint32_t func, uint32_t arg);
+
+int syscall_handle_thread_create(uint32_t pc, uint32_t a0, uint32_t a1);
+
+int syscall_handle_thread_join(int thread);
+
+void syscall_handle_thread_exit(int retval);
+
+void syscall_stats_init(void);
+
+void syscall_stats_release(process_table_t *entry);
+
+void syscall_stats_print(void);
+
+int syscall_handle_stats(syscall_stats_t *stats, int global);
+
+int syscall_handle_profile_start(uint32_t base, uint32_t shift);
+
+int syscall_handle_profile_stop(syscall_profile_t *profile);
+#endif /*CHANGED_5*/
+
 openfile_t syscall_handle_open(const char *filename);
 
 int syscall_handle_close(openfile_t filehandle);
@@ -131,6 +367,26 @@ int syscall_handle_create(const char *filename, int size);
 
 int syscall_handle_delete(const char *filename);
 
+#ifdef CHANGED_5
+void *syscall_handle_mmap(openfile_t filehandle, int offset, int length);
+
+int syscall_handle_munmap(void *addr);
+
+int syscall_handle_ring_setup(syscall_ring_t *ring);
+
+int syscall_handle_submit(void);
+
+int syscall_handle_aio(const syscall_aio_t *request, int write);
+
+int syscall_handle_await(int *result);
+
+int syscall_handle_pipe(openfile_t *handles);
+
+int syscall_handle_redirect(int std, openfile_t filehandle);
+
+void syscall_inherit_stdio(process_table_t *parent, process_table_t *child);
+#endif
+
 
 #endif /* CHANGED_2 */
 
@@ -145,6 +401,13 @@ int syscall_handle_delete(const char *filename);
 #define SYSCALL_JOIN 0x103
 #define SYSCALL_FORK 0x104
 #define SYSCALL_MEMLIMIT 0x105
+#define SYSCALL_THREAD_CREATE 0x106
+#define SYSCALL_THREAD_JOIN 0x107
+#define SYSCALL_THREAD_EXIT 0x108
+#define SYSCALL_STATS 0x109
+#define SYSCALL_PROFILE_START 0x10A
+#define SYSCALL_PROFILE_STOP 0x10B
+#define SYSCALL_REDIRECT 0x10C
 #define SYSCALL_OPEN 0x201
 #define SYSCALL_CLOSE 0x202
 #define SYSCALL_SEEK 0x203
@@ -152,6 +415,22 @@ int syscall_handle_delete(const char *filename);
 #define SYSCALL_WRITE 0x205
 #define SYSCALL_CREATE 0x206
 #define SYSCALL_DELETE 0x207
+#define SYSCALL_MMAP 0x208
+#define SYSCALL_MUNMAP 0x209
+#define SYSCALL_RING_SETUP 0x20A
+#define SYSCALL_SUBMIT 0x20B
+#define SYSCALL_AREAD 0x20C
+#define SYSCALL_AWRITE 0x20D
+#define SYSCALL_AWAIT 0x20E
+#define SYSCALL_PIPE 0x20F
+
+#ifdef CHANGED_5
+/* Highest numbers of the groups, keep them up to date when adding
+ * system calls as they size the statistics (SYSCALL_STATS_GROUP).
+ */
+#define SYSCALL_PROC_LAST SYSCALL_REDIRECT
+#define SYSCALL_FS_LAST SYSCALL_PIPE
+#endif
 
 
 
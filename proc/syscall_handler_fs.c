@@ -12,6 +12,26 @@
 #include "vm/pagetable.h"
 #include "drivers/gcd.h"
 #include "kernel/config.h"
+#ifdef CHANGED_5
+#include "proc/aio.h"
+#include "proc/pipe.h"
+
+/* Closes a file or pipe handle */
+static void close_handle(openfile_t filehandle) {
+    if (PIPE_IS_HANDLE(filehandle))
+        pipe_close(filehandle);
+    else
+        vfs_close(filehandle);
+}
+
+/* Opens another reference to a file or pipe handle, returns 0 on
+   success */
+static int dup_handle(openfile_t filehandle) {
+    if (PIPE_IS_HANDLE(filehandle))
+        return pipe_dup(filehandle);
+    return vfs_dup(filehandle);
+}
+#endif
 
 /*close all filehandles attached to the process*/
 void syscall_close_all_filehandles(process_table_t *pt) {
@@ -20,10 +40,22 @@ void syscall_close_all_filehandles(process_table_t *pt) {
     for (i = 0; i < MAX_OPEN_FILES_PER_PROCESS; i++) {
         int filehandle = pt->filehandle[i];
         if (filehandle > 0) {
+#ifdef CHANGED_5
+            close_handle(filehandle);
+#else
             vfs_close(filehandle);
+#endif
         }
         pt->filehandle[i] = -1;
     }
+#ifdef CHANGED_5
+    // and the handles stdin and stdout are redirected to
+    for (i = FILEHANDLE_STDIN; i <= FILEHANDLE_STDOUT; i++) {
+        if (pt->stdio[i] != i)
+            close_handle(pt->stdio[i]);
+        pt->stdio[i] = i;
+    }
+#endif
 }
 
 /*check that the process has the given filehandle */
@@ -78,7 +110,11 @@ int syscall_handle_close(openfile_t filehandle) {
     /*try to find the filehandle and close it */
     for (i = 0; i < MAX_OPEN_FILES_PER_PROCESS; i++) {
         if (pt->filehandle[i] == filehandle) {
+#ifdef CHANGED_5
+            close_handle(filehandle);
+#else
             vfs_close(filehandle);
+#endif
             filehandle_found = 1;
             pt->filehandle[i] = -1;
             break;
@@ -104,6 +140,48 @@ int syscall_handle_seek(openfile_t filehandle, int offset) {
 
 }
 
+#ifdef CHANGED_5
+/* Reads or writes a file or a pipe straight from or to the pages of a
+   user buffer, with one filesystem call per
+   CONFIG_SYSCALL_MAX_PINNED_PAGES pages of the buffer. A pipe read
+   returns after the first part that gets any data. */
+static int transfer_user_buffer(openfile_t filehandle, void *buffer,
+        int length, int write) {
+    pagetable_t *p = thread_get_current_thread_entry()->pagetable;
+    user_buffer_t pinned;
+    int count = 0;
+    int size, done;
+
+    while (count < length) {
+        // reading from the file writes to the buffer
+        size = pin_user_buffer(p, &pinned, (char *)buffer + count,
+                               length - count, !write);
+        if (size == RETVAL_SYSCALL_HELPERS_NOK) {
+            kprintf("Process was killed\n");
+            syscall_handle_exit(1);
+            return -1;
+        }
+        if (PIPE_IS_HANDLE(filehandle) && write)
+            done = pipe_writev(filehandle, pinned.segments, pinned.count);
+        else if (PIPE_IS_HANDLE(filehandle))
+            done = pipe_readv(filehandle, pinned.segments, pinned.count);
+        else if (write)
+            done = vfs_writev(filehandle, pinned.segments, pinned.count);
+        else
+            done = vfs_readv(filehandle, pinned.segments, pinned.count);
+        unpin_user_buffer(p, &pinned);
+
+        if (done < 0)
+            return write ? count : VFS_ERROR;
+        count += done;
+        // end of file, or a file full as files have fixed sizes
+        if (done < size)
+            break;
+    }
+    return count;
+}
+#endif
+
 int syscall_handle_read(openfile_t filehandle, void *buffer, int length) {
     /* illegal filehandle */
     if (filehandle < 0)
@@ -113,10 +191,20 @@ int syscall_handle_read(openfile_t filehandle, void *buffer, int length) {
     pagetable_t *p = t->pagetable;
     process_table_t *pt = get_current_process_entry();
 
+#ifdef CHANGED_5
+    // stdin may be redirected to a pipe or a file
+    if (filehandle == FILEHANDLE_STDIN)
+        filehandle = pt->stdio[FILEHANDLE_STDIN];
+    else if (check_filehandle(filehandle, pt) == VFS_NOT_OPEN)
+        return VFS_NOT_FOUND;
+    if (filehandle != FILEHANDLE_STDIN)
+        return transfer_user_buffer(filehandle, buffer, length, 0);
+#else
     if (check_filehandle(filehandle, pt) == VFS_NOT_OPEN
             && filehandle != FILEHANDLE_STDIN) {
         return VFS_NOT_FOUND;
     }
+#endif
     /*read from file in blocks and write to vm */
     int count = 0;
     int to_be_read;
@@ -168,10 +256,20 @@ int syscall_handle_write(openfile_t filehandle, const void *buffer, int length)
     int readed;
     int written;
 
+#ifdef CHANGED_5
+    // stdout may be redirected to a pipe or a file
+    if (filehandle == FILEHANDLE_STDOUT)
+        filehandle = pt->stdio[FILEHANDLE_STDOUT];
+    else if (check_filehandle(filehandle, pt) == VFS_NOT_OPEN)
+        return VFS_NOT_FOUND;
+    if (filehandle != FILEHANDLE_STDOUT)
+        return transfer_user_buffer(filehandle, (void *)buffer, length, 1);
+#else
     if (check_filehandle(filehandle, pt) == VFS_NOT_OPEN
             && filehandle != FILEHANDLE_STDOUT) {
         return VFS_NOT_FOUND;
     }
+#endif
 
     while (count < length) {
         readed = MIN(length-count, CONFIG_SYSCALL_MAX_BUFFER_SIZE);
@@ -233,4 +331,210 @@ int syscall_handle_delete(const char *filename) {
     return vfs_remove(temp);
 }
 
+#ifdef CHANGED_5
+void *syscall_handle_mmap(openfile_t filehandle, int offset, int length) {
+    process_table_t *pt = get_current_process_entry();
+
+    if (filehandle <= FILEHANDLE_STDERR || offset < 0 || length <= 0)
+        return NULL;
+    if (check_filehandle(filehandle, pt) == VFS_NOT_OPEN)
+        return NULL;
+    return (void *)process_map_file(filehandle, offset, length);
+}
+
+int syscall_handle_munmap(void *addr) {
+    return process_unmap_file((uint32_t)addr);
+}
+
+int syscall_handle_ring_setup(syscall_ring_t *ring) {
+    process_table_t *pt = get_current_process_entry();
+    uint32_t sq_head;
+
+    if (pt == NULL)
+        return RETVAL_SYSCALL_USERLAND_NOK;
+    // NULL unregisters the ring
+    if (ring != NULL && ((uint32_t)ring % sizeof(uint32_t) != 0 ||
+            copy_from_user(&sq_head, &ring->sq_head, sizeof(sq_head))
+            == RETVAL_SYSCALL_HELPERS_NOK))
+        return RETVAL_SYSCALL_USERLAND_NOK;
+    pt->ring = (uint32_t)ring;
+    return 0;
+}
+
+/* Runs one request of the submission ring */
+static int ring_request(const syscall_sqe_t *sqe) {
+    switch (sqe->opcode) {
+    case SYSCALL_OPEN:
+        return syscall_handle_open((const char *)sqe->arg1);
+    case SYSCALL_CLOSE:
+        return syscall_handle_close(sqe->arg1);
+    case SYSCALL_SEEK:
+        return syscall_handle_seek(sqe->arg1, sqe->arg2);
+    case SYSCALL_READ:
+        return syscall_handle_read(sqe->arg1, (void *)sqe->arg2, sqe->arg3);
+    case SYSCALL_WRITE:
+        return syscall_handle_write(sqe->arg1, (const void *)sqe->arg2,
+                                    sqe->arg3);
+    case SYSCALL_CREATE:
+        return syscall_handle_create((const char *)sqe->arg1, sqe->arg2);
+    case SYSCALL_DELETE:
+        return syscall_handle_delete((const char *)sqe->arg1);
+    default:
+        return RETVAL_SYSCALL_USERLAND_NOK;
+    }
+}
+
+/* Copies a part of the ring of the process to or from the kernel. The
+   process is killed if its ring is not in its memory. */
+static void copy_ring(void *target, const void *source, int size,
+        int to_user) {
+    int ret;
+
+    if (to_user)
+        ret = copy_to_user(target, source, size);
+    else
+        ret = copy_from_user(target, source, size);
+    if (ret == RETVAL_SYSCALL_HELPERS_NOK) {
+        kprintf("Process was killed\n");
+        syscall_handle_exit(1);
+    }
+}
+
+/* Runs the requests in the submission ring of the process in order
+   while there is room for their completions. The indices owned by the
+   kernel are written back once for the whole batch. Returns the number
+   of requests run. */
+int syscall_handle_submit(void) {
+    process_table_t *pt = get_current_process_entry();
+    syscall_ring_t *ring;
+    syscall_sqe_t sqe;
+    syscall_cqe_t cqe;
+    uint32_t sq_head, sq_tail, cq_head, cq_tail;
+    int count = 0;
+
+    if (pt == NULL || pt->ring == 0)
+        return RETVAL_SYSCALL_USERLAND_NOK;
+    ring = (syscall_ring_t *)pt->ring;
+
+    copy_ring(&sq_head, &ring->sq_head, sizeof(uint32_t), 0);
+    copy_ring(&cq_tail, &ring->cq_tail, sizeof(uint32_t), 0);
+    while (1) {
+        // the process may add requests and take completions meanwhile
+        copy_ring(&sq_tail, &ring->sq_tail, sizeof(uint32_t), 0);
+        copy_ring(&cq_head, &ring->cq_head, sizeof(uint32_t), 0);
+        if (sq_head == sq_tail || cq_tail - cq_head >= SYSCALL_RING_ENTRIES)
+            break;
+
+        copy_ring(&sqe, &ring->sq[sq_head % SYSCALL_RING_ENTRIES],
+                  sizeof(sqe), 0);
+        cqe.user_data = sqe.user_data;
+        cqe.result = ring_request(&sqe);
+        copy_ring(&ring->cq[cq_tail % SYSCALL_RING_ENTRIES], &cqe,
+                  sizeof(cqe), 1);
+        sq_head++;
+        cq_tail++;
+        count++;
+    }
+    copy_ring(&ring->sq_head, &sq_head, sizeof(uint32_t), 1);
+    copy_ring(&ring->cq_tail, &cq_tail, sizeof(uint32_t), 1);
+    return count;
+}
+
+int syscall_handle_aio(const syscall_aio_t *request, int write) {
+    process_table_t *pt = get_current_process_entry();
+    syscall_aio_t aio;
+    int token;
+
+    if (copy_from_user(&aio, request, sizeof(aio))
+            == RETVAL_SYSCALL_HELPERS_NOK) {
+        kprintf("Process was killed\n");
+        syscall_handle_exit(1);
+        return -1;
+    }
+    if (aio.filehandle <= FILEHANDLE_STDERR ||
+            check_filehandle(aio.filehandle, pt) == VFS_NOT_OPEN)
+        return VFS_NOT_FOUND;
+
+    token = aio_submit(aio.filehandle, aio.buffer, aio.length, aio.offset,
+                       write);
+    if (token == -2) {
+        kprintf("Process was killed\n");
+        syscall_handle_exit(1);
+        return -1;
+    }
+    return token;
+}
+
+int syscall_handle_await(int *result) {
+    int token, value;
+
+    token = aio_wait_any(&value);
+    if (token >= 0 && result != NULL &&
+            copy_to_user(result, &value, sizeof(value))
+            == RETVAL_SYSCALL_HELPERS_NOK) {
+        kprintf("Process was killed\n");
+        syscall_handle_exit(1);
+        return -1;
+    }
+    return token;
+}
+
+int syscall_handle_pipe(openfile_t *handles) {
+    process_table_t *pt = get_current_process_entry();
+    openfile_t ends[2];
+    int i, slots[2], found = 0;
+
+    // both ends are kept with the open files of the process
+    for (i = 0; i < MAX_OPEN_FILES_PER_PROCESS && found < 2; i++) {
+        if (pt->filehandle[i] == FILEHANDLE_UNUSED)
+            slots[found++] = i;
+    }
+    if (found < 2)
+        return VFS_ERROR;
+    if (pipe_create(&ends[0], &ends[1]) < 0)
+        return VFS_LIMIT;
+    if (copy_to_user(handles, ends, sizeof(ends))
+            == RETVAL_SYSCALL_HELPERS_NOK) {
+        pipe_close(ends[0]);
+        pipe_close(ends[1]);
+        kprintf("Process was killed\n");
+        syscall_handle_exit(1);
+        return -1;
+    }
+    pt->filehandle[slots[0]] = ends[0];
+    pt->filehandle[slots[1]] = ends[1];
+    return 0;
+}
+
+int syscall_handle_redirect(int std, openfile_t filehandle) {
+    process_table_t *pt = get_current_process_entry();
+
+    if (std != FILEHANDLE_STDIN && std != FILEHANDLE_STDOUT)
+        return FILEHANDLE_ILLEGAL;
+    // the redirection holds a reference of its own, so the process may
+    // close the handle afterwards
+    if (filehandle != std) {
+        if (filehandle < 0 || check_filehandle(filehandle, pt) == VFS_NOT_OPEN)
+            return VFS_NOT_FOUND;
+        if (dup_handle(filehandle) < 0)
+            return VFS_ERROR;
+    }
+    if (pt->stdio[std] != std)
+        close_handle(pt->stdio[std]);
+    pt->stdio[std] = filehandle;
+    return 0;
+}
+
+/* Gives a new process the stdin and stdout of its parent. Called while
+   the parent waits for the child to be created. */
+void syscall_inherit_stdio(process_table_t *parent, process_table_t *child) {
+    int i;
+
+    for (i = FILEHANDLE_STDIN; i <= FILEHANDLE_STDOUT; i++) {
+        if (parent->stdio[i] != i && dup_handle(parent->stdio[i]) == 0)
+            child->stdio[i] = parent->stdio[i];
+    }
+}
+#endif
+
 #endif /* CHANGED_2 */
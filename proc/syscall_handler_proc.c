@@ -15,6 +15,9 @@
 #include "vm/pagepool.h"
 #include "kernel/thread.h"
 #include "proc/process_table.h"
+#ifdef CHANGED_5
+#include "proc/aio.h"
+#endif
 
 #ifdef CHANGED_4
 #include "drivers/yams.h"
@@ -25,8 +28,10 @@
 #endif
 
 
+#ifndef CHANGED_5
 extern lock_t* process_table_lock;
 extern process_table_t process_table[CONFIG_MAX_PROCESSES];
+#endif
 
 
 static void new_process_thread(uint32_t dataptr) {
@@ -35,15 +40,19 @@ static void new_process_thread(uint32_t dataptr) {
     process_start(dat->filename, dat);
 }
 
+#ifndef CHANGED_5
 static int is_data_ready(child_process_create_data_t* d) {
     return d->ready;
 }
+#endif
 
 PID_t syscall_handle_execp(const char *filename, int argc, char** argv) {
 
     child_process_create_data_t dat;
     TID_t child_thread;
+#ifndef CHANGED_5
     process_table_t* my_entry;
+#endif
 
     memoryset(&dat, 0, sizeof(child_process_create_data_t));
     dat.argc = argc;
@@ -58,6 +67,11 @@ PID_t syscall_handle_execp(const char *filename, int argc, char** argv) {
         return PROCESS_NO_PARENT_PID;
     }
 
+#ifdef CHANGED_5
+    // start child thread and wait until child process is created
+    thread_run(child_thread);
+    process_wait_created(&dat);
+#else
     my_entry = get_current_process_entry();
     // wait until child process is created
     lock_acquire(my_entry->die_lock);
@@ -69,11 +83,91 @@ PID_t syscall_handle_execp(const char *filename, int argc, char** argv) {
         condition_wait(my_entry->die_cond, my_entry->die_lock);
     }
     lock_release(my_entry->die_lock);
+#endif
+
+    // child entry created (or creation failed), return its pid to userland
+    return dat.child_pid;
+}
+
+
+
+#ifdef CHANGED_5
+static void forked_process_thread(uint32_t dataptr) {
+    process_fork((child_process_create_data_t*)dataptr);
+}
+
+PID_t syscall_handle_fork(uint32_t func, uint32_t arg) {
+
+    child_process_create_data_t dat;
+    TID_t child_thread;
+    thread_table_t* my_thread;
+
+    my_thread = thread_get_current_thread_entry();
+    memoryset(&dat, 0, sizeof(child_process_create_data_t));
+    dat.parent_pid = get_current_process_pid();
+    dat.child_pid = PROCESS_NO_PARENT_PID;
+    dat.ready = 0;
+    dat.pagetable = my_thread->pagetable;
+    dat.func = func;
+    dat.arg = arg;
+    dat.sp = my_thread->user_context->cpu_regs[MIPS_REGISTER_SP];
+
+    if (dat.parent_pid == PROCESS_NO_PARENT_PID || func == 0) {
+        return PROCESS_NO_PARENT_PID;
+    }
+    child_thread = thread_create(forked_process_thread, (uint32_t)&dat);
+    if (child_thread < 0) {
+        return PROCESS_NO_PARENT_PID;
+    }
+
+    // start child thread and wait until child process is created
+    thread_run(child_thread);
+    process_wait_created(&dat);
 
     // child entry created (or creation failed), return its pid to userland
     return dat.child_pid;
 }
 
+int syscall_handle_thread_create(uint32_t pc, uint32_t a0, uint32_t a1) {
+    if (pc == 0)
+        return -1;
+    return process_thread_create(pc, a0, a1);
+}
+
+int syscall_handle_thread_join(int thread) {
+    return process_thread_join(thread);
+}
+
+void syscall_handle_thread_exit(int retval) {
+    // the last thread takes the whole process with it
+    if (!process_thread_exit(retval))
+        syscall_handle_exit(retval);
+}
+
+int syscall_handle_profile_start(uint32_t base, uint32_t shift) {
+    return process_profile_start(base, shift);
+}
+
+int syscall_handle_profile_stop(syscall_profile_t *profile) {
+    process_table_t *my_entry;
+    uint32_t page;
+    int samples;
+
+    my_entry = get_current_process_entry();
+    if (my_entry == NULL)
+        return RETVAL_SYSCALL_USERLAND_NOK;
+    page = process_profile_stop(my_entry);
+    if (page == 0)
+        return RETVAL_SYSCALL_USERLAND_NOK;
+
+    samples = ((syscall_profile_t *)page)->samples;
+    if (profile != NULL && copy_to_user(profile, (void *)page,
+            sizeof(syscall_profile_t)) == RETVAL_SYSCALL_HELPERS_NOK)
+        samples = RETVAL_SYSCALL_USERLAND_NOK;
+    pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS(page));
+    return samples;
+}
+#endif /* CHANGED_5 */
 
 
 extern void syscall_close_all_filehandles(process_table_t*);
@@ -83,8 +177,13 @@ void syscall_handle_exit(int retval) {
     process_table_t* my_entry;
     thread_table_t* my_thread;
     interrupt_status_t intr_stat;
+#ifdef CHANGED_5
+    PID_t my_pid;
+    uint32_t profile;
+#else
     PID_t child_pid, my_pid;
     uint32_t i;
+#endif
 
     if (retval < 0) {
         // no negative return values accepted
@@ -98,9 +197,27 @@ void syscall_handle_exit(int retval) {
 
     my_entry = get_current_process_entry();
     if (my_entry != NULL) {
+#ifdef CHANGED_5
+        // the other threads must not run in the address space freed below
+        process_stop_threads(my_entry);
+        // nor may the disk transfer to it
+        aio_wait_process(my_pid);
+        syscall_stats_release(my_entry);
+        profile = process_profile_stop(my_entry);
+        if (profile != 0)
+            pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS(profile));
+#endif
         syscall_close_all_filehandles(my_entry);
+#ifdef CHANGED_5
+        process_unmap_all_files();
+        process_free_image(my_entry);
+#endif
         my_thread = thread_get_current_thread_entry();
         intr_stat = _interrupt_disable();
+#ifdef CHANGED_5
+        /* free heap */
+        process_resize_heap(my_entry, my_thread->pagetable, 0);
+#else
         lock_acquire(my_entry->die_lock);
         lock_acquire(process_table_lock);
 #ifdef CHANGED_4
@@ -119,9 +236,13 @@ void syscall_handle_exit(int retval) {
         my_entry->retval = retval;
         // signal joining parent (if any)
         condition_broadcast(my_entry->die_cond, my_entry->die_lock);
-
+#endif /* CHANGED_5 */
 
         // release page table
+#ifdef CHANGED_5
+        // the pages are freed by vm_destroy_pagetable under the pagetable
+        // lock, as the swap writer may be moving them meanwhile
+#else
         for (i = 0 ; i < my_thread->pagetable->valid_count ; i++) {
             if (my_thread->pagetable->entries[i].V0) {
                 pagepool_free_phys_page(my_thread->pagetable->entries[i].PFN0 << 12);
@@ -130,8 +251,11 @@ void syscall_handle_exit(int retval) {
                 pagepool_free_phys_page(my_thread->pagetable->entries[i].PFN1 << 12);
             }
         }
+#endif
 
-#ifdef CHANGED_4
+        // with ASID generations (CHANGED_5) the ASID is not reused before
+        // the TLB has been flushed, so the entries can be left in TLB
+#if defined(CHANGED_4) && !defined(CHANGED_5)
         // invalidate TLB entries if they exist
         for (i = 0 ; i < my_thread->pagetable->valid_count ; i++) {
             my_thread->pagetable->entries[i].V0 = my_thread->pagetable->entries[i].V1 = 0;
@@ -143,9 +267,15 @@ void syscall_handle_exit(int retval) {
         my_thread->pagetable = NULL;
         my_thread->userland_pid = -1;
 
+#ifdef CHANGED_5
+        // orphan the children, mark this process as finished and wake
+        // the parent if it is joining
+        process_finish(my_entry, retval);
+#else
         // all done, we can release locks
         lock_release(process_table_lock);
         lock_release(my_entry->die_lock);
+#endif
         _interrupt_set_state(intr_stat);
     }
 
@@ -155,6 +285,17 @@ void syscall_handle_exit(int retval) {
 
 }
 
+#ifdef CHANGED_5
+/* PIDs carry the generation of their process table entry, so a PID of
+ * a child that has already been joined is rejected even if the entry
+ * has been reused. The parent sleeps until one of its children exits. */
+int syscall_handle_join(PID_t pid) {
+    int retval = process_join(pid);
+    if (retval < 0)
+        return RETVAL_SYSCALL_USERLAND_NOK;
+    return retval;
+}
+#else
 int syscall_handle_join(PID_t pid) {
     process_table_t* my_entry;
     process_table_t* child_entry;
@@ -187,6 +328,7 @@ int syscall_handle_join(PID_t pid) {
     // return acquired return value from child
     return retval;
 }
+#endif /* CHANGED_5 */
 
 #ifdef CHANGED_4
 /* check how many pages apart two virtual addresses are
@@ -232,6 +374,36 @@ int can_be_mapped(int n, uint32_t start_page_vaddr, pagetable_t *pagetable) {
     return 1;
 }
 
+#ifdef CHANGED_5
+/* The heap of each process is described in its process table entry:
+ * heap_end is the current end and heap_pages the number of pages mapped
+ * from heap_vaddr on. The page of heap_end is always mapped. Pages
+ * between the old and the new end are known to be mapped (or not) from
+ * the descriptor, so no pagetable search is needed, and they are mapped
+ * and unmapped in batches by process_resize_heap.
+ */
+void * syscall_handle_memlimit(void *heap_end) {
+    process_table_t *proc = get_current_process_entry();
+    thread_table_t *thread = thread_get_current_thread_entry();
+    uint32_t heap_new = (uint32_t)heap_end;
+
+    if (heap_end == NULL)
+        return (void *)proc->heap_end;
+
+    /* the heap must not reach the guard below the stack region or
+       the mmap area */
+    if (heap_new >= proc->stack_bottom -
+                CONFIG_USERLAND_STACK_GUARD * PAGE_SIZE ||
+            heap_new < proc->heap_vaddr || heap_new >= PROCESS_MMAP_BASE)
+        return NULL;
+
+    if (process_resize_heap(proc, thread->pagetable,
+                            (heap_new - proc->heap_vaddr) / PAGE_SIZE + 1) < 0)
+        return NULL;
+    proc->heap_end = heap_new;
+    return heap_end;
+}
+#else
 /* outline for implementation:
  *  current heap_end is calculated heap_start+offset
  *  -> offset is held in a static variable
@@ -297,6 +469,7 @@ void * syscall_handle_memlimit(void *heap_end) {
         return (void *)heap_now;
     }
 }
+#endif /* CHANGED_5 */
 #endif /*CHANGED_4*/
 
 #endif /* CHANGED_2 */
@@ -10,9 +10,188 @@
 #include "proc/syscall.h"
 #include "vm/vm.h"
 
+#ifdef CHANGED_5
+#include "kernel/interrupt.h"
+#include "vm/pagepool.h"
+#include "vm/swap.h"
+#include "vm/tlb.h"
+#include "lib/libc.h"
+
+int get_user_page_offsets(pagetable_t* pagetable, uint32_t vaddr,
+        uint32_t* p_physpageoff, uint32_t* p_virtpageoff) {
+    interrupt_status_t intr_status;
+
+    if (vm_get_vaddr_page_offsets(pagetable, vaddr, p_physpageoff, p_virtpageoff)) {
+        return 1;
+    }
+    // page may belong to the process but not be loaded yet
+    intr_status = _interrupt_disable();
+    process_handle_page_fault(vaddr, 0);
+    _interrupt_set_state(intr_status);
+    return vm_get_vaddr_page_offsets(pagetable, vaddr, p_physpageoff, p_virtpageoff);
+}
+
+/* Last address of the user address space plus one. */
+#define USER_ADDRESS_END 0x80000000
+
+/* Checks that a range does not reach the kernel address space, which
+   the copy routines could access without faults. */
+static int is_user_range(const void *vaddr, int size) {
+    return size >= 0 && (uint32_t)vaddr < USER_ADDRESS_END &&
+        (uint32_t)size <= USER_ADDRESS_END - (uint32_t)vaddr;
+}
+
+int copy_from_user(void *target, const void *user_source, int size) {
+    if (!is_user_range(user_source, size) ||
+            _user_copy(target, user_source, size) < 0)
+        return RETVAL_SYSCALL_HELPERS_NOK;
+    return RETVAL_SYSCALL_HELPERS_OK;
+}
+
+int copy_to_user(void *user_target, const void *source, int size) {
+    if (!is_user_range(user_target, size) ||
+            _user_copy(user_target, source, size) < 0)
+        return RETVAL_SYSCALL_HELPERS_NOK;
+    return RETVAL_SYSCALL_HELPERS_OK;
+}
+
+int copy_string_from_user(char *target, const char *user_source,
+        int max_length) {
+    int ret;
+
+    if (!is_user_range(user_source, 1) || max_length <= 0)
+        return RETVAL_SYSCALL_HELPERS_NOK;
+    max_length = MIN((uint32_t)max_length,
+                     USER_ADDRESS_END - (uint32_t)user_source);
+    ret = _user_copy_string(target, user_source, max_length);
+    if (ret < 0)
+        return RETVAL_SYSCALL_HELPERS_NOK;
+    return ret;
+}
+
+/* Makes a loaded user page writable as the first write to it would:
+   a clean page of a file mapping is marked written and a copy-on-write
+   page is copied. Nothing is written to the page, so a store of
+   another thread of the process is not lost. Must be called with
+   interrupts disabled; interrupts are enabled while waiting for memory
+   for the copy. Returns 0 if the page is mapped read-only, 1 if it is
+   writable or was swapped out meanwhile (pin_user_buffer checks the
+   pages again when it pins them). */
+static int make_page_writable(pagetable_t *pagetable, uint32_t page) {
+    uint32_t physoff, virtoff;
+    int ret, ok;
+
+    if (!vm_mark_written(pagetable, page)) {
+        while ((ret = vm_copy_on_write(pagetable, page)) < 0) {
+            _interrupt_enable();
+            ok = swap_wait_for_pages();
+            _interrupt_disable();
+            if (!ok)
+                return 0;
+        }
+        // the copy may still be a clean page of a file mapping
+        if (ret > 0)
+            vm_mark_written(pagetable, page);
+    }
+    _tlb_set_asid(pagetable->ASID);
+    return vm_is_writable(pagetable, page) ||
+        !vm_get_vaddr_page_offsets(pagetable, page, &physoff, &virtoff);
+}
+
+int pin_user_buffer(pagetable_t* pagetable, user_buffer_t* buffer,
+        void* virtual_buffer, int size, int write) {
+    interrupt_status_t intr_status;
+    pagepool_owner_t owner;
+    vfs_segment_t *segment;
+    uint32_t vaddr, page, end, physoff, virtoff, phys;
+    int ok;
+
+    if (size <= 0)
+        return 0;
+    vaddr = (uint32_t)virtual_buffer;
+    end = vaddr + MIN((uint32_t)size,
+            CONFIG_SYSCALL_MAX_PINNED_PAGES * PAGE_SIZE
+            - (vaddr & ~PAGE_SIZE_MASK));
+    if (end < vaddr)
+        return RETVAL_SYSCALL_HELPERS_NOK;
+
+    do {
+        // load the pages, and make those the call writes writable
+        for (page = vaddr & PAGE_SIZE_MASK ; page < end ; page += PAGE_SIZE) {
+            intr_status = _interrupt_disable();
+            ok = get_user_page_offsets(pagetable, page, &physoff, &virtoff);
+            if (ok && write)
+                ok = make_page_writable(pagetable, page);
+            _interrupt_set_state(intr_status);
+            if (!ok)
+                return RETVAL_SYSCALL_HELPERS_NOK;
+        }
+
+        // a page swapped out after it was loaded is loaded again, and
+        // made writable again if it came back read-only
+        intr_status = _interrupt_disable();
+        buffer->count = 0;
+        buffer->vaddr = vaddr & PAGE_SIZE_MASK;
+        buffer->pages = 0;
+        buffer->owned = 0;
+        for (page = buffer->vaddr ; page < end ; page += PAGE_SIZE) {
+            if (!vm_get_vaddr_page_offsets(pagetable, page, &physoff,
+                    &virtoff) || (write && !vm_is_writable(pagetable, page))) {
+                unpin_user_buffer(pagetable, buffer);
+                break;
+            }
+            phys = physoff << 12;
+            if (pagepool_get_owner(phys, &owner) &&
+                    owner.pagetable == pagetable && owner.vaddr == page)
+                buffer->owned |= 1 << buffer->pages;
+            // a referenced page has no owner and is not swapped out
+            pagepool_ref_phys_page(phys);
+            buffer->phys[buffer->pages++] = phys;
+
+            // physically contiguous pages make one segment
+            segment = buffer->segments + MAX(buffer->count - 1, 0);
+            if (buffer->count > 0 && ADDR_KERNEL_TO_PHYS(
+                    (uint32_t)segment->buffer + segment->size) == phys) {
+                segment->size += MIN(end, page + PAGE_SIZE) - page;
+            } else {
+                segment = buffer->segments + buffer->count;
+                segment->buffer = (void *)ADDR_PHYS_TO_KERNEL(
+                        phys + (MAX(page, vaddr) & ~PAGE_SIZE_MASK));
+                segment->size = MIN(end, page + PAGE_SIZE) - MAX(page, vaddr);
+                buffer->count++;
+            }
+        }
+        _interrupt_set_state(intr_status);
+    } while (buffer->pages == 0);
+
+    return end - vaddr;
+}
+
+void unpin_user_buffer(pagetable_t* pagetable, user_buffer_t* buffer) {
+    interrupt_status_t intr_status;
+    int i;
+
+    intr_status = _interrupt_disable();
+    for (i = 0 ; i < buffer->pages ; i++) {
+        pagepool_free_phys_page(buffer->phys[i]);
+        // give the page back to the swap if it was the process's own
+        if (buffer->owned & (1 << i))
+            pagepool_set_owner(buffer->phys[i], pagetable,
+                               buffer->vaddr + i * PAGE_SIZE);
+    }
+    buffer->count = 0;
+    buffer->pages = 0;
+    _interrupt_set_state(intr_status);
+}
+#endif
+
 
 int read_string_from_vm(pagetable_t* pagetable, const char* virtual_source,
         char* physical_target, int max_length) {
+#ifdef CHANGED_5
+    pagetable = pagetable;
+    return copy_string_from_user(physical_target, virtual_source, max_length);
+#else
 
     uint32_t i, virtual_page_start, virtual_page_end, vaddr, phys_page_start;
     int inside_pagetable;
@@ -42,10 +221,15 @@ int read_string_from_vm(pagetable_t* pagetable, const char* virtual_source,
     }
     // never reach this far, we must add this to prevent compiler error
     return RETVAL_SYSCALL_HELPERS_NOK;
+#endif
 }
 
 int read_data_from_vm(pagetable_t* pagetable, const void* virtual_source,
         void* physical_target, int size) {
+#ifdef CHANGED_5
+    pagetable = pagetable;
+    return copy_from_user(physical_target, virtual_source, size);
+#else
     uint32_t i, virtual_page_start, virtual_page_end, vaddr, phys_page_start;
     int inside_pagetable;
 
@@ -69,11 +253,16 @@ int read_data_from_vm(pagetable_t* pagetable, const void* virtual_source,
     }
     // block with given size was read successfully
     return RETVAL_SYSCALL_HELPERS_OK;
+#endif
 }
 
 
 int write_data_to_vm(pagetable_t* pagetable, const void* physical_source,
         void* virtual_target, int size) {
+#ifdef CHANGED_5
+    pagetable = pagetable;
+    return copy_to_user(virtual_target, physical_source, size);
+#else
     uint32_t i, virtual_page_start, virtual_page_end, vaddr, phys_page_start;
     int inside_pagetable;
 
@@ -93,6 +282,7 @@ int write_data_to_vm(pagetable_t* pagetable, const void* physical_source,
     }
     // block with given size was written successfully
     return RETVAL_SYSCALL_HELPERS_OK;
+#endif
 }
 
 
@@ -9,8 +9,22 @@
 #define BUFFER_SIZE 128
 
 
+/* Copies stdin to stdout until end of file, as in "ls | cat" */
+int cat_stdin(void) {
+    char buffer[BUFFER_SIZE];
+    int retval;
+
+    while ((retval = syscall_read(stdin, buffer, BUFFER_SIZE)) > 0) {
+        syscall_write(stdout, buffer, retval);
+    }
+    return retval < 0 ? retval : 1;
+}
+
 int main(int argc,char **argv) {
 
+    if (argc == 1) {
+        return cat_stdin();
+    }
     if (argc != 2) {
         cout("Invalid arguments. Usage: cat [filename]\n");
         return -1;
@@ -34,7 +48,7 @@ int main(int argc,char **argv) {
             syscall_close(filehandle);
             return retval;
         }
-        syscall_write(1, buffer, BUFFER_SIZE);
+        syscall_write(1, buffer, retval);
 
         if(retval < BUFFER_SIZE){
             break;
@@ -54,6 +54,20 @@ void cout(const char* str, ...) {
     syscall_write(stdout, buffer, written);
 }
 
+/* Number of failed checks, a test returns non-zero if there were any */
+int ok_failures = 0;
+
+/* Print the result of one check of a test */
+void ok(int b)
+{
+    if (b) {
+        cout("OK.\n");
+    } else {
+        cout("FAIL!\n");
+        ok_failures++;
+    }
+}
+
 /* Halt the system (sync disks and power off). This function will
  * never return. 
  */
@@ -105,10 +119,13 @@ int syscall_join(int pid)
 }
 
 
-/* Create a new thread running in the same address space as the
- * caller. The thread is started at function 'func', and the thread
- * will end when 'func' returns. 'arg' is passed as an argument to
- * 'func'. Returns 0 on success or a negative value on error.
+/* Create a child process running in a copy of the address space of
+ * the caller. The pages are shared copy-on-write, so changes made by
+ * either process are not seen by the other. The child is started at
+ * function 'func' on a copy of the caller's stack, and exits when
+ * 'func' returns. 'arg' is passed as an argument to 'func'. Returns
+ * the PID of the child (which can be joined) or a negative value on
+ * error.
  */
 int syscall_fork(void (*func)(int), int arg)
 {
@@ -116,6 +133,132 @@ int syscall_fork(void (*func)(int), int arg)
 }
 
 
+/* Threads start here, so that returning from the thread function ends
+ * the thread with its return value.
+ */
+static void thread_start(int (*func)(int), int arg)
+{
+    syscall_thread_exit(func(arg));
+}
+
+
+/* Start a new thread in the address space of the calling process. The
+ * thread runs function 'func' on its own stack with 'arg' as its
+ * argument, and ends when 'func' returns or calls syscall_thread_exit.
+ * Returns the id of the thread (which can be joined) or a negative
+ * value on error.
+ */
+int syscall_thread_create(int (*func)(int), int arg)
+{
+    return (int)_syscall(SYSCALL_THREAD_CREATE, (uint32_t)thread_start,
+                         (uint32_t)func, (uint32_t)arg);
+}
+
+
+/* Wait until the thread 'thread' of this process ends and return its
+ * return value. Returns a negative value if there is no such thread
+ * or it is the calling thread.
+ */
+int syscall_thread_join(int thread)
+{
+    return (int)_syscall(SYSCALL_THREAD_JOIN, (uint32_t)thread, 0, 0);
+}
+
+
+/* End the calling thread with the return value 'retval'. If it is the
+ * last thread of the process, the process exits with 'retval'. To end
+ * the whole process at once, use syscall_exit.
+ */
+void syscall_thread_exit(int retval)
+{
+    _syscall(SYSCALL_THREAD_EXIT, (uint32_t)retval, 0, 0);
+}
+
+
+/* Copy the system call statistics of this process, or of all
+ * processes if 'global' is non-zero, to 'stats', which must have room
+ * for SYSCALL_STATS_SLOTS entries. Use SYSCALL_STATS_SLOT to find the
+ * entry of a system call. The call itself is counted after the copy.
+ * Returns 0 on success or a negative value on error.
+ */
+int syscall_stats(syscall_stats_t *stats, int global)
+{
+    return (int)_syscall(SYSCALL_STATS, (uint32_t)stats, (uint32_t)global, 0);
+}
+
+
+/* Start sampling the program counter of the process on every timer
+ * interrupt. Addresses from 'base' on are counted in buckets of
+ * 2^'shift' bytes. Returns 0 on success or a negative value on error.
+ */
+int syscall_profile_start(void *base, int shift)
+{
+    return (int)_syscall(SYSCALL_PROFILE_START, (uint32_t)base,
+                         (uint32_t)shift, 0);
+}
+
+
+/* Stop profiling and copy the histogram to 'profile' unless it is
+ * NULL. Returns the number of samples taken, or a negative value if
+ * the process was not being profiled.
+ */
+int syscall_profile_stop(syscall_profile_t *profile)
+{
+    return (int)_syscall(SYSCALL_PROFILE_STOP, (uint32_t)profile, 0, 0);
+}
+
+
+/* Format one line of a profile file to 'line', the header if 'bucket'
+ * is negative. Returns the length of the line.
+ */
+static int profile_line(char *line, const syscall_profile_t *profile,
+                        int bucket)
+{
+    if (bucket < 0)
+        return snprintf(line, 80, "# base 0x%.8x shift %d samples %d missed %d\n",
+                        profile->base, profile->shift, profile->samples,
+                        profile->missed);
+    return snprintf(line, 80, "0x%.8x %d\n",
+                    profile->base + (bucket << profile->shift),
+                    profile->buckets[bucket]);
+}
+
+
+/* Write 'profile' to a new file 'filename' as text: a header line and
+ * the start address and sample count of every non-empty bucket, one
+ * per line. util/pcprof turns it into samples per function. Returns
+ * the size of the file or a negative value on error.
+ */
+int profile_write(const char *filename, const syscall_profile_t *profile)
+{
+    char line[80];
+    char *text;
+    int i, size = 0, filehandle, ret;
+
+    /* files have a fixed size, so it is counted first */
+    for (i = -1; i < SYSCALL_PROFILE_BUCKETS; i++)
+        if (i < 0 || profile->buckets[i] != 0)
+            size += profile_line(line, profile, i);
+
+    text = malloc(size + 1);
+    if (text == NULL)
+        return -1;
+    size = 0;
+    for (i = -1; i < SYSCALL_PROFILE_BUCKETS; i++)
+        if (i < 0 || profile->buckets[i] != 0)
+            size += profile_line(text + size, profile, i);
+
+    ret = -1;
+    if (syscall_create(filename, size) >= 0 &&
+        (filehandle = syscall_open(filename)) >= 0) {
+        ret = syscall_write(filehandle, text, size);
+        syscall_close(filehandle);
+    }
+    free(text);
+    return ret;
+}
+
+
 /* (De)allocate memory by trying to set the heap to end at the address
  * 'heap_end'. Returns the new end address of the heap, or NULL on
  * error. If 'heap_end' is NULL, the current heap end is returned.
@@ -194,3 +337,171 @@ int syscall_delete(const char *filename)
 {
     return (int)_syscall(SYSCALL_DELETE, (uint32_t)filename, 0, 0);
 }
+
+
+/* Map 'length' bytes of the open file 'filehandle' starting from
+ * 'offset' (a multiple of 4096) into memory. The pages are read from
+ * the file when they are first accessed, and the pages written are
+ * written back to the file by syscall_munmap or when the process
+ * exits. Returns the address of the mapping, or NULL on error.
+ */
+void *syscall_mmap(int filehandle, int offset, int length)
+{
+    return (void*)_syscall(SYSCALL_MMAP, (uint32_t)filehandle,
+                           (uint32_t)offset, (uint32_t)length);
+}
+
+
+/* Remove the mapping at 'addr' returned by syscall_mmap, writing the
+ * written pages back to the file. Returns 0 on success or a negative
+ * value on error, also when written pages could not be saved (the
+ * mapping is removed anyway).
+ */
+int syscall_munmap(void *addr)
+{
+    return (int)_syscall(SYSCALL_MUNMAP, (uint32_t)addr, 0, 0);
+}
+
+
+/* Register 'ring' as the submission and completion rings of the
+ * process, or unregister the rings if 'ring' is NULL. The ring must be
+ * zeroed before it is registered. Returns 0 on success or a negative
+ * value on error.
+ */
+int syscall_ring_setup(syscall_ring_t *ring)
+{
+    return (int)_syscall(SYSCALL_RING_SETUP, (uint32_t)ring, 0, 0);
+}
+
+
+/* Run the requests added to the registered submission ring, as long
+ * as there is room for their completions. Returns the number of
+ * requests run or a negative value on error.
+ */
+int syscall_submit(void)
+{
+    return (int)_syscall(SYSCALL_SUBMIT, 0, 0, 0);
+}
+
+
+/* Add a request to the submission ring. 'opcode' is the number of the
+ * system call (SYSCALL_OPEN, SYSCALL_READ etc.) and 'a1'-'a3' its
+ * arguments. 'user_data' is returned with the completion. Returns 0,
+ * or -1 if the ring is full and must be submitted first.
+ */
+int ring_request(syscall_ring_t *ring, uint32_t opcode, uint32_t a1,
+                 uint32_t a2, uint32_t a3, uint32_t user_data)
+{
+    syscall_sqe_t *sqe;
+
+    if (ring->sq_tail - ring->sq_head >= SYSCALL_RING_ENTRIES) return -1;
+    sqe = &ring->sq[ring->sq_tail % SYSCALL_RING_ENTRIES];
+    sqe->opcode = opcode;
+    sqe->arg1 = a1;
+    sqe->arg2 = a2;
+    sqe->arg3 = a3;
+    sqe->user_data = user_data;
+    ring->sq_tail++;
+    return 0;
+}
+
+
+/* Take the oldest completion from the completion ring into 'cqe'.
+ * Returns 0, or -1 if there are no completions.
+ */
+int ring_complete(syscall_ring_t *ring, syscall_cqe_t *cqe)
+{
+    if (ring->cq_head == ring->cq_tail) return -1;
+    *cqe = ring->cq[ring->cq_head % SYSCALL_RING_ENTRIES];
+    ring->cq_head++;
+    return 0;
+}
+
+
+/* Start reading 'length' bytes from position 'offset' of the open file
+ * 'filehandle' to 'buffer', without waiting for the read. At most 128k
+ * is read at once. Returns a token for the read, to be matched with
+ * syscall_await, or a negative value on error. The buffer must not be
+ * used before the read is done.
+ */
+int syscall_aread(int filehandle, void *buffer, int length, int offset)
+{
+    syscall_aio_t request;
+    request.filehandle = filehandle;
+    request.buffer = buffer;
+    request.length = length;
+    request.offset = offset;
+    return (int)_syscall(SYSCALL_AREAD, (uint32_t)&request, 0, 0);
+}
+
+
+/* Start writing like syscall_aread reads. */
+int syscall_awrite(int filehandle, const void *buffer, int length,
+                   int offset)
+{
+    syscall_aio_t request;
+    request.filehandle = filehandle;
+    request.buffer = (void *)buffer;
+    request.length = length;
+    request.offset = offset;
+    return (int)_syscall(SYSCALL_AWRITE, (uint32_t)&request, 0, 0);
+}
+
+
+/* Wait until any read or write started by the process is done. The
+ * number of bytes transferred (or a negative value on error) is stored
+ * to 'result'. Returns the token of the read or write, or a negative
+ * value if there are none in progress.
+ */
+int syscall_await(int *result)
+{
+    return (int)_syscall(SYSCALL_AWAIT, (uint32_t)result, 0, 0);
+}
+
+
+/* Create a pipe. The handle of the read end is stored to handles[0]
+ * and that of the write end to handles[1]. Reads wait for data and
+ * return 0 when the pipe is empty and every write end is closed.
+ * Returns 0 on success or a negative value on error.
+ */
+int syscall_pipe(int *handles)
+{
+    return (int)_syscall(SYSCALL_PIPE, (uint32_t)handles, 0, 0);
+}
+
+
+/* Redirect 'std' (stdin or stdout) of the process to the open file or
+ * pipe 'filehandle', or back to the console if 'filehandle' is 'std'.
+ * Processes started afterwards get the same stdin and stdout. Returns
+ * 0 on success or a negative value on error.
+ */
+int syscall_redirect(int std, int filehandle)
+{
+    return (int)_syscall(SYSCALL_REDIRECT, (uint32_t)std,
+                         (uint32_t)filehandle, 0);
+}
+
+
+/* Return the time in milliseconds, as of the last timer interrupt.
+ * Read from the kernel data page without a system call.
+ */
+uint32_t kdata_msec(void)
+{
+    return ((volatile syscall_kdata_t *)SYSCALL_KDATA_ADDR)->msec;
+}
+
+
+/* Return the number of CPUs, read from the kernel data page. */
+int kdata_cpus(void)
+{
+    return (int)((syscall_kdata_t *)SYSCALL_KDATA_ADDR)->cpus;
+}
+
+
+/* Return the PID of the calling process, read from the kernel data
+ * page of the process without a system call.
+ */
+int kdata_pid(void)
+{
+    return ((syscall_kdata_process_t *)(SYSCALL_KDATA_ADDR + 4096))->pid;
+}
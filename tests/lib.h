@@ -38,6 +38,7 @@
 #define BUENOS_USERLAND_LIB_H
 
 #include "lib/types.h"
+#include "proc/syscall.h"
 
 /* NULL pointer for userland programs */
 #define NULL ((void *)0)
@@ -55,6 +56,10 @@ uint32_t _syscall(uint32_t syscall_num, uint32_t a1, uint32_t a2, uint32_t a3);
 /* standard std out printing with 128 mark buffer */
 void cout(const char* text, ...);
 
+/* one check of a test, prints OK. or FAIL! and counts the failures */
+extern int ok_failures;
+void ok(int b);
+
 void syscall_halt(void);
 
 int syscall_exec(const char *filename);
@@ -71,7 +76,31 @@ int syscall_create(const char *filename, int size);
 int syscall_delete(const char *filename);
 
 int syscall_fork(void (*func)(int), int arg);
+int syscall_thread_create(int (*func)(int), int arg);
+int syscall_thread_join(int thread);
+void syscall_thread_exit(int retval);
+int syscall_stats(syscall_stats_t *stats, int global);
+int syscall_profile_start(void *base, int shift);
+int syscall_profile_stop(syscall_profile_t *profile);
+int profile_write(const char *filename, const syscall_profile_t *profile);
 void *syscall_memlimit(void *heap_end);
+void *syscall_mmap(int filehandle, int offset, int length);
+int syscall_munmap(void *addr);
+int syscall_ring_setup(syscall_ring_t *ring);
+int syscall_submit(void);
+int ring_request(syscall_ring_t *ring, uint32_t opcode, uint32_t a1,
+                 uint32_t a2, uint32_t a3, uint32_t user_data);
+int ring_complete(syscall_ring_t *ring, syscall_cqe_t *cqe);
+int syscall_aread(int filehandle, void *buffer, int length, int offset);
+int syscall_awrite(int filehandle, const void *buffer, int length,
+                   int offset);
+int syscall_await(int *result);
+int syscall_pipe(int *handles);
+int syscall_redirect(int std, int filehandle);
+
+uint32_t kdata_msec(void);
+int kdata_cpus(void);
+int kdata_pid(void);
 
 void *malloc(int size);
 void free(void *ptr);
@@ -1,201 +1,278 @@
 /*
  * malloc and free implementations
+ *
+ * Segregated fit: small blocks are kept in free lists by size class
+ * and reused as they are, without splitting or merging. Larger blocks
+ * are kept in one list of free blocks, which are split on allocation
+ * and merged with their free neighbours when freed. New blocks are cut
+ * from the top of the heap, which grows and shrinks in chunks of
+ * several pages to keep the number of memlimit calls low.
  */
 
 #include "tests/lib.h"
 
-/* memory alignment = 4 bytes */
-#define ALIGNMENT 4
+/* memory alignment = 8 bytes, also the granularity of block sizes */
+#define ALIGNMENT 8
 
-/* each memory segment allocated by malloc has a header
- * - last header has next NULL
+/* every block starts with a header. The size includes the header,
+ * the low bits of it are flags. prev_size is the size of the block
+ * just before this one in memory, 0 for the first block.
  */
-typedef struct segment_header_s {
-    struct segment_header_s *next; 
-    struct segment_header_s *prev; 
-    int32_t size;
-    uint32_t free;
-} segment_header_t;
-
-/* make header width multiple of 4 */
-#define HDR_SIZE (sizeof(segment_header_t))
-#define HEADER_ALIGN (ALIGNMENT - (HDR_SIZE % ALIGNMENT))
-#define SEG_HEADER_SIZE (HDR_SIZE + HEADER_ALIGN)
+typedef struct block_header_s {
+    uint32_t prev_size;
+    uint32_t size;
+} block_header_t;
+
+#define HDR_SIZE (sizeof(block_header_t))
+
+/* block is in use, or is a small block (which are never merged) */
+#define BLOCK_INUSE 0x1
+/* block is a small block of a size class */
+#define BLOCK_SMALL 0x2
+#define BLOCK_FLAGS 0x7
+
+#define BLOCK_SIZE(b) ((b)->size & ~BLOCK_FLAGS)
+#define NEXT_BLOCK(b) ((block_header_t *)((char *)(b) + BLOCK_SIZE(b)))
+#define PREV_BLOCK(b) ((block_header_t *)((char *)(b) - (b)->prev_size))
+
+/* free large blocks are in a doubly linked list kept in their data */
+typedef struct free_block_s {
+    block_header_t header;
+    struct free_block_s *next;
+    struct free_block_s *prev;
+} free_block_t;
+
+/* smallest large block worth splitting off */
+#define MIN_LARGE_BLOCK (sizeof(free_block_t) + ALIGNMENT)
+
+/* block sizes of the size classes, with the header. Larger blocks
+ * are large blocks.
+ */
+static const uint32_t class_sizes[] = {
+    16, 24, 32, 48, 64, 96, 128, 192, 256, 384, 512, 768, 1024, 1536, 2048
+};
+#define NUM_CLASSES ((int)(sizeof(class_sizes) / sizeof(class_sizes[0])))
+#define SMALL_MAX 2048
+
+/* the heap grows at least this much at a time and is shrunk when
+ * twice this much is free at the top
+ */
+#define HEAP_CHUNK (16 * 4096)
 
 /* heap information for malloc */
 static struct {
-    struct segment_header_s *start;
+    /* free small blocks by class, linked through their data */
+    void *classes[NUM_CLASSES];
+    /* free large blocks */
+    free_block_t *large;
+    /* the free block at the top of the heap, up to end */
+    block_header_t *top;
+    /* end of the heap as returned by memlimit */
+    char *end;
 } heap;
 
-static void
+static int
 init_malloc(void) {
     /* static int is used to run this function only once */
     static int done = 0;
-    if (done) return;
-    heap.start = syscall_memlimit(NULL);
-    /* check memory alignment and allocate memory
-     * for the members of heap.start
-     */
-    if ((uint32_t)heap.start % ALIGNMENT) {
-        /* alignment */
-        heap.start = syscall_memlimit((char *)heap.start
-                                        + (ALIGNMENT - ((uint32_t)heap.start % ALIGNMENT)));
-    }
-    /* memory */
-    syscall_memlimit((char *)heap.start + SEG_HEADER_SIZE);
+    char *start, *end;
+    if (done) return 0;
 
-    heap.start->next = NULL;
-    heap.start->prev = NULL;
-    heap.start->size = 0;
-    heap.start->free = 1;
+    start = syscall_memlimit(NULL);
+    if (start == NULL) return -1;
+    /* alignment */
+    if ((uint32_t)start % ALIGNMENT)
+        start += ALIGNMENT - ((uint32_t)start % ALIGNMENT);
+    end = syscall_memlimit(start + HEAP_CHUNK);
+    if (end == NULL) return -1;
+
+    heap.top = (block_header_t *)start;
+    heap.top->prev_size = 0;
+    heap.top->size = end - start;
+    heap.end = end;
 
     done = 1;
-    return;
+    return 0;
 }
 
-/* adjust size to be aligned in memory
- * returns negative value if size is bad
- */
-int
-adjust_size(int *size) {
-    if (*size <= 0) return -1;
-    /* if size is not divisible by four,
+/* returns the block size for a request, 0 if size is bad */
+static uint32_t
+block_size(int size) {
+    if (size <= 0 || size > 0x7fff0000) return 0;
+    size += HDR_SIZE;
+    /* if size is not divisible by the alignment,
      * add the remainder
      */
-    if (*size % ALIGNMENT) *size += ALIGNMENT - (*size % ALIGNMENT);
-    return 0;
+    if (size % ALIGNMENT) size += ALIGNMENT - (size % ALIGNMENT);
+    return size;
 }
 
-/* returns free segment of size size for allocation
- * the segment must be divided after this function
- * here only the linked list updated
- */
-static segment_header_t *
-next_free(segment_header_t *start, int size) {
-    void *heap_end, *new_heap_end;
-    segment_header_t *seg, *last_seg;
-    /* find next free and large enough segment
-     * - if not found return the last segment
-     */
-    seg = start;
-    while (seg->next) {
-        if ((seg->free) && (seg->size >= size))
-            break;
-        seg = seg->next;
-    }
-    if (!seg->free || seg->size < size) {
-        /* seg is the last one and too small or in use!
-         * get more heap
-         */
-        heap_end = syscall_memlimit(NULL);
-        new_heap_end = syscall_memlimit((char *)heap_end + 1 + size + SEG_HEADER_SIZE);
-        /* +1 since heap_end is addressible */
-        if (!new_heap_end)
-            return NULL;
-        /* update the last header:
-         * we consider the start of the new segment as a pointer
-         * to the header structure
-         */
-        /* +1 since the address heap_end is used by the previously
-         * last last_segment
-         */
-        last_seg = (segment_header_t *)((char *)heap_end+1);
-        seg->next = last_seg;
-        /* FIXME: the following line fails */
-        last_seg->prev = seg;
-        last_seg->next = NULL;
-        seg = last_seg;
-    }
-    return seg;
+/* returns the size class of a small block size */
+static int
+size_class(uint32_t size) {
+    int i = 0;
+    while (class_sizes[i] < size) i++;
+    return i;
 }
 
 static void
-divide_segment(segment_header_t *seg, int size) {
-    segment_header_t *between;
-    if (seg->next) {
-        /* create a new seg after size bytes */
-        between = (segment_header_t *)((char *)seg + size + SEG_HEADER_SIZE);
-        between->next = seg->next;
-        between->prev = seg;
-        between->size = seg->size - size - SEG_HEADER_SIZE;
-
-        seg->next->prev = between;
-        seg->next = between;
-        seg->size = size;
-    } else {
-        /* last seg just needs size update */
-        seg->size = size;
-    }
-    return;
+unlink_large(free_block_t *block) {
+    if (block->prev) block->prev->next = block->next;
+    else heap.large = block->next;
+    if (block->next) block->next->prev = block->prev;
 }
 
-static void *
-data_vaddr(segment_header_t *header) {
-    return (void *)((char *)header + SEG_HEADER_SIZE);
+static void
+link_large(free_block_t *block) {
+    block->prev = NULL;
+    block->next = heap.large;
+    if (heap.large) heap.large->prev = block;
+    heap.large = block;
 }
 
-static segment_header_t *
-find_header(void *segment_start) {
-    return (void *)((char *)segment_start - SEG_HEADER_SIZE);
+/* makes the top block at least size bytes larger than needed
+ * for a block of given size
+ */
+static int
+grow_heap(uint32_t size) {
+    uint32_t grow;
+    char *end;
+    /* the top block keeps its header */
+    if (BLOCK_SIZE(heap.top) >= size + HDR_SIZE) return 0;
+    grow = size + HDR_SIZE - BLOCK_SIZE(heap.top);
+    end = syscall_memlimit(heap.end + (grow < HEAP_CHUNK ? HEAP_CHUNK : grow));
+    if (end == NULL) {
+        /* try with just what is needed */
+        end = syscall_memlimit(heap.end + grow);
+        if (end == NULL) return -1;
+    }
+    heap.top->size += end - heap.end;
+    heap.end = end;
+    return 0;
 }
 
-/* merges free adjacent segments to the freed segment */
+/* gives memory at the top back to the system when there is a lot of it */
 static void
-merge_around(segment_header_t *between) {
-    segment_header_t *next = between->next;
-    segment_header_t *prev = between->prev;
-    /* merge previous */
-    if (prev && prev->free) {
-        next->prev = prev;
-        prev->next = next;
-        /* add length of the between segment to size of previous segment */
-        prev->size += between->size + SEG_HEADER_SIZE;
-        /* there is no between segment anymore
-         * --> let between be now previous segment to make next if clause work
-         */
-        between = prev;
-    }
-    /* merge next */
-    if (next && next->free) {
-        /* add length of the next segment to size of
-         * between (or previous if above code was executed) segment
-         */
-        between->size += next->size + SEG_HEADER_SIZE;
-        /* and update the linked list */
-        between->next = next->next;
-        next->next->prev = between;
-    }
+shrink_heap(void) {
+    char *end;
+    if (BLOCK_SIZE(heap.top) < 2 * HEAP_CHUNK) return;
+    end = syscall_memlimit((char *)heap.top + HEAP_CHUNK);
+    if (end == NULL) return;
+    heap.top->size = end - (char *)heap.top;
+    heap.end = end;
 }
 
-static int
-last_free(segment_header_t *freed_header) {
-    while (freed_header->next) {
-        freed_header = freed_header->next;
-        if (!freed_header->free)
-            return 0;
+/* cuts a block of given size from the top of the heap */
+static block_header_t *
+cut_from_top(uint32_t size) {
+    block_header_t *block;
+    if (grow_heap(size) < 0) return NULL;
+    block = heap.top;
+    heap.top = (block_header_t *)((char *)block + size);
+    heap.top->prev_size = size;
+    heap.top->size = BLOCK_SIZE(block) - size;
+    block->size = size;
+    return block;
+}
+
+/* finds the best fitting free large block */
+static block_header_t *
+find_large(uint32_t size) {
+    free_block_t *block, *best = NULL;
+    block_header_t *rest;
+    uint32_t left;
+
+    for (block = heap.large; block; block = block->next) {
+        if (BLOCK_SIZE(&block->header) >= size &&
+            (!best || BLOCK_SIZE(&block->header) < BLOCK_SIZE(&best->header))) {
+            best = block;
+            if (BLOCK_SIZE(&best->header) == size) break;
+        }
     }
-    return 1;
+    if (!best) return NULL;
+    unlink_large(best);
+
+    /* split off the rest if it is large enough to be useful */
+    left = BLOCK_SIZE(&best->header) - size;
+    if (left >= MIN_LARGE_BLOCK) {
+        best->header.size = size;
+        rest = NEXT_BLOCK(&best->header);
+        rest->prev_size = size;
+        rest->size = left;
+        NEXT_BLOCK(rest)->prev_size = left;
+        link_large((free_block_t *)rest);
+    }
+    return &best->header;
 }
 
 void *
 malloc(int size) {
-    segment_header_t *seg;
-    init_malloc();
-    if (adjust_size(&size) < 0) return NULL;
-    seg = next_free(heap.start, size);
-    if (!seg) return NULL;
-    /* we found proper slot */
-    seg->free = 0;
-    divide_segment(seg, size);
-    return data_vaddr(seg);
+    block_header_t *block;
+    uint32_t bsize;
+    int class;
+
+    if (init_malloc() < 0) return NULL;
+    bsize = block_size(size);
+    if (bsize == 0) return NULL;
+
+    if (bsize <= SMALL_MAX) {
+        class = size_class(bsize);
+        if (heap.classes[class]) {
+            block = (block_header_t *)((char *)heap.classes[class] - HDR_SIZE);
+            heap.classes[class] = *(void **)heap.classes[class];
+            return (char *)block + HDR_SIZE;
+        }
+        block = cut_from_top(class_sizes[class]);
+        if (!block) return NULL;
+        block->size |= BLOCK_SMALL | BLOCK_INUSE;
+        return (char *)block + HDR_SIZE;
+    }
+
+    block = find_large(bsize);
+    if (!block) block = cut_from_top(bsize);
+    if (!block) return NULL;
+    block->size |= BLOCK_INUSE;
+    return (char *)block + HDR_SIZE;
 }
 
 void
 free(void *ptr) {
+    block_header_t *block, *next, *prev;
     if (!ptr) return;
-    segment_header_t *header = find_header(ptr);
-    header->free = 1;
-    merge_around(header);
-    if (last_free(header))
-        syscall_memlimit(header);
+    block = (block_header_t *)((char *)ptr - HDR_SIZE);
+
+    if (block->size & BLOCK_SMALL) {
+        /* stays in use for merging, just goes to the class list */
+        *(void **)ptr = heap.classes[size_class(BLOCK_SIZE(block))];
+        heap.classes[size_class(BLOCK_SIZE(block))] = ptr;
+        return;
+    }
+
+    block->size &= ~BLOCK_INUSE;
+    /* merge next */
+    next = NEXT_BLOCK(block);
+    if (next != heap.top && !(next->size & BLOCK_INUSE)) {
+        unlink_large((free_block_t *)next);
+        block->size += BLOCK_SIZE(next);
+    }
+    /* merge previous */
+    if (block->prev_size) {
+        prev = PREV_BLOCK(block);
+        if (!(prev->size & BLOCK_INUSE)) {
+            unlink_large((free_block_t *)prev);
+            prev->size += BLOCK_SIZE(block);
+            block = prev;
+        }
+    }
+
+    next = NEXT_BLOCK(block);
+    if (next == heap.top) {
+        /* becomes part of the top */
+        block->size += BLOCK_SIZE(heap.top);
+        heap.top = block;
+        shrink_heap();
+        return;
+    }
+    next->prev_size = BLOCK_SIZE(block);
+    link_large((free_block_t *)block);
 }
@@ -1,12 +1,15 @@
 #include "tests/lib.h"
 #include "tests/str.h"
 
+#define MAX_SUITES 32
+
 static int test_num;
-static char tests[10][8][20];
-static int cases[10];
+static char tests[MAX_SUITES][8][20];
+static int cases[MAX_SUITES];
 
 static int create_test_suite(const char* executable);
 static void add_test_case(int suite, const char* arg);
+static void add_test(const char* executable);
 static void run_suites();
 
 
@@ -49,6 +52,22 @@ int main() {
     add_test_case(testsuite, "test_create");
     add_test_case(testsuite, "test_delete");
     add_test_case(testsuite, "test_complex");
+    add_test_case(testsuite, "test_large");
+
+    // tests taking no arguments, they return non-zero on failure
+    add_test("test_fork");
+    add_test("test_swap");
+    add_test("test_mmap");
+    add_test("test_stack");
+    add_test("test_big");
+    add_test("test_threads");
+    add_test("test_ring");
+    add_test("test_aio");
+    add_test("test_kdata");
+    add_test("test_stats");
+    add_test("test_prof");
+    add_test("test_pipe");
+    add_test("test_churn");
 
     run_suites();
     // all tests executed
@@ -72,6 +91,11 @@ static void add_test_case(int suite, const char* arg) {
     stringcopy(tests[suite][cases[suite]], arg, 30);
 }
 
+/* A suite of one case, the name of the executable as its argument */
+static void add_test(const char* executable) {
+    add_test_case(create_test_suite(executable), executable);
+}
+
 static void run_suites() {
     int i, j, retval;
     char filename[30];
@@ -297,13 +297,104 @@ shell_stop(shell_cmd *cmd, shell_status *status) {
         return 1;
 }
 
+/* pipeline_length: return the number of commands separated by "|",
+ * 0 if a "|" is at either end or next to another one
+ */
+int
+shell_pipeline_length(int argc, char **argv) {
+    int i, commands = 1;
+    if (argc == 0 || stringcmp("|", argv[0]) == 0 ||
+        stringcmp("|", argv[argc-1]) == 0)
+        return 0;
+    for (i = 1; i < argc; i++) {
+        if (stringcmp("|", argv[i]) == 0) {
+            if (stringcmp("|", argv[i-1]) == 0)
+                return 0;
+            commands++;
+        }
+    }
+    return commands;
+}
+
+/* start_pipeline: start the commands separated by "|", each with its
+ * stdin connected to the stdout of the one before it by a pipe.
+ * Stores the pids to pids and returns the number of commands started,
+ * which is less than all if one of them could not be started.
+ */
+int
+shell_start_pipeline(int argc, char **argv, int *pids) {
+    char filename[SHELL_MAXEXECSZ];
+    int start, end, pid, n = 0;
+    int fd[2], input = stdin, output;
+
+    for (start = 0; start < argc; start = end + 1) {
+        end = start;
+        while (end < argc && stringcmp("|", argv[end]) != 0)
+            end++;
+        if (strlen(argv[start]) + strlen(SHELL_DISK) >= SHELL_MAXEXECSZ)
+            break;
+        snprintf(filename, SHELL_MAXEXECSZ, "%s%s", SHELL_DISK, argv[start]);
+
+        output = stdout;
+        if (end < argc) {
+            if (syscall_pipe(fd) < 0)
+                break;
+            output = fd[1];
+        }
+        /* the new process gets the stdin and stdout of the shell */
+        syscall_redirect(stdin, input);
+        syscall_redirect(stdout, output);
+        pid = syscall_execp(filename, end - start - 1,
+                            (const char**)(argv + start + 1));
+        syscall_redirect(stdin, stdin);
+        syscall_redirect(stdout, stdout);
+
+        /* only the processes keep the pipes open */
+        if (input != stdin)
+            syscall_close(input);
+        if (output != stdout)
+            syscall_close(output);
+        input = end < argc ? fd[0] : stdin;
+        if (pid < 0)
+            break;
+        pids[n++] = pid;
+    }
+    if (input != stdin)
+        syscall_close(input);
+    return n;
+}
+
+/* execute_pipeline: start a pipeline and join all of its processes
+ */
+void
+shell_execute_pipeline(shell_cmd *cmd, shell_status *status) {
+    int pids[SHELL_MAXARGS];
+    int commands, started, i, retval = 0;
+
+    commands = shell_pipeline_length(cmd->argc, cmd->argv);
+    if (commands == 0) {
+        status->error = SYNTAXFAIL;
+        return;
+    }
+    started = shell_start_pipeline(cmd->argc, cmd->argv, pids);
+    for (i = 0; i < started; i++)
+        retval = syscall_join(pids[i]);
+    if (started < commands) {
+        status->error = EXECPFAIL;
+        return;
+    }
+    cout("\nDone, got: %d\n", retval);
+}
+
 /* execute: call execp and join process
  */
 void
 shell_execute(shell_cmd *cmd, shell_status *status) {
     char filename[SHELL_MAXEXECSZ];
     int pid, retval;
-    if (status->foreground) {
+    if (status->foreground && shell_pipeline_length(cmd->argc, cmd->argv) != 1) {
+        shell_execute_pipeline(cmd, status);
+    } else if (status->foreground) {
         if (strlen(cmd->argv[0]) + strlen(SHELL_DISK) >= SHELL_MAXEXECSZ) {
             status->error = MAXEXECSZFAIL;
             return;
@@ -389,6 +480,16 @@ int shell_request_clear(shell_cmd* cmd, shell_status* status) {
 
 int shell_start_background_proc(int argc, char** argv) {
     char filename[SHELL_MAXEXECSZ];
+    int pids[SHELL_MAXARGS];
+    int commands;
+    /* a pipeline returns the pid of its last process */
+    commands = shell_pipeline_length(argc - 1, argv + 1);
+    if (commands != 1) {
+        if (commands == 0 ||
+            shell_start_pipeline(argc - 1, argv + 1, pids) < commands)
+            return -1;
+        return pids[commands - 1];
+    }
     if (strlen(argv[1]) + strlen(SHELL_DISK) >= SHELL_MAXEXECSZ) {
         return -1;
     }
@@ -0,0 +1,84 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+#define FILENAME "[disk1]aio.dat"
+#define CHUNK 4096
+#define CHUNKS 4
+
+static char data[CHUNKS * CHUNK];
+static char buffer[CHUNKS * CHUNK];
+
+/* Waits for count requests, whose tokens are in tokens, and checks
+   that each is waited for once and transferred CHUNK bytes. */
+static int
+wait_all(int *tokens, int count) {
+    int done[CHUNKS];
+    int i, token, result, good = 1;
+
+    for (i = 0; i < count; i++) {
+        done[i] = 0;
+    }
+    while ((token = syscall_await(&result)) >= 0) {
+        for (i = 0; i < count && tokens[i] != token; i++) ;
+        if (i == count || done[i] || result != CHUNK) good = 0;
+        else done[i] = 1;
+    }
+    for (i = 0; i < count; i++) {
+        good = good && done[i];
+    }
+    return good;
+}
+
+int
+main(void) {
+    int tokens[CHUNKS];
+    int fd, i, good;
+
+    cout("Running asynchronous I/O tests: \n");
+
+    syscall_delete(FILENAME);
+    syscall_create(FILENAME, sizeof(data));
+    fd = syscall_open(FILENAME);
+
+    cout("-> Nothing to wait for: ");
+    ok(syscall_await(&i) < 0);
+
+    cout("-> Bad file handle is rejected: ");
+    ok(syscall_aread(fd + 100, buffer, CHUNK, 0) < 0 &&
+       syscall_aread(stdout, buffer, CHUNK, 0) < 0);
+
+    cout("-> Writes in flight together, in reverse order: ");
+    for (i = 0; i < CHUNKS * CHUNK; i++) {
+        data[i] = (char)(i * 5 + i / CHUNK);
+    }
+    good = fd >= 0;
+    for (i = CHUNKS - 1; i >= 0; i--) {
+        tokens[i] = syscall_awrite(fd, data + i * CHUNK, CHUNK, i * CHUNK);
+        good = good && tokens[i] >= 0;
+    }
+    ok(good && wait_all(tokens, CHUNKS));
+
+    cout("-> Reads in flight together: ");
+    good = 1;
+    for (i = 0; i < CHUNKS; i++) {
+        tokens[i] = syscall_aread(fd, buffer + i * CHUNK, CHUNK, i * CHUNK);
+        good = good && tokens[i] >= 0;
+    }
+    good = good && wait_all(tokens, CHUNKS);
+    for (i = 0; good && i < CHUNKS * CHUNK; i++) {
+        good = buffer[i] == data[i];
+    }
+    ok(good);
+
+    cout("-> Read past the end of file is short: ");
+    tokens[0] = syscall_aread(fd, buffer, 2 * CHUNK, (CHUNKS - 1) * CHUNK);
+    ok(tokens[0] >= 0 && syscall_await(&i) == tokens[0] && i == CHUNK);
+
+    cout("-> Seek position is not used or changed: ");
+    ok(syscall_read(fd, buffer, 1) == 1 && buffer[0] == data[0]);
+
+    /* left in flight, the exit waits for it */
+    syscall_aread(fd, buffer, sizeof(buffer), 0);
+    syscall_close(fd);
+    return ok_failures != 0;
+}
@@ -0,0 +1,61 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+/* A program much larger than the TLB: 32k of read-only data, 8k of
+   initialized data and 512k of bss, together about 140 pages. The
+   files of TFS are at most 63.5k, so most of the size is in the bss. */
+
+#define T4(n) (n), (n) + 1, (n) + 2, (n) + 3
+#define T16(n) T4(n), T4((n) + 4), T4((n) + 8), T4((n) + 12)
+#define T64(n) T16(n), T16((n) + 16), T16((n) + 32), T16((n) + 48)
+#define T256(n) T64(n), T64((n) + 64), T64((n) + 128), T64((n) + 192)
+#define T1024(n) T256(n), T256((n) + 256), T256((n) + 512), T256((n) + 768)
+#define T2048(n) T1024(n), T1024((n) + 1024)
+#define T8192(n) T2048(n), T2048((n) + 2048), T2048((n) + 4096), \
+                 T2048((n) + 6144)
+
+#define RO_WORDS 8192
+#define RW_WORDS 2048
+#define BSS_WORDS (128 * 1024)
+
+static const uint32_t ro_table[RO_WORDS] = { T8192(0) };
+static uint32_t rw_table[RW_WORDS] = { T2048(7) };
+static uint32_t bss_table[BSS_WORDS];
+
+int
+main(void) {
+    int i, good;
+
+    cout("Running large program tests: \n");
+
+    cout("-> Read-only data: ");
+    good = 1;
+    for (i = 0; i < RO_WORDS; i++) {
+        good = good && ro_table[i] == (uint32_t)i;
+    }
+    ok(good);
+
+    cout("-> Initialized data: ");
+    good = 1;
+    for (i = 0; i < RW_WORDS; i++) {
+        good = good && rw_table[i] == (uint32_t)i + 7;
+        rw_table[i] *= 3;
+    }
+    for (i = 0; i < RW_WORDS; i++) {
+        good = good && rw_table[i] == 3 * ((uint32_t)i + 7);
+    }
+    ok(good);
+
+    cout("-> Bss starts zeroed and keeps data: ");
+    good = 1;
+    for (i = 0; i < BSS_WORDS; i++) {
+        good = good && bss_table[i] == 0;
+        bss_table[i] = ro_table[i % RO_WORDS] ^ (uint32_t)i;
+    }
+    for (i = 0; i < BSS_WORDS; i++) {
+        good = good && bss_table[i] == (ro_table[i % RO_WORDS] ^ (uint32_t)i);
+    }
+    ok(good);
+
+    return ok_failures != 0;
+}
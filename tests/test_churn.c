@@ -0,0 +1,79 @@
+/*
+ * Churn benchmark for malloc and free: allocates and frees blocks of
+ * mostly small, sometimes large random sizes in random order, and
+ * checks that no block is overwritten. Prints the time taken, read
+ * from the kernel data page, to compare allocators.
+ */
+
+#include "tests/lib.h"
+#include "tests/str.h"
+
+#define SLOTS 256
+#define ROUNDS 20000
+
+static char *blocks[SLOTS];
+static int sizes[SLOTS];
+static uint32_t seed = 1;
+
+static uint32_t
+next_random(void) {
+    seed = seed * 1103515245 + 12345;
+    return seed >> 8;
+}
+
+static int
+random_size(void) {
+    uint32_t r = next_random() % 100;
+    if (r < 80) return 1 + next_random() % 128;
+    if (r < 98) return 1 + next_random() % 2048;
+    return 1 + next_random() % 16384;
+}
+
+int
+main(void) {
+    char *start, *end;
+    int i, j, k, good, allocs, live, peak;
+    uint32_t msec;
+
+    cout("Running malloc churn benchmark: \n");
+    start = syscall_memlimit(NULL);
+    good = 1;
+    allocs = 0;
+    live = 0;
+    peak = 0;
+    msec = kdata_msec();
+
+    for (i = 0; i < ROUNDS && good; i++) {
+        k = next_random() % SLOTS;
+        if (blocks[k]) {
+            for (j = 0; j < sizes[k]; j++) {
+                good = good && blocks[k][j] == (char)(k + j);
+            }
+            free(blocks[k]);
+            blocks[k] = NULL;
+            live -= sizes[k];
+        } else {
+            sizes[k] = random_size();
+            blocks[k] = malloc(sizes[k]);
+            good = blocks[k] != NULL && ((uint32_t)blocks[k] & 7) == 0;
+            for (j = 0; good && j < sizes[k]; j++) {
+                blocks[k][j] = (char)(k + j);
+            }
+            allocs++;
+            live += sizes[k];
+            if (live > peak)
+                peak = live;
+        }
+    }
+    msec = kdata_msec() - msec;
+    end = syscall_memlimit(NULL);
+    for (k = 0; k < SLOTS; k++) {
+        free(blocks[k]);
+    }
+
+    cout("-> %d allocations in %d ms, peak %d bytes in use, heap %d bytes: ",
+         allocs, (int)msec, peak, (int)(end - start));
+    ok(good);
+
+    return ok_failures != 0;
+}
@@ -0,0 +1,101 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+#define PAGES 4
+#define CHILDREN 4
+/* more than the process table had entries before it could grow */
+#define ZOMBIES 40
+
+static int shared_value;
+static char buffer[PAGES * 4096];
+
+/* Checks that the child sees the memory of the parent as it was at
+   the time of the fork and modifies only its own copy. */
+static void
+child(int arg) {
+    int i;
+
+    if (shared_value != 42 || buffer[0] != 'p') {
+        syscall_exit(1);
+    }
+    shared_value = arg;
+    for (i = 0; i < PAGES; i++) {
+        buffer[i * 4096] = 'c';
+    }
+}
+
+/* Exits right away, the parent joins it later */
+static void
+exiter(int arg) {
+    syscall_exit(arg);
+}
+
+int
+main(void) {
+    int pids[CHILDREN];
+    int zombies[ZOMBIES];
+    int i, j, good;
+
+    cout("Running fork tests: \n");
+
+    shared_value = 42;
+    for (i = 0; i < PAGES; i++) {
+        buffer[i * 4096] = 'p';
+    }
+
+    cout("-> Fork one child: ");
+    pids[0] = syscall_fork(child, 7);
+    ok(pids[0] >= 0);
+
+    cout("-> Child saw parent's memory: ");
+    ok(syscall_join(pids[0]) == 0);
+
+    cout("-> Parent's memory not modified by child: ");
+    good = shared_value == 42;
+    for (i = 0; i < PAGES; i++) {
+        good = good && buffer[i * 4096] == 'p';
+    }
+    ok(good);
+
+    cout("-> Fork several children: ");
+    good = 1;
+    for (i = 0; i < CHILDREN; i++) {
+        pids[i] = syscall_fork(child, i);
+        good = good && pids[i] >= 0;
+    }
+    ok(good);
+
+    cout("-> Join children: ");
+    good = 1;
+    for (j = 0; j < CHILDREN; j++) {
+        good = good && pids[j] >= 0 && syscall_join(pids[j]) == 0;
+    }
+    ok(good);
+
+    cout("-> Parent writes after children exited: ");
+    buffer[0] = 'x';
+    shared_value = 1;
+    ok(buffer[0] == 'x' && buffer[4096] == 'p' && shared_value == 1);
+
+    cout("-> Fork with NULL function fails: ");
+    ok(syscall_fork(0, 0) < 0);
+
+    cout("-> Many exited children wait to be joined: ");
+    good = 1;
+    for (i = 0; i < ZOMBIES; i++) {
+        zombies[i] = syscall_fork(exiter, i);
+        good = good && zombies[i] > 0;
+    }
+    for (i = ZOMBIES - 1; i >= 0; i--) {
+        good = good && zombies[i] > 0 && syscall_join(zombies[i]) == i;
+    }
+    ok(good);
+
+    cout("-> Joined PID is not valid for a new child: ");
+    /* the new child most likely gets the entry of the last joined one */
+    j = syscall_fork(exiter, 5);
+    ok(j > 0 && j != zombies[0] && syscall_join(zombies[0]) < 0 &&
+       syscall_join(j) == 5);
+
+    return ok_failures != 0;
+}
@@ -189,6 +189,54 @@ static void test_complex() {
 
 }
 
+/* reads and writes spanning many pages, from unaligned buffers */
+#define LARGE_SIZE 40000
+static char large_out[LARGE_SIZE + 8];
+static char large_in[LARGE_SIZE + 8];
+
+static void test_large() {
+    const char *filename = "[disk1]large.dat";
+    int filehandle, return_value, i, ok;
+
+    syscall_delete(filename);
+    return_value = syscall_create(filename, LARGE_SIZE);
+    assert(0, return_value, "test_large_1_failed\n");
+    filehandle = syscall_open(filename);
+    assert(0, MIN(filehandle, 0), "test_large_2_failed\n");
+
+    for (i = 0; i < LARGE_SIZE; i++) {
+        large_out[i + 1] = (char)(i * 13 + i / 512);
+    }
+    return_value = syscall_write(filehandle, large_out + 1, LARGE_SIZE);
+    assert(LARGE_SIZE, return_value, "test_large_3_failed\n");
+
+    /* the file is full */
+    return_value = syscall_write(filehandle, large_out + 1, 10);
+    assert(0, return_value, "test_large_4_failed\n");
+
+    syscall_seek(filehandle, 0);
+    return_value = syscall_read(filehandle, large_in + 3, LARGE_SIZE + 5);
+    assert(LARGE_SIZE, return_value, "test_large_5_failed\n");
+    ok = 1;
+    for (i = 0; i < LARGE_SIZE; i++) {
+        ok = ok && large_in[i + 3] == large_out[i + 1];
+    }
+    assert(1, ok, "test_large_6_failed\n");
+
+    /* starting in the middle of a block */
+    syscall_seek(filehandle, 1000);
+    return_value = syscall_read(filehandle, large_in, 5000);
+    assert(5000, return_value, "test_large_7_failed\n");
+    ok = 1;
+    for (i = 0; i < 5000; i++) {
+        ok = ok && large_in[i] == large_out[1000 + i + 1];
+    }
+    assert(1, ok, "test_large_8_failed\n");
+
+    syscall_close(filehandle);
+    syscall_delete(filename);
+}
+
 /*NOT in use*/
 void test_read_stdin() {
     char buf[50];
@@ -223,6 +271,9 @@ int main(int argc, char** argv) {
     else if (stringcmp(argv[1], "test_complex") == 0) {
         test_complex();
     }
+    else if (stringcmp(argv[1], "test_large") == 0) {
+        test_large();
+    }
 
     cout("test_complex finished\n");
 
@@ -0,0 +1,45 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+static void
+child_pid(int arg) {
+    arg = arg;
+    syscall_exit(kdata_pid());
+}
+
+/* The kernel data pages are read-only, the write kills the process */
+static void
+write_kdata(int arg) {
+    *(int *)(SYSCALL_KDATA_ADDR + arg) = 0;
+    syscall_exit(0);
+}
+
+int
+main(void) {
+    uint32_t start;
+    int i, pid, my_pid;
+
+    cout("Running kernel data page tests: \n");
+
+    cout("-> Time advances: ");
+    start = kdata_msec();
+    for (i = 0; i < 10000000 && kdata_msec() == start; i++) ;
+    ok(kdata_msec() != start);
+
+    cout("-> At least one CPU: ");
+    ok(kdata_cpus() >= 1);
+
+    cout("-> Forked child sees its own PID: ");
+    my_pid = kdata_pid();
+    pid = syscall_fork(child_pid, 0);
+    ok(pid >= 0 && pid != my_pid && syscall_join(pid) == pid &&
+       kdata_pid() == my_pid);
+
+    cout("-> Pages are read-only: ");
+    pid = syscall_fork(write_kdata, 0);
+    i = pid >= 0 && syscall_join(pid) != 0;
+    pid = syscall_fork(write_kdata, 4096);
+    ok(i && pid >= 0 && syscall_join(pid) != 0);
+
+    return ok_failures != 0;
+}
@@ -1,12 +1,6 @@
 #include "tests/lib.h"
 #include "tests/str.h"
 
-static void
-ok(void *b) {
-    if (b) cout("OK.\n");
-    else cout("FAIL!\n");
-}
-
 int
 main(void) {
     char *s,*t,*u;
@@ -15,7 +9,7 @@ main(void) {
 
     cout("-> Small allocation: ");
     s = malloc(sizeof(char));
-    ok(s);
+    ok(s != NULL);
 
     cout("-> Small free: ");
     free(s);
@@ -23,11 +17,11 @@ main(void) {
 
     cout("-> Large allocation: ");
     s = malloc(4096*sizeof(char));
-    ok(s);
+    ok(s != NULL);
 
     cout("-> Large allocation: ");
     t = malloc(4096*sizeof(char));
-    ok(t);
+    ok(t != NULL);
 
     cout("-> Large free: ");
     free(s);
@@ -35,11 +29,11 @@ main(void) {
 
     cout("-> Small allocation: ");
     s = malloc(8*sizeof(char));
-    ok(s);
+    ok(s != NULL);
 
     cout("-> Small allocation: ");
     u = malloc(8*sizeof(char));
-    ok(u);
+    ok(u != NULL);
 
     cout("-> Small free: ");
     free(s);
@@ -51,7 +45,7 @@ main(void) {
 
     cout("-> Large allocation: ");
     t = malloc(1024*sizeof(char));
-    ok(t);
+    ok(t != NULL);
 
     cout("-> Small free: ");
     free(u);
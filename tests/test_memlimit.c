@@ -1,9 +1,36 @@
 #include "tests/lib.h"
 #include "tests/str.h"
 
+#define CHILDREN 3
+#define GROW_PAGES 40
+
+/* Grows the heap of the child by a different amount in every child
+   and checks that the new pages are zeroed and hold what is written. */
+static void
+grow_child(int arg) {
+    char *start, *end;
+    int i, size = (GROW_PAGES + arg) * 4096;
+
+    start = syscall_memlimit(0);
+    end = syscall_memlimit(start + size);
+    if (end != start + size) syscall_exit(1);
+    for (i = 0; i < size; i++) {
+        if (start[i] != 0) syscall_exit(2);
+        start[i] = (char)(i + arg);
+    }
+    for (i = 0; i < size; i++) {
+        if (start[i] != (char)(i + arg)) syscall_exit(3);
+    }
+    if (syscall_memlimit(0) != end) syscall_exit(4);
+    /* give the pages back before exiting */
+    if (syscall_memlimit(start) != start) syscall_exit(5);
+}
+
 int
 main(void) {
     char *heap, *orig;
+    int pids[CHILDREN];
+    int i, good;
 
     cout("Testing memlimit.\n");
 
@@ -103,6 +130,29 @@ main(void) {
         return 1;
     }
 
+    cout("-> heaps of forked processes grow separately: ");
+    good = 1;
+    for (i = 0; i < CHILDREN; i++) {
+        pids[i] = syscall_fork(grow_child, i);
+        good = good && pids[i] >= 0;
+    }
+    for (i = 0; i < CHILDREN; i++) {
+        if (pids[i] >= 0)
+            good = syscall_join(pids[i]) == 0 && good;
+    }
+    if (good && syscall_memlimit(0) == orig) cout("OK.\n");
+    else {
+        cout("FAIL!\n");
+        return 1;
+    }
+
+    cout("-> memlimit up to the mmap area: ");
+    heap = syscall_memlimit((void *)0x40000000);
+    if (heap) {
+        cout("FAIL!\n");
+        return 1;
+    } else cout("OK.\n");
+
     cout("All memlimit tests passed.\n");
 
     syscall_halt();
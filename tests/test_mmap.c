@@ -0,0 +1,87 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+#define FILENAME "[disk1]mmap.dat"
+/* The file ends in the middle of its last page */
+#define SIZE (3 * 4096 + 100)
+
+static char buffer[SIZE];
+
+static char
+pattern(int i) {
+    return (char)(i * 7 + i / 4096);
+}
+
+int
+main(void) {
+    char *map;
+    int fd, i, good;
+
+    cout("Running mmap tests: \n");
+
+    cout("-> Create file: ");
+    syscall_delete(FILENAME);
+    good = syscall_create(FILENAME, SIZE) == 0;
+    fd = syscall_open(FILENAME);
+    for (i = 0; i < SIZE; i++) {
+        buffer[i] = pattern(i);
+    }
+    good = good && fd >= 0 && syscall_write(fd, buffer, SIZE) == SIZE;
+    ok(good);
+
+    cout("-> Unaligned offset is rejected: ");
+    ok(syscall_mmap(fd, 100, SIZE) == NULL);
+
+    cout("-> Mapping shows the file: ");
+    map = syscall_mmap(fd, 0, SIZE);
+    good = map != NULL;
+    for (i = 0; good && i < SIZE; i++) {
+        good = map[i] == pattern(i);
+    }
+    ok(good);
+
+    cout("-> Rest of the last page is zero: ");
+    good = map != NULL;
+    for (i = SIZE; good && i < 4 * 4096; i++) {
+        good = map[i] == 0;
+    }
+    ok(good);
+
+    /* write to the second page only, the file may be closed while it
+       is still mapped */
+    syscall_close(fd);
+    if (map != NULL) {
+        for (i = 4096; i < 2 * 4096; i++) {
+            map[i] = 'x';
+        }
+    }
+
+    cout("-> Unmap: ");
+    ok(map != NULL && syscall_munmap(map) == 0);
+
+    cout("-> Second unmap fails: ");
+    ok(syscall_munmap(map) < 0);
+
+    cout("-> Written page reached the file: ");
+    fd = syscall_open(FILENAME);
+    good = fd >= 0 && syscall_read(fd, buffer, SIZE) == SIZE;
+    for (i = 0; good && i < SIZE; i++) {
+        if (i >= 4096 && i < 2 * 4096)
+            good = buffer[i] == 'x';
+        else
+            good = buffer[i] == pattern(i);
+    }
+    ok(good);
+
+    cout("-> Mapping at an offset: ");
+    map = syscall_mmap(fd, 2 * 4096, 4096 + 100);
+    good = map != NULL;
+    for (i = 0; good && i < 4096 + 100; i++) {
+        good = map[i] == pattern(2 * 4096 + i);
+    }
+    ok(good);
+    /* left mapped, removed when the process exits */
+
+    syscall_close(fd);
+    return ok_failures != 0;
+}
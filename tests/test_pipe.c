@@ -0,0 +1,70 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+/* more than fits in the buffer of a pipe */
+#define BYTES 4000
+
+static char buffer[BYTES];
+
+/* Writes BYTES bytes to stdout, which is the pipe, in small pieces */
+static void
+writer(int arg) {
+    int i, size;
+
+    for (i = 0; i < BYTES; i++) {
+        buffer[i] = 'a' + i % 26;
+    }
+    for (i = 0; i < BYTES; i += size) {
+        size = BYTES - i < arg ? BYTES - i : arg;
+        if (syscall_write(stdout, buffer + i, size) != size)
+            syscall_exit(1);
+    }
+}
+
+int
+main(void) {
+    int fd[2];
+    int pid, n, total, right;
+    char text[8];
+
+    cout("Running pipe tests: \n");
+
+    cout("-> Data written to a pipe is read back: ");
+    ok(syscall_pipe(fd) == 0 &&
+       syscall_write(fd[1], "hello", 5) == 5 &&
+       syscall_read(fd[0], text, sizeof(text)) == 5 &&
+       text[0] == 'h' && text[4] == 'o');
+
+    cout("-> Reads return end of file when the write end is closed: ");
+    ok(syscall_write(fd[1], "bye", 3) == 3 &&
+       syscall_close(fd[1]) == 0 &&
+       syscall_read(fd[0], text, sizeof(text)) == 3 &&
+       syscall_read(fd[0], text, sizeof(text)) == 0);
+    syscall_close(fd[0]);
+
+    cout("-> Writes fail when the read end is closed: ");
+    ok(syscall_pipe(fd) == 0 &&
+       syscall_close(fd[0]) == 0 &&
+       syscall_write(fd[1], "lost", 4) <= 0);
+    syscall_close(fd[1]);
+
+    cout("-> A child writes through its redirected stdout: ");
+    syscall_pipe(fd);
+    syscall_redirect(stdout, fd[1]);
+    pid = syscall_fork(writer, 100);
+    syscall_redirect(stdout, stdout);
+    syscall_close(fd[1]);
+    total = 0;
+    right = 1;
+    while ((n = syscall_read(fd[0], buffer + total, BYTES - total)) > 0) {
+        total += n;
+    }
+    for (n = 0; n < total; n++) {
+        if (buffer[n] != 'a' + n % 26)
+            right = 0;
+    }
+    syscall_close(fd[0]);
+    ok(pid >= 0 && syscall_join(pid) == 0 && total == BYTES && right);
+
+    return ok_failures != 0;
+}
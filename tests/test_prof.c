@@ -0,0 +1,63 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+/* milliseconds each function spins */
+#define SPIN_MSEC 300
+
+static syscall_profile_t profile;
+
+/* Spins for SPIN_MSEC milliseconds, returns the number of rounds */
+static int
+spin_a(void) {
+    uint32_t end = kdata_msec() + SPIN_MSEC;
+    int rounds = 0;
+
+    while (kdata_msec() < end)
+        rounds++;
+    return rounds;
+}
+
+/* Same as spin_a, but does twice the work per round */
+static int
+spin_b(void) {
+    uint32_t end = kdata_msec() + SPIN_MSEC;
+    int rounds = 0;
+
+    while (kdata_msec() < end)
+        rounds += 2;
+    return rounds;
+}
+
+int
+main(void) {
+    uint32_t sum = 0;
+    int samples, i;
+
+    cout("Running profiler tests: \n");
+
+    cout("-> Profiling can not be stopped before it is started: ");
+    ok(syscall_profile_stop(NULL) < 0);
+
+    cout("-> Profiling starts only once: ");
+    ok(syscall_profile_start((void *)0x1000, 4) == 0 &&
+       syscall_profile_start((void *)0x1000, 4) < 0);
+
+    spin_a();
+    spin_b();
+
+    cout("-> Timer interrupts sample the program: ");
+    samples = syscall_profile_stop(&profile);
+    ok(samples > 0 && profile.samples == (uint32_t)samples &&
+       profile.base == 0x1000 && profile.shift == 4);
+
+    cout("-> Every sample is in a bucket or missed: ");
+    for (i = 0; i < SYSCALL_PROFILE_BUCKETS; i++)
+        sum += profile.buckets[i];
+    ok(sum + profile.missed == profile.samples);
+
+    /* read with util/tfstool and summarized with util/pcprof */
+    cout("-> Profile written to prof.txt: ");
+    ok(profile_write("[disk1]prof.txt", &profile) > 0);
+
+    return ok_failures != 0;
+}
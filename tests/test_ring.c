@@ -0,0 +1,98 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+#define FILENAME "[disk1]ring.dat"
+#define CHUNK 64
+#define CHUNKS 40
+
+static syscall_ring_t ring;
+static char data[CHUNKS * CHUNK];
+static char buffer[CHUNKS * CHUNK];
+
+/* Submits the ring and checks that the completions come in order with
+   the expected user data. Returns the result of the last completion,
+   or -1000 on error. */
+static int
+run(uint32_t first, int count) {
+    syscall_cqe_t cqe;
+    int i, result = -1000;
+
+    if (syscall_submit() != count) return -1000;
+    for (i = 0; i < count; i++) {
+        if (ring_complete(&ring, &cqe) < 0 || cqe.user_data != first + i)
+            return -1000;
+        result = cqe.result;
+    }
+    return ring_complete(&ring, &cqe) < 0 ? result : -1000;
+}
+
+int
+main(void) {
+    syscall_cqe_t cqe;
+    int fd, i, first, good, traps;
+
+    cout("Running ring tests: \n");
+
+    cout("-> Submit without a ring fails: ");
+    ok(syscall_submit() < 0);
+
+    cout("-> Register ring: ");
+    ok(syscall_ring_setup(&ring) == 0);
+
+    cout("-> Create and open in one batch: ");
+    ring_request(&ring, SYSCALL_DELETE, (uint32_t)FILENAME, 0, 0, 0);
+    ring_request(&ring, SYSCALL_CREATE, (uint32_t)FILENAME,
+                 sizeof(data), 0, 1);
+    ring_request(&ring, SYSCALL_OPEN, (uint32_t)FILENAME, 0, 0, 2);
+    fd = run(0, 3);
+    ok(fd >= 0);
+
+    cout("-> Writes in batches of a full ring: ");
+    for (i = 0; i < CHUNKS * CHUNK; i++) {
+        data[i] = (char)(i * 3);
+    }
+    good = 1;
+    traps = 0;
+    i = 0;
+    while (good && i < CHUNKS) {
+        first = i;
+        while (i < CHUNKS && ring_request(&ring, SYSCALL_WRITE, fd,
+                                          (uint32_t)(data + i * CHUNK),
+                                          CHUNK, i) == 0) {
+            i++;
+        }
+        traps++;
+        good = run(first, i - first) == CHUNK;
+    }
+    /* one trap per ring full of writes */
+    ok(good && traps == (CHUNKS + SYSCALL_RING_ENTRIES - 1) /
+       SYSCALL_RING_ENTRIES);
+
+    cout("-> Full ring rejects requests: ");
+    for (i = 0; i < SYSCALL_RING_ENTRIES; i++) {
+        ring_request(&ring, SYSCALL_SEEK, fd, 0, 0, i);
+    }
+    ok(ring_request(&ring, SYSCALL_SEEK, fd, 0, 0, 0) < 0 &&
+       run(0, SYSCALL_RING_ENTRIES) == 0);
+
+    cout("-> Seek and read back in one batch: ");
+    ring_request(&ring, SYSCALL_SEEK, fd, 0, 0, 0);
+    ring_request(&ring, SYSCALL_READ, fd, (uint32_t)buffer,
+                 sizeof(buffer), 1);
+    good = run(0, 2) == sizeof(buffer);
+    for (i = 0; good && i < CHUNKS * CHUNK; i++) {
+        good = buffer[i] == data[i];
+    }
+    ok(good);
+
+    cout("-> Unknown request fails alone: ");
+    ring_request(&ring, SYSCALL_HALT, 0, 0, 0, 0);
+    ring_request(&ring, SYSCALL_CLOSE, fd, 0, 0, 1);
+    good = syscall_submit() == 2;
+    good = good && ring_complete(&ring, &cqe) == 0 && cqe.result < 0;
+    good = good && ring_complete(&ring, &cqe) == 0 && cqe.result == 0;
+    ok(good);
+
+    syscall_ring_setup(NULL);
+    return ok_failures != 0;
+}
@@ -0,0 +1,61 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+/* The stack of a process may grow up to 256 pages (1M) */
+#define FRAME 1024
+#define DEPTH 400
+
+/* Uses about FRAME bytes of stack per call and checks that the data of
+   every frame survives the deeper calls. */
+static int
+recurse(int depth) {
+    char frame[FRAME];
+    int i, sum;
+
+    for (i = 0; i < FRAME; i++) {
+        frame[i] = (char)(depth + i);
+    }
+    sum = depth > 0 ? recurse(depth - 1) : 0;
+    for (i = 0; i < FRAME; i++) {
+        if (frame[i] != (char)(depth + i)) return -1000000;
+    }
+    return sum + 1;
+}
+
+static int
+large_buffer(void) {
+    char buffer[64 * 1024];
+    int i;
+
+    for (i = 0; i < (int)sizeof(buffer); i += 4096) {
+        if (buffer[i] != 0) return 0;
+        buffer[i] = 1;
+    }
+    return 1;
+}
+
+/* Recurses until the stack runs out, the process is killed */
+static void
+overflow(int arg) {
+    recurse(arg);
+}
+
+int
+main(void) {
+    int pid;
+
+    cout("Running stack tests: \n");
+
+    /* before the recursion, which leaves its data on the stack */
+    cout("-> Large buffer on stack starts zeroed: ");
+    ok(large_buffer());
+
+    cout("-> Deep recursion: ");
+    ok(recurse(DEPTH) == DEPTH + 1);
+
+    cout("-> Overflowing the stack limit kills the process: ");
+    pid = syscall_fork(overflow, 2000);
+    ok(pid >= 0 && syscall_join(pid) != 0);
+
+    return ok_failures != 0;
+}
@@ -0,0 +1,71 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+#define CALLS 10
+
+static syscall_stats_t stats[SYSCALL_STATS_SLOTS];
+static syscall_stats_t global[SYSCALL_STATS_SLOTS];
+
+/* Thread that ends with an exit call, which never returns */
+static int
+exit_thread(int arg) {
+    syscall_thread_exit(arg);
+    return 0;
+}
+
+/* Returns the number of calls in the latency histogram of a slot */
+static uint32_t
+histogram_calls(syscall_stats_t *s) {
+    uint32_t calls = 0;
+    int i;
+
+    for (i = 0; i < SYSCALL_STATS_BUCKETS; i++) {
+        calls += s->latency[i];
+    }
+    return calls;
+}
+
+int
+main(void) {
+    syscall_stats_t *seek, *memlimit;
+    int i, thread;
+
+    cout("Running syscall statistics tests: \n");
+
+    cout("-> Process statistics start empty: ");
+    ok(syscall_stats(stats, 0) == 0 &&
+       stats[SYSCALL_STATS_SLOT(SYSCALL_SEEK)].calls == 0);
+
+    for (i = 0; i < CALLS; i++) {
+        syscall_seek(-1, 0);
+        syscall_memlimit(NULL);
+    }
+
+    cout("-> Process statistics count calls and errors: ");
+    seek = &stats[SYSCALL_STATS_SLOT(SYSCALL_SEEK)];
+    memlimit = &stats[SYSCALL_STATS_SLOT(SYSCALL_MEMLIMIT)];
+    ok(syscall_stats(stats, 0) == 0 &&
+       seek->calls == CALLS && seek->errors == CALLS &&
+       memlimit->calls >= CALLS && memlimit->errors == 0);
+
+    cout("-> Latency histogram holds every call: ");
+    ok(histogram_calls(seek) == CALLS && histogram_calls(memlimit) == memlimit->calls);
+
+    /* the first call is counted as it started the statistics */
+    cout("-> Stats call counts after the copy: ");
+    ok(syscall_stats(stats, 0) == 0 &&
+       stats[SYSCALL_STATS_SLOT(SYSCALL_STATS)].calls == 2);
+
+    cout("-> Thread exit is counted: ");
+    thread = syscall_thread_create(exit_thread, 1);
+    ok(thread > 0 && syscall_thread_join(thread) == 1 &&
+       syscall_stats(stats, 0) == 0 &&
+       stats[SYSCALL_STATS_SLOT(SYSCALL_THREAD_EXIT)].calls == 1);
+
+    cout("-> Global statistics include the process: ");
+    ok(syscall_stats(global, 1) == 0 &&
+       global[SYSCALL_STATS_SLOT(SYSCALL_SEEK)].calls >= CALLS);
+
+    /* the global statistics are printed at shutdown */
+    return ok_failures != 0;
+}
@@ -0,0 +1,58 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+/* Together the children touch more pages than the machine has
+   memory, so the test only passes with a swap disk. */
+#define PAGES 40
+#define CHILDREN 4
+#define ROUNDS 3
+
+static int buffer[PAGES * 1024];
+
+/* Fills every page with words depending on the child and the page,
+   then checks them several times while the other children are doing
+   the same. */
+static void
+child(int arg) {
+    int i, j, round;
+
+    for (i = 0; i < PAGES; i++) {
+        for (j = 0; j < 1024; j += 64) {
+            buffer[i * 1024 + j] = arg * 100000 + i * 1024 + j;
+        }
+    }
+    for (round = 0; round < ROUNDS; round++) {
+        for (i = 0; i < PAGES; i++) {
+            for (j = 0; j < 1024; j += 64) {
+                if (buffer[i * 1024 + j] != arg * 100000 + i * 1024 + j) {
+                    syscall_exit(1);
+                }
+            }
+        }
+    }
+}
+
+int
+main(void) {
+    int pids[CHILDREN];
+    int i, good;
+
+    cout("Running swap tests: \n");
+
+    cout("-> Fork children: ");
+    good = 1;
+    for (i = 0; i < CHILDREN; i++) {
+        pids[i] = syscall_fork(child, i + 1);
+        good = good && pids[i] >= 0;
+    }
+    ok(good);
+
+    cout("-> Children kept their data: ");
+    good = 1;
+    for (i = 0; i < CHILDREN; i++) {
+        good = good && pids[i] >= 0 && syscall_join(pids[i]) == 0;
+    }
+    ok(good);
+
+    return ok_failures != 0;
+}
@@ -0,0 +1,107 @@
+#include "tests/lib.h"
+#include "tests/str.h"
+
+/* Threads share the address space of the process, each on its own
+   stack. */
+#define THREADS 4
+#define PART 256
+#define FRAME 1024
+
+static int numbers[THREADS * PART];
+static volatile int spinning;
+
+/* Sums one part of the shared array */
+static int
+sum_part(int part) {
+    int i, sum = 0;
+
+    for (i = part * PART; i < (part + 1) * PART; i++) {
+        sum += numbers[i];
+    }
+    return sum;
+}
+
+static int
+exit_early(int arg) {
+    syscall_thread_exit(arg + 1);
+    return 0;
+}
+
+static int
+recurse(int depth) {
+    char frame[FRAME];
+    int i, sum;
+
+    for (i = 0; i < FRAME; i++) {
+        frame[i] = (char)(depth + i);
+    }
+    sum = depth > 0 ? recurse(depth - 1) : 0;
+    for (i = 0; i < FRAME; i++) {
+        if (frame[i] != (char)(depth + i)) return -1000000;
+    }
+    return sum + 1;
+}
+
+static int
+spin(int arg) {
+    while (spinning) ;
+    return arg;
+}
+
+static int
+exit_process(int arg) {
+    syscall_exit(arg);
+    return 0;
+}
+
+/* Exits the whole process from a thread while other threads run */
+static void
+child(int arg) {
+    int i;
+
+    spinning = 1;
+    for (i = 0; i < 2; i++) {
+        syscall_thread_create(spin, i);
+    }
+    syscall_thread_create(exit_process, arg);
+    spin(0);
+}
+
+int
+main(void) {
+    int tids[THREADS];
+    int i, sum, pid;
+
+    cout("Running thread tests: \n");
+
+    for (i = 0; i < THREADS * PART; i++) {
+        numbers[i] = i;
+    }
+
+    cout("-> Threads sum parts of a shared array: ");
+    for (i = 0; i < THREADS; i++) {
+        tids[i] = syscall_thread_create(sum_part, i);
+    }
+    sum = 0;
+    for (i = 0; i < THREADS; i++) {
+        sum += tids[i] >= 0 ? syscall_thread_join(tids[i]) : -1;
+    }
+    ok(sum == THREADS * PART * (THREADS * PART - 1) / 2);
+
+    cout("-> Thread ends with syscall_thread_exit: ");
+    ok(syscall_thread_join(syscall_thread_create(exit_early, 41)) == 42);
+
+    cout("-> Deep recursion on a thread stack: ");
+    ok(syscall_thread_join(syscall_thread_create(recurse, 40)) == 41);
+
+    cout("-> Joining self, a joined or a bad thread fails: ");
+    i = syscall_thread_create(exit_early, 0);
+    ok(syscall_thread_join(i) == 1 && syscall_thread_join(i) < 0 &&
+       syscall_thread_join(0) < 0 && syscall_thread_join(100) < 0);
+
+    cout("-> Exit from a thread ends the process: ");
+    pid = syscall_fork(child, 7);
+    ok(pid >= 0 && syscall_join(pid) == 7);
+
+    return ok_failures != 0;
+}
@@ -5,7 +5,7 @@ MODULE := util
 
 NATIVECC      := gcc
 NATIVECFLAGS  += -O2 -g -I. -Wall -W
-TARGETS       += util/tfstool
+TARGETS       += util/tfstool util/pcprof
 
 util/tfstool: util/tfstool.o
 	$(NATIVECC) -o $@ $^
@@ -13,5 +13,11 @@ util/tfstool: util/tfstool.o
 util/tfstool.o: util/tfstool.c util/tfstool.h fs/tfs.h lib/bitmap.h
 	$(NATIVECC) -o $@  $(NATIVECFLAGS) -c $<
 
+util/pcprof: util/pcprof.o
+	$(NATIVECC) -o $@ $^
+
+util/pcprof.o: util/pcprof.c
+	$(NATIVECC) -o $@  $(NATIVECFLAGS) -c $<
+
 utilclean:
-	rm -f util/*.[od] util/tfstool
+	rm -f util/*.[od] util/tfstool util/pcprof
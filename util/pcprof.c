@@ -0,0 +1,211 @@
+/*
+ * PC profile summarizer.
+ *
+ * Reads a linker map file (tests/<program>.map for userland programs,
+ * buenos.map for the kernel) and a profile of sampled program counters,
+ * and prints the number of samples in every function, most sampled
+ * first.
+ *
+ * A profile has one "<address> <count>" pair per line, the address in
+ * hex with a 0x prefix. The pair may follow one word, as in the
+ * "kprof <address> <count>" lines of the kernel profiler, so kernel
+ * console logs can be given as they are. Other lines are skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    unsigned long addr;
+    /* input sections of object files sort before symbols at the same
+       address so that the symbol gets the samples */
+    int is_symbol;
+    char name[64];
+    unsigned long samples;
+} symbol_t;
+
+static symbol_t *symbols = NULL;
+static int num_symbols = 0;
+static int max_symbols = 0;
+
+void print_usage(void)
+{
+    printf("PC profile summarizer\n");
+    printf("Usage: pcprof <map file> [profile]\n");
+    printf("The profile is read from standard input if it is not given.\n");
+    exit(1);
+}
+
+FILE *openfile(char *filename, const char *mode)
+{
+    FILE *fp = fopen(filename, mode);
+
+    if (fp == NULL) {
+        perror(filename);
+        exit(1);
+    }
+    return fp;
+}
+
+void add_symbol(unsigned long addr, const char *name, int is_symbol)
+{
+    if (num_symbols == max_symbols) {
+        max_symbols = max_symbols ? 2 * max_symbols : 256;
+        symbols = realloc(symbols, max_symbols * sizeof(symbol_t));
+        if (symbols == NULL) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    symbols[num_symbols].addr = addr;
+    symbols[num_symbols].is_symbol = is_symbol;
+    strncpy(symbols[num_symbols].name, name, sizeof(symbols[0].name) - 1);
+    symbols[num_symbols].name[sizeof(symbols[0].name) - 1] = '\0';
+    symbols[num_symbols].samples = 0;
+    num_symbols++;
+}
+
+int compare_address(const void *a, const void *b)
+{
+    const symbol_t *s1 = a, *s2 = b;
+
+    if (s1->addr != s2->addr)
+        return s1->addr < s2->addr ? -1 : 1;
+    return s1->is_symbol - s2->is_symbol;
+}
+
+int compare_samples(const void *a, const void *b)
+{
+    const symbol_t *s1 = a, *s2 = b;
+
+    if (s1->samples != s2->samples)
+        return s1->samples > s2->samples ? -1 : 1;
+    return compare_address(a, b);
+}
+
+/* Symbols are "0x<address> <name>" lines. Code sections of object
+ * files are " .text 0x<address> 0x<size> <file>" lines; they name the
+ * static functions, which are not in the map.
+ */
+void read_map(char *filename)
+{
+    FILE *fp = openfile(filename, "r");
+    char line[512], f1[256], f2[256], f3[256], f4[256];
+    unsigned long addr, size;
+    int fields;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        fields = sscanf(line, "%255s %255s %255s %255s", f1, f2, f3, f4);
+        if (fields == 2 && !strncmp(f1, "0x", 2)) {
+            addr = strtoul(f1, NULL, 16);
+            if (addr != 0)
+                add_symbol(addr, f2, 1);
+        } else if (fields == 4 && !strncmp(f1, ".text", 5)
+                   && !strncmp(f2, "0x", 2)) {
+            addr = strtoul(f2, NULL, 16);
+            size = strtoul(f3, NULL, 16);
+            if (addr != 0 && size != 0)
+                add_symbol(addr, f4, 0);
+        }
+    }
+    fclose(fp);
+
+    if (num_symbols == 0) {
+        fprintf(stderr, "%s: no symbols found\n", filename);
+        exit(1);
+    }
+    qsort(symbols, num_symbols, sizeof(symbol_t), compare_address);
+}
+
+/* Parses a profile line to addr and count. Returns 0 if the line is
+ * not a sample.
+ */
+int parse_sample(char *line, unsigned long *addr, unsigned long *count)
+{
+    char f1[256], f2[256], f3[256], f4[256], *end;
+    char *hex, *num;
+
+    switch (sscanf(line, "%255s %255s %255s %255s", f1, f2, f3, f4)) {
+    case 2:
+        hex = f1;
+        num = f2;
+        break;
+    case 3:
+        hex = f2;
+        num = f3;
+        break;
+    default:
+        return 0;
+    }
+    if (strncmp(hex, "0x", 2))
+        return 0;
+    *addr = strtoul(hex, &end, 16);
+    if (*end != '\0')
+        return 0;
+    *count = strtoul(num, &end, 10);
+    return *end == '\0';
+}
+
+/* Returns the symbol containing addr, NULL if addr is before them all */
+symbol_t *find_symbol(unsigned long addr)
+{
+    int low = 0, high = num_symbols - 1, middle;
+
+    if (addr < symbols[0].addr)
+        return NULL;
+    /* last symbol at or below addr */
+    while (low < high) {
+        middle = (low + high + 1) / 2;
+        if (symbols[middle].addr <= addr)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return &symbols[low];
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *fp;
+    char line[512];
+    unsigned long addr, count, total = 0, unknown = 0;
+    symbol_t *symbol;
+    int i;
+
+    if (argc < 2 || argc > 3)
+        print_usage();
+
+    read_map(argv[1]);
+    fp = argc == 3 ? openfile(argv[2], "r") : stdin;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (!parse_sample(line, &addr, &count) || count == 0)
+            continue;
+        total += count;
+        symbol = find_symbol(addr);
+        if (symbol == NULL)
+            unknown += count;
+        else
+            symbol->samples += count;
+    }
+    if (fp != stdin)
+        fclose(fp);
+
+    if (total == 0) {
+        printf("No samples.\n");
+        return 0;
+    }
+
+    qsort(symbols, num_symbols, sizeof(symbol_t), compare_samples);
+    printf("%10s %6s  %-10s  %s\n", "samples", "%", "address", "function");
+    for (i = 0; i < num_symbols && symbols[i].samples > 0; i++) {
+        printf("%10lu %5.1f%%  0x%08lx  %s\n", symbols[i].samples,
+               100.0 * symbols[i].samples / total, symbols[i].addr,
+               symbols[i].name);
+    }
+    if (unknown > 0)
+        printf("%10lu %5.1f%%  %-10s  (unknown)\n", unknown,
+               100.0 * unknown / total, "");
+    return 0;
+}
@@ -40,6 +40,7 @@
 #include "kernel/spinlock.h"
 #include "kernel/interrupt.h"
 #include "kernel/assert.h"
+#include "kernel/config.h"
 
 /** @name Page pool
  *
@@ -66,6 +67,37 @@ static int pagepool_static_end;
 /* Spinlock to handle synchronous access to pagepool_free_pages */
 static spinlock_t pagepool_slock;
 
+#ifdef CHANGED_5
+/* Number of mappings referring to each physical page. Pages shared
+   copy-on-write are freed when the last reference is dropped. */
+static uint16_t *pagepool_refcounts;
+
+/* The pagetable and virtual address mapping each unshared user page,
+   used for choosing pages to swap out. The owner is forgotten when the
+   number of references changes. */
+static pagepool_owner_t *pagepool_owners;
+
+/* Free pages known to contain only zeroes, filled by the idle thread.
+   They stay reserved in pagepool_free_pages so that the plain
+   allocator takes them only when no other page is left. */
+static int pagepool_zeroed[CONFIG_PAGEPOOL_ZEROED_PAGES];
+static int pagepool_num_zeroed;
+
+/* Page each CPU's idle thread is zeroing (0 if none) and how many
+   bytes of it are done. The idle thread restarts from its initial
+   context after every interrupt, so the progress is kept here. */
+static int pagepool_zeroing[CONFIG_MAX_CPUS];
+static uint32_t pagepool_zeroing_done[CONFIG_MAX_CPUS];
+static int pagepool_num_zeroing;
+
+/* Zeroed page requests served from the list and by zeroing on the spot */
+static uint32_t pagepool_zeroed_hits;
+static uint32_t pagepool_zeroed_misses;
+
+/* Bytes zeroed at a time by the idle thread with interrupts disabled */
+#define PAGEPOOL_ZERO_CHUNK 256
+#endif
+
 /**
  * Pagepool initialization. Finds out number of physical pages and
  * number of staticly reserved physical pages. Marks reserved pages
@@ -82,6 +114,20 @@ void pagepool_init(void)
         (uint32_t *)kmalloc(bitmap_sizeof(pagepool_num_pages));
     bitmap_init(pagepool_free_pages, pagepool_num_pages);
 
+#ifdef CHANGED_5
+    pagepool_refcounts =
+        (uint16_t *)kmalloc(pagepool_num_pages * sizeof(uint16_t));
+    memoryset(pagepool_refcounts, 0, pagepool_num_pages * sizeof(uint16_t));
+    pagepool_owners = (pagepool_owner_t *)
+        kmalloc(pagepool_num_pages * sizeof(pagepool_owner_t));
+    memoryset(pagepool_owners, 0, pagepool_num_pages * sizeof(pagepool_owner_t));
+    memoryset(pagepool_zeroing, 0, sizeof(pagepool_zeroing));
+    pagepool_num_zeroed = 0;
+    pagepool_num_zeroing = 0;
+    pagepool_zeroed_hits = 0;
+    pagepool_zeroed_misses = 0;
+#endif
+
     /* Note that number of reserved pages must be get after we have 
        (staticly) reserved memory for bitmap. */
     num_res_pages = kmalloc_get_reserved_pages();
@@ -100,6 +146,34 @@ void pagepool_init(void)
 
 }
 
+#ifdef CHANGED_5
+/**
+ * Takes a page from the pre-zeroed list, or failing that a page the
+ * idle threads have not finished zeroing. Called with pagepool_slock
+ * held.
+ *
+ * @return Page number, zero if there are no such pages.
+ */
+static int pagepool_take_zeroed(void)
+{
+    int i, page;
+
+    if (pagepool_num_zeroed > 0)
+        return pagepool_zeroed[--pagepool_num_zeroed];
+
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+        if (pagepool_zeroing[i] != 0) {
+            page = pagepool_zeroing[i];
+            pagepool_zeroing[i] = 0;
+            pagepool_num_zeroing--;
+            return page;
+        }
+    }
+
+    return 0;
+}
+#endif
+
 /**
  * Finds first free physical page and marks it reserved.  
  *
@@ -121,6 +195,14 @@ uint32_t pagepool_get_phys_page(void)
         /* There should have been a free page. Check that the pagepool
            internal variables are in synch. */
 	KERNEL_ASSERT(i >= 0 && pagepool_num_free_pages >= 0);
+#ifdef CHANGED_5
+        pagepool_refcounts[i] = 1;
+        pagepool_owners[i].pagetable = NULL;
+    } else if ((i = pagepool_take_zeroed()) != 0) {
+        /* Only pages waiting in the zeroed list are left. */
+        pagepool_refcounts[i] = 1;
+        pagepool_owners[i].pagetable = NULL;
+#endif
     } else {
         i = 0;
     }
@@ -152,6 +234,17 @@ void pagepool_free_phys_page(uint32_t phys_addr)
     /* Check that the page was reserved. */
     KERNEL_ASSERT(bitmap_get(pagepool_free_pages, i) == 1);
 
+#ifdef CHANGED_5
+    /* Shared page, only drop this reference. */
+    KERNEL_ASSERT(pagepool_refcounts[i] > 0);
+    pagepool_owners[i].pagetable = NULL;
+    if (--pagepool_refcounts[i] > 0) {
+        spinlock_release(&pagepool_slock);
+        _interrupt_set_state(intr_status);
+        return;
+    }
+#endif
+
     bitmap_set(pagepool_free_pages, i, 0);
     pagepool_num_free_pages++;
 
@@ -161,7 +254,270 @@ void pagepool_free_phys_page(uint32_t phys_addr)
 
 #ifdef CHANGED_4
 int pagepool_get_free_pages(void) {
+#ifdef CHANGED_5
+    return pagepool_num_free_pages + pagepool_num_zeroed +
+        pagepool_num_zeroing;
+#else
     return pagepool_num_free_pages;
+#endif
+}
+#endif
+
+#ifdef CHANGED_5
+/**
+ * Adds a reference to given reserved page. The page is freed only after
+ * pagepool_free_phys_page has been called once for every reference.
+ *
+ * @param phys_addr Page to be shared.
+ */
+void pagepool_ref_phys_page(uint32_t phys_addr)
+{
+    interrupt_status_t intr_status;
+    int i;
+
+    i = phys_addr / PAGE_SIZE;
+    KERNEL_ASSERT(i >= pagepool_static_end);
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagepool_slock);
+
+    KERNEL_ASSERT(bitmap_get(pagepool_free_pages, i) == 1);
+    KERNEL_ASSERT(pagepool_refcounts[i] > 0 &&
+                  pagepool_refcounts[i] < 0xffff);
+    pagepool_refcounts[i]++;
+    pagepool_owners[i].pagetable = NULL;
+
+    spinlock_release(&pagepool_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Returns the number of references to given reserved page.
+ *
+ * @param phys_addr Page to be checked.
+ */
+int pagepool_get_refcount(uint32_t phys_addr)
+{
+    return pagepool_refcounts[phys_addr / PAGE_SIZE];
+}
+
+/**
+ * Reserves a page filled with zeroes. Pages zeroed in advance by the
+ * idle thread are used first, otherwise a free page is zeroed here.
+ *
+ * @return Address of the page, zero if no free pages are available.
+ */
+uint32_t pagepool_get_zeroed_phys_page(void)
+{
+    interrupt_status_t intr_status;
+    uint32_t phys;
+    int i;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagepool_slock);
+
+    /* A page the idle thread has not finished is not taken here, it
+       would have to be zeroed anyway. */
+    if (pagepool_num_zeroed > 0) {
+        i = pagepool_zeroed[--pagepool_num_zeroed];
+        pagepool_refcounts[i] = 1;
+        pagepool_owners[i].pagetable = NULL;
+        pagepool_zeroed_hits++;
+        spinlock_release(&pagepool_slock);
+        _interrupt_set_state(intr_status);
+        return i*PAGE_SIZE;
+    }
+
+    pagepool_zeroed_misses++;
+    spinlock_release(&pagepool_slock);
+    _interrupt_set_state(intr_status);
+
+    phys = pagepool_get_phys_page();
+    if (phys != 0)
+        memoryset((void *)ADDR_PHYS_TO_KERNEL(phys), 0, PAGE_SIZE);
+    return phys;
+}
+
+/**
+ * Zeroes free pages into the pre-zeroed list until it is full or there
+ * are no free pages left. Called by the idle thread with interrupts
+ * enabled. The page is zeroed a small piece at a time with interrupts
+ * disabled so that the progress is recorded even though the idle
+ * thread is restarted from the beginning after each interrupt.
+ */
+void pagepool_zero_idle(void)
+{
+    interrupt_status_t intr_status;
+    uint32_t *word;
+    int cpu, i;
+
+    while (1) {
+        intr_status = _interrupt_disable();
+        spinlock_acquire(&pagepool_slock);
+        cpu = _interrupt_getcpu();
+
+        if (pagepool_zeroing[cpu] == 0) {
+            if (pagepool_num_free_pages == 0 ||
+                pagepool_num_zeroed + pagepool_num_zeroing >=
+                CONFIG_PAGEPOOL_ZEROED_PAGES) {
+                spinlock_release(&pagepool_slock);
+                _interrupt_set_state(intr_status);
+                return;
+            }
+
+            i = bitmap_findnset(pagepool_free_pages, pagepool_num_pages);
+            KERNEL_ASSERT(i > 0);
+            pagepool_num_free_pages--;
+            pagepool_num_zeroing++;
+            pagepool_zeroing[cpu] = i;
+            pagepool_zeroing_done[cpu] = 0;
+        }
+
+        /* The spinlock is held so that an allocator on another CPU
+           cannot take the page in the middle of a piece. */
+        word = (uint32_t *)ADDR_PHYS_TO_KERNEL(pagepool_zeroing[cpu]*PAGE_SIZE
+                                               + pagepool_zeroing_done[cpu]);
+        for (i = 0; i < PAGEPOOL_ZERO_CHUNK / 4; i += 4) {
+            word[i] = 0;
+            word[i+1] = 0;
+            word[i+2] = 0;
+            word[i+3] = 0;
+        }
+        pagepool_zeroing_done[cpu] += PAGEPOOL_ZERO_CHUNK;
+
+        if (pagepool_zeroing_done[cpu] == PAGE_SIZE) {
+            pagepool_zeroed[pagepool_num_zeroed++] = pagepool_zeroing[cpu];
+            pagepool_zeroing[cpu] = 0;
+            pagepool_num_zeroing--;
+        }
+
+        spinlock_release(&pagepool_slock);
+        _interrupt_set_state(intr_status);
+    }
+}
+
+/**
+ * Records the only mapping of a reserved user page, which makes the
+ * page a candidate for swapping out.
+ *
+ * @param phys_addr Page to be recorded.
+ *
+ * @param pagetable Pagetable mapping the page.
+ *
+ * @param vaddr Virtual address of the page in the pagetable.
+ */
+void pagepool_set_owner(uint32_t phys_addr,
+                        struct pagetable_struct_t *pagetable, uint32_t vaddr)
+{
+    interrupt_status_t intr_status;
+    int i;
+
+    i = phys_addr / PAGE_SIZE;
+    KERNEL_ASSERT(i >= pagepool_static_end);
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagepool_slock);
+
+    if (pagepool_refcounts[i] == 1) {
+        pagepool_owners[i].pagetable = pagetable;
+        pagepool_owners[i].vaddr = vaddr;
+    }
+
+    spinlock_release(&pagepool_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Returns the recorded mapping of a page. Must be called with
+ * interrupts disabled so that the pagetable stays valid until it has
+ * been used.
+ *
+ * @param phys_addr Page to be checked.
+ *
+ * @param owner Returns the pagetable and virtual address of the page.
+ *
+ * @return 1 if the page has an owner, 0 otherwise.
+ */
+int pagepool_get_owner(uint32_t phys_addr, pagepool_owner_t *owner)
+{
+    int i;
+
+    i = phys_addr / PAGE_SIZE;
+    if (i < pagepool_static_end || i >= pagepool_num_pages)
+        return 0;
+
+    spinlock_acquire(&pagepool_slock);
+    *owner = pagepool_owners[i];
+    spinlock_release(&pagepool_slock);
+
+    return owner->pagetable != NULL;
+}
+
+/**
+ * Reserves a physically contiguous run of free pages starting at a
+ * page number that is a multiple of the alignment. Every page of the
+ * run is reserved separately and may later be freed on its own. Pages
+ * in the pre-zeroed list are not used.
+ *
+ * @param count Number of pages in the run.
+ *
+ * @param align Alignment of the first page in pages, a power of two.
+ *
+ * @return Address of the first page of the run, zero if no such run
+ * is free.
+ */
+uint32_t pagepool_get_contiguous(int count, int align)
+{
+    interrupt_status_t intr_status;
+    int i, j, start;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagepool_slock);
+
+    start = 0;
+    if (count <= pagepool_num_free_pages) {
+        i = (pagepool_static_end + align - 1) & ~(align - 1);
+        for (; i + count <= pagepool_num_pages; i += align) {
+            for (j = 0; j < count; j++) {
+                if (bitmap_get(pagepool_free_pages, i + j))
+                    break;
+            }
+            if (j == count) {
+                start = i;
+                break;
+            }
+        }
+    }
+
+    for (j = 0; start != 0 && j < count; j++) {
+        bitmap_set(pagepool_free_pages, start + j, 1);
+        pagepool_refcounts[start + j] = 1;
+        pagepool_owners[start + j].pagetable = NULL;
+    }
+    if (start != 0)
+        pagepool_num_free_pages -= count;
+
+    spinlock_release(&pagepool_slock);
+    _interrupt_set_state(intr_status);
+    return start * PAGE_SIZE;
+}
+
+/**
+ * Returns the number of physical pages in the system.
+ */
+int pagepool_get_num_pages(void)
+{
+    return pagepool_num_pages;
+}
+
+/**
+ * Prints how many zeroed page requests were served from the list.
+ */
+void pagepool_print_stats(void)
+{
+    kprintf("Pagepool: zeroed pages: %d hits, %d misses, %d ready\n",
+            pagepool_zeroed_hits, pagepool_zeroed_misses,
+            pagepool_num_zeroed);
 }
 #endif
 
@@ -51,4 +51,25 @@ void pagepool_free_phys_page(uint32_t phys_addr);
 int pagepool_get_free_pages(void);
 #endif
 
+#ifdef CHANGED_5
+struct pagetable_struct_t;
+
+/* The single mapping of a user page */
+typedef struct {
+    struct pagetable_struct_t *pagetable;
+    uint32_t vaddr;
+} pagepool_owner_t;
+
+void pagepool_ref_phys_page(uint32_t phys_addr);
+int pagepool_get_refcount(uint32_t phys_addr);
+uint32_t pagepool_get_zeroed_phys_page(void);
+void pagepool_zero_idle(void);
+void pagepool_set_owner(uint32_t phys_addr,
+                        struct pagetable_struct_t *pagetable, uint32_t vaddr);
+int pagepool_get_owner(uint32_t phys_addr, pagepool_owner_t *owner);
+int pagepool_get_num_pages(void);
+uint32_t pagepool_get_contiguous(int count, int align);
+void pagepool_print_stats(void);
+#endif
+
 #endif /* BUENOS_VM_PAGEPOOL_H */
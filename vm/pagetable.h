@@ -39,11 +39,82 @@
 
 #include "lib/libc.h"
 #include "vm/tlb.h"
+#ifdef CHANGED_5
+#include "kernel/spinlock.h"
+#endif
 
 /* Number of mapping entries in one pagetable. This is the number
    of entries that fits on a single hardware memory page (4k). */
 #define PAGETABLE_ENTRIES 340
 
+#ifdef CHANGED_5
+/* Number of hash slots in a pagetable index. Must be a power of two
+   and clearly larger than PAGETABLE_ENTRIES to keep probe sequences
+   short. The TLB refill handler in vm/_tlb.S depends on this value. */
+#define PAGETABLE_INDEX_SLOTS 1024
+
+/* Maximum number of large page mappings in one pagetable. */
+#define PAGETABLE_LARGE_ENTRIES 16
+
+/* Large page mappings map a pair of 16k, 64k, 256k or 1M pages with a
+   single entry, selected by a size of 1, 2, 3 or 4. The pages of each
+   pair are physically contiguous and aligned to the page size. The
+   entries are kept apart from the 4k page pairs, which the TLB refill
+   handler does not expect to find them among. */
+#define PAGETABLE_LARGE_MAX_SIZE 4
+#define PAGETABLE_LARGE_PAGE_SIZE(size) ((uint32_t)4096 << (2 * (size)))
+/* Value of the CP0 PageMask register for given size */
+#define PAGETABLE_LARGE_PAGEMASK(size) (((1 << (2 * (size))) - 1) << 13)
+
+/* Lookup index of a pagetable. Lives on a physical page of its own,
+   because the pagetable page is full of hardware format entries. A
+   slot is selected by VPN2 modulo PAGETABLE_INDEX_SLOTS and collisions
+   are resolved by linear probing. Each used slot contains the byte
+   offset of the matching entry from the beginning of the pagetable,
+   which is never 0, so 0 marks a free slot. Entries are never removed
+   from a pagetable, so slots never need to be freed either. The rest
+   of the page holds software bits of the entries which have no room
+   in the hardware format, indexed like pagetable->entries. */
+typedef struct {
+    uint16_t slots[PAGETABLE_INDEX_SLOTS];
+    uint8_t flags[PAGETABLE_ENTRIES];
+    /* Large page mappings, see below. An entry is in use when its
+       size is not 0. */
+    tlb_entry_t large[PAGETABLE_LARGE_ENTRIES];
+    uint8_t large_size[PAGETABLE_LARGE_ENTRIES];
+    /* Serializes changes to the mappings of the pagetable, which the
+       threads of a process make on any CPU. */
+    spinlock_t slock;
+    /* Bit mask of the CPUs that have activated the pagetable and whose
+       TLB may hold its entries, see tlb_shootdown. */
+    uint32_t cpus;
+} pagetable_index_t;
+
+/* Software flags of a pagetable entry. The even (0) or odd (1) page of
+   the pair is shared copy-on-write: it is mapped read-only, but may be
+   written after it has been copied. */
+#define PAGETABLE_FLAG_COW0 0x01
+#define PAGETABLE_FLAG_COW1 0x02
+
+/* The even (0) or odd (1) page of the pair has been moved to swap.
+   The page is invalid and its PFN field holds the swap slot instead
+   of a physical page number. The D-bit still tells if the page is
+   writable. */
+#define PAGETABLE_FLAG_SWAP0 0x04
+#define PAGETABLE_FLAG_SWAP1 0x08
+
+/* The page pair is part of a large page mapping. Both pages are
+   invalid in the 4k entry. */
+#define PAGETABLE_FLAG_LARGE 0x10
+
+/* The even (0) or odd (1) page of the pair is writable but has not
+   been written since it was loaded. It is mapped read-only so that the
+   first write can be noticed, see vm_mark_written. Used to find the
+   pages of file mappings that must be written back. */
+#define PAGETABLE_FLAG_CLEAN0 0x20
+#define PAGETABLE_FLAG_CLEAN1 0x40
+#endif /* CHANGED_5 */
+
 /* A pagetable. This structure fits on one physical page (4k). */
 typedef struct pagetable_struct_t{
     /* Address space identifier. We use Thread Ids in Buenos. */
@@ -52,6 +123,13 @@ typedef struct pagetable_struct_t{
     uint32_t valid_count;
     /* Actual virtual memory mapping entries*/
     tlb_entry_t entries[PAGETABLE_ENTRIES];
+#ifdef CHANGED_5
+    /* VPN2 lookup index for the entries. The TLB refill handler
+       expects to find this pointer at offset 4088. */
+    pagetable_index_t *index;
+    /* ASID generation the ASID was allocated in, see tlb_activate. */
+    uint32_t asid_generation;
+#endif
 } pagetable_t;
 
 #endif /* BUENOS_VM_PAGETABLE_H */
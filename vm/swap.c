@@ -0,0 +1,623 @@
+/*
+ * swap.c
+ *
+ *  Paging of user pages to a swap disk.
+ */
+
+#ifdef CHANGED_5
+
+#include "vm/swap.h"
+#include "vm/vm.h"
+#include "vm/tlb.h"
+#include "vm/pagepool.h"
+#include "drivers/device.h"
+#include "drivers/gbd.h"
+#include "drivers/yams.h"
+#include "kernel/thread.h"
+#include "kernel/sleepq.h"
+#include "kernel/spinlock.h"
+#include "kernel/interrupt.h"
+#include "kernel/semaphore.h"
+#include "kernel/assert.h"
+#include "kernel/config.h"
+#include "lib/bitmap.h"
+#include "lib/libc.h"
+
+/* Smallest supported block size of the swap disk */
+#define SWAP_MIN_BLOCK_SIZE 128
+
+/* Block requests of one writeback batch */
+#define SWAP_MAX_REQUESTS (CONFIG_SWAP_BATCH * PAGE_SIZE / SWAP_MIN_BLOCK_SIZE)
+
+/* The swap disk, NULL if there is none */
+static gbd_t *swap_gbd;
+
+/* Number of page sized slots on the swap disk and disk blocks per slot */
+static uint32_t swap_num_slots;
+static uint32_t swap_blocks_per_page;
+
+/* Number of pagetable entries referring to each slot. A slot is free
+   when it has no references and it is not being written. A slot whose
+   write failed is bad and never used again. */
+static uint16_t swap_slot_refs[CONFIG_SWAP_MAX_SLOTS];
+static uint8_t swap_slot_busy[CONFIG_SWAP_MAX_SLOTS];
+static uint8_t swap_slot_bad[CONFIG_SWAP_MAX_SLOTS];
+
+/* Where the search for a free slot continues */
+static uint32_t swap_next_slot;
+
+/* Hand of the clock going round the physical pages and the reference
+   bits it keeps for them, on a page of their own. The bits are also
+   set by the threads paging in. */
+static uint32_t swap_clock_hand;
+static bitmap_t *swap_referenced;
+
+/* Set when the writeback thread should free pages. The thread sleeps
+   on this variable. */
+static int swap_wanted;
+
+/* Pages freed by the latest writeback pass. Threads waiting for free
+   pages sleep on this variable. */
+static int swap_last_freed;
+
+/* Protects the variables above */
+static spinlock_t swap_slock;
+
+/* Held by the writeback thread while it uses the pagetable owning a
+   page, so that the pagetable is not freed meanwhile (see
+   swap_release_pagetable). */
+static spinlock_t swap_scan_slock;
+
+/* Signaled once for every completed block write */
+static semaphore_t *swap_write_sem;
+
+/* Pages of the batch being written and the mappings they came from.
+   The pagetable is cleared if it is destroyed during the write, it is
+   protected by swap_scan_slock. */
+static struct {
+    uint32_t phys;
+    uint32_t slot;
+    pagetable_t *pagetable;
+    uint32_t vaddr;
+} swap_batch[CONFIG_SWAP_BATCH];
+static gbd_request_t swap_requests[SWAP_MAX_REQUESTS];
+
+/* Statistics */
+static uint32_t swap_pages_out;
+static uint32_t swap_pages_in;
+static uint32_t swap_write_errors;
+
+/**
+ * Reserves a free swap slot. Called with swap_slock held.
+ *
+ * @return The slot, or -1 if swap is full.
+ */
+static int swap_alloc_slot(void)
+{
+    uint32_t i, slot;
+
+    for (i = 0; i < swap_num_slots; i++) {
+        slot = (swap_next_slot + i) % swap_num_slots;
+        if (swap_slot_refs[slot] == 0 && !swap_slot_busy[slot] &&
+            !swap_slot_bad[slot]) {
+            swap_slot_refs[slot] = 1;
+            swap_next_slot = (slot + 1) % swap_num_slots;
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Adds a reference to a swap slot, when a pagetable containing pages
+ * in swap is copied.
+ *
+ * @param slot The slot.
+ */
+void swap_ref_slot(uint32_t slot)
+{
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&swap_slock);
+
+    KERNEL_ASSERT(slot < swap_num_slots && swap_slot_refs[slot] > 0 &&
+                  swap_slot_refs[slot] < 0xffff);
+    swap_slot_refs[slot]++;
+
+    spinlock_release(&swap_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Drops a reference to a swap slot. The slot can be reused when it has
+ * no references and its contents have been written.
+ *
+ * @param slot The slot.
+ */
+void swap_free_slot(uint32_t slot)
+{
+    interrupt_status_t intr_status;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&swap_slock);
+
+    KERNEL_ASSERT(slot < swap_num_slots && swap_slot_refs[slot] > 0);
+    swap_slot_refs[slot]--;
+
+    spinlock_release(&swap_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Waits until the writeback thread no longer uses given pagetable, and
+ * makes it forget the pages of the pagetable it is writing. Called by
+ * vm_destroy_pagetable after the pages of the pagetable have been
+ * freed, so that the thread cannot find the pagetable again.
+ *
+ * @param pagetable The pagetable to be freed.
+ */
+void swap_release_pagetable(pagetable_t *pagetable)
+{
+    interrupt_status_t intr_status;
+    int i;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&swap_scan_slock);
+    for (i = 0; i < CONFIG_SWAP_BATCH; i++) {
+        if (swap_batch[i].pagetable == pagetable)
+            swap_batch[i].pagetable = NULL;
+    }
+    spinlock_release(&swap_scan_slock);
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Reads or writes the blocks of one page. The requests are given the
+ * semaphore sem, a NULL semaphore makes the calls synchronous and
+ * then one request is reused for all blocks. Stops at the first
+ * request that fails.
+ *
+ * @return Number of requests that succeeded (or were submitted, when
+ * asynchronous), swap_blocks_per_page if all did.
+ */
+static uint32_t swap_transfer(gbd_request_t *requests, uint32_t slot,
+                              uint32_t phys, semaphore_t *sem, int write)
+{
+    gbd_request_t *req;
+    uint32_t i, block_size;
+    int ok;
+
+    block_size = PAGE_SIZE / swap_blocks_per_page;
+    for (i = 0; i < swap_blocks_per_page; i++) {
+        req = sem == NULL ? requests : requests + i;
+        req->block = slot * swap_blocks_per_page + i;
+        req->buf = phys + i * block_size;
+        req->sem = sem;
+        if (write)
+            ok = swap_gbd->write_block(swap_gbd, req);
+        else
+            ok = swap_gbd->read_block(swap_gbd, req);
+        if (!ok)
+            break;
+    }
+
+    return i;
+}
+
+/**
+ * Chooses pages to swap out with the clock algorithm and moves them to
+ * swap in their pagetables. A page is considered referenced if its
+ * mapping is found in the TLB when the clock passes it, and it is
+ * given a second chance on the next round. Only the TLB of the current
+ * CPU is looked at, so pages used on the other CPUs just get fewer
+ * second chances. The mappings are shot down on all CPUs, and the
+ * caller must call tlb_shootdown_wait before writing the pages. Must
+ * be called with interrupts disabled.
+ *
+ * @return Number of pages in swap_batch.
+ */
+static int swap_choose_victims(void)
+{
+    pagepool_owner_t owner;
+    tlb_entry_t *entry;
+    uint32_t num_pages, page, phys, scanned;
+    int n, slot, ok, referenced;
+
+    n = 0;
+    num_pages = pagepool_get_num_pages();
+    for (scanned = 0; scanned < 2 * num_pages && n < CONFIG_SWAP_BATCH;
+         scanned++) {
+        page = swap_clock_hand;
+        swap_clock_hand = (swap_clock_hand + 1) % num_pages;
+        phys = page * PAGE_SIZE;
+
+        // the owner is only valid while the pagetable cannot be freed
+        spinlock_acquire(&swap_scan_slock);
+        entry = NULL;
+        if (pagepool_get_owner(phys, &owner))
+            entry = vm_get_entry_by_vaddr(owner.pagetable, owner.vaddr);
+        if (entry == NULL) {
+            spinlock_release(&swap_scan_slock);
+            continue;
+        }
+
+        referenced = _tlb_probe(entry) >= 0;
+        spinlock_acquire(&swap_slock);
+        if (!referenced && bitmap_get(swap_referenced, page)) {
+            bitmap_set(swap_referenced, page, 0);
+            referenced = 1;
+        } else if (referenced) {
+            bitmap_set(swap_referenced, page, 1);
+        }
+        slot = referenced ? 0 : swap_alloc_slot();
+        spinlock_release(&swap_slock);
+        if (referenced || slot < 0) {
+            spinlock_release(&swap_scan_slock);
+            if (slot < 0)
+                break;
+            continue;
+        }
+
+        // fails if the page was unmapped or freed after the lookup
+        ok = vm_swap_out(owner.pagetable, owner.vaddr, phys, slot);
+        spinlock_release(&swap_scan_slock);
+        spinlock_acquire(&swap_slock);
+        if (ok)
+            swap_slot_busy[slot] = 1;
+        else
+            swap_slot_refs[slot] = 0;
+        spinlock_release(&swap_slock);
+        if (!ok)
+            continue;
+
+        swap_batch[n].phys = phys;
+        swap_batch[n].slot = slot;
+        swap_batch[n].pagetable = owner.pagetable;
+        swap_batch[n].vaddr = owner.vaddr;
+        n++;
+    }
+
+    return n;
+}
+
+/**
+ * Puts a page whose write failed back into its pagetable, if the
+ * pagetable still has it in the slot, and marks the slot bad. Other
+ * pagetables sharing the slot after a fork can no longer read the page
+ * from swap. Must be called with interrupts disabled.
+ *
+ * @param i Index of the page in swap_batch.
+ *
+ * @return 1 if the page is mapped again, 0 if it can be freed.
+ */
+static int swap_restore_page(int i)
+{
+    int restored = 0;
+
+    spinlock_acquire(&swap_scan_slock);
+    if (swap_batch[i].pagetable != NULL)
+        restored = vm_swap_in(swap_batch[i].pagetable, swap_batch[i].vaddr,
+                              swap_batch[i].slot, swap_batch[i].phys);
+    spinlock_release(&swap_scan_slock);
+
+    spinlock_acquire(&swap_slock);
+    // the reference of the restored mapping
+    if (restored)
+        swap_slot_refs[swap_batch[i].slot]--;
+    swap_slot_bad[swap_batch[i].slot] = 1;
+    swap_write_errors++;
+    spinlock_release(&swap_slock);
+
+    return restored;
+}
+
+/**
+ * Writes a batch of pages to swap and frees them. A page that could
+ * not be written is mapped again instead (see swap_restore_page).
+ *
+ * @return Number of pages freed.
+ */
+static int swap_write_batch(void)
+{
+    interrupt_status_t intr_status;
+    uint32_t submitted[CONFIG_SWAP_BATCH];
+    uint32_t j;
+    int i, n, freed, failed;
+
+    intr_status = _interrupt_disable();
+    n = swap_choose_victims();
+    tlb_shootdown_wait();
+    _interrupt_set_state(intr_status);
+
+    /* The pages are no longer mapped, so they do not change while the
+       disk writes them. */
+    for (i = 0; i < n; i++) {
+        submitted[i] = swap_transfer(swap_requests + i * swap_blocks_per_page,
+                                     swap_batch[i].slot, swap_batch[i].phys,
+                                     swap_write_sem, 1);
+    }
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < submitted[i]; j++) {
+            semaphore_P(swap_write_sem);
+        }
+    }
+
+    freed = 0;
+    intr_status = _interrupt_disable();
+    for (i = 0; i < n; i++) {
+        failed = submitted[i] < swap_blocks_per_page;
+        for (j = 0; j < submitted[i]; j++) {
+            if (swap_requests[i * swap_blocks_per_page + j].return_value != 0)
+                failed = 1;
+        }
+        if (failed && swap_restore_page(i))
+            continue;
+        pagepool_free_phys_page(swap_batch[i].phys);
+        if (!failed)
+            freed++;
+    }
+
+    spinlock_acquire(&swap_slock);
+    for (i = 0; i < n; i++) {
+        swap_slot_busy[swap_batch[i].slot] = 0;
+    }
+    swap_pages_out += freed;
+    sleepq_wake_all(swap_slot_busy);
+    spinlock_release(&swap_slock);
+    _interrupt_set_state(intr_status);
+
+    return freed;
+}
+
+/**
+ * The writeback thread. Keeps at least CONFIG_SWAP_LOW_PAGES pages
+ * free by writing pages to swap ahead of the allocations needing them.
+ */
+static void swap_writeback_thread(uint32_t arg)
+{
+    interrupt_status_t intr_status;
+    int freed, n;
+
+    arg = arg;
+    while (1) {
+        intr_status = _interrupt_disable();
+        spinlock_acquire(&swap_slock);
+        while (!swap_wanted) {
+            sleepq_add(&swap_wanted);
+            spinlock_release(&swap_slock);
+            thread_switch();
+            spinlock_acquire(&swap_slock);
+        }
+        swap_wanted = 0;
+        spinlock_release(&swap_slock);
+        _interrupt_set_state(intr_status);
+
+        freed = 0;
+        do {
+            n = swap_write_batch();
+            freed += n;
+        } while (n > 0 && pagepool_get_free_pages() < CONFIG_SWAP_HIGH_PAGES);
+
+        intr_status = _interrupt_disable();
+        spinlock_acquire(&swap_slock);
+        swap_last_freed = freed;
+        sleepq_wake_all(&swap_last_freed);
+        spinlock_release(&swap_slock);
+        _interrupt_set_state(intr_status);
+    }
+}
+
+/**
+ * Wakes up the writeback thread. Called with swap_slock held.
+ */
+static void swap_wake_writeback(void)
+{
+    swap_wanted = 1;
+    sleepq_wake(&swap_wanted);
+}
+
+/**
+ * Finds the swap disk and starts the writeback thread. Without a swap
+ * disk the system runs without paging.
+ */
+void swap_init(void)
+{
+    device_t *dev;
+    gbd_t *gbd;
+    uint32_t block_size, page;
+    TID_t tid;
+
+    spinlock_reset(&swap_slock);
+    spinlock_reset(&swap_scan_slock);
+
+    dev = device_get(YAMS_TYPECODE_DISK, CONFIG_SWAP_DISK);
+    if (dev == NULL || dev->generic_device == NULL) {
+        kprintf("Swap: No swap disk found, paging disabled\n");
+        return;
+    }
+    gbd = (gbd_t *)dev->generic_device;
+
+    block_size = gbd->block_size(gbd);
+    if (block_size < SWAP_MIN_BLOCK_SIZE || PAGE_SIZE % block_size != 0) {
+        kprintf("Swap: Unsupported block size %d, paging disabled\n",
+                block_size);
+        return;
+    }
+    swap_blocks_per_page = PAGE_SIZE / block_size;
+    swap_num_slots = gbd->total_blocks(gbd) / swap_blocks_per_page;
+    if (swap_num_slots > CONFIG_SWAP_MAX_SLOTS)
+        swap_num_slots = CONFIG_SWAP_MAX_SLOTS;
+
+    KERNEL_ASSERT(pagepool_get_num_pages() <= PAGE_SIZE * 8);
+    page = pagepool_get_zeroed_phys_page();
+    swap_write_sem = semaphore_create(0);
+    KERNEL_ASSERT(page != 0 && swap_write_sem != NULL);
+    swap_referenced = (bitmap_t *)ADDR_PHYS_TO_KERNEL(page);
+
+    swap_clock_hand = 0;
+    swap_next_slot = 0;
+    swap_wanted = 0;
+    swap_last_freed = 0;
+    swap_pages_out = 0;
+    swap_pages_in = 0;
+    memoryset(swap_slot_refs, 0, sizeof(swap_slot_refs));
+    memoryset(swap_slot_busy, 0, sizeof(swap_slot_busy));
+    memoryset(swap_slot_bad, 0, sizeof(swap_slot_bad));
+    memoryset(swap_batch, 0, sizeof(swap_batch));
+    swap_write_errors = 0;
+
+    tid = thread_create(&swap_writeback_thread, 0);
+    KERNEL_ASSERT(tid >= 0);
+    thread_run(tid);
+
+    swap_gbd = gbd;
+    kprintf("Swap: %d pages on disk %d\n", swap_num_slots, CONFIG_SWAP_DISK);
+}
+
+/**
+ * Waits until the writeback thread has freed pages. Must not be called
+ * from interrupt handlers or with spinlocks held.
+ *
+ * @return 1 if pages were freed, 0 if there is no swap or nothing could
+ * be swapped out.
+ */
+int swap_wait_for_pages(void)
+{
+    interrupt_status_t intr_status;
+    int freed;
+
+    if (swap_gbd == NULL)
+        return 0;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&swap_slock);
+
+    swap_wake_writeback();
+    sleepq_add(&swap_last_freed);
+    spinlock_release(&swap_slock);
+    thread_switch();
+    spinlock_acquire(&swap_slock);
+    freed = swap_last_freed;
+
+    spinlock_release(&swap_slock);
+    _interrupt_set_state(intr_status);
+
+    return freed > 0;
+}
+
+/**
+ * Reserves a page for user memory. If no pages are free, waits for
+ * pages to be swapped out. Must not be called from interrupt handlers
+ * or with spinlocks held.
+ *
+ * @param zeroed 1 if the page must be filled with zeroes.
+ *
+ * @return Address of the page, zero if no page could be freed.
+ */
+uint32_t swap_get_page(int zeroed)
+{
+    interrupt_status_t intr_status;
+    uint32_t phys;
+
+    while (1) {
+        if (zeroed)
+            phys = pagepool_get_zeroed_phys_page();
+        else
+            phys = pagepool_get_phys_page();
+
+        if (swap_gbd != NULL &&
+            pagepool_get_free_pages() < CONFIG_SWAP_LOW_PAGES) {
+            intr_status = _interrupt_disable();
+            spinlock_acquire(&swap_slock);
+            swap_wake_writeback();
+            spinlock_release(&swap_slock);
+            _interrupt_set_state(intr_status);
+        }
+
+        if (phys != 0 || !swap_wait_for_pages())
+            return phys;
+    }
+}
+
+/**
+ * Reads a page of the pagetable back from swap and maps it, if the
+ * page is in swap. Must be called with interrupts disabled, but the
+ * calling thread must be able to sleep. Interrupts are enabled while
+ * the page is read.
+ *
+ * @param pagetable The pagetable of the current thread.
+ *
+ * @param vaddr Faulting virtual address.
+ *
+ * @return 1 if the page is mapped again, 0 if it was not in swap, -1 if
+ * it could not be read.
+ */
+int swap_page_in(pagetable_t *pagetable, uint32_t vaddr)
+{
+    gbd_request_t request;
+    uint32_t page, slot, phys, current;
+    int ok, bad;
+
+    page = vaddr & PAGE_SIZE_MASK;
+    if (!vm_get_swap_slot(pagetable, page, &slot))
+        return 0;
+
+    _interrupt_enable();
+    phys = swap_get_page(0);
+    _interrupt_disable();
+    if (phys == 0)
+        return -1;
+
+    /* A page still being written has to reach the disk first */
+    spinlock_acquire(&swap_slock);
+    while (swap_slot_busy[slot]) {
+        sleepq_add(swap_slot_busy);
+        spinlock_release(&swap_slock);
+        thread_switch();
+        spinlock_acquire(&swap_slock);
+    }
+    bad = swap_slot_bad[slot];
+    spinlock_release(&swap_slock);
+
+    /* The write failed: the page is mapped again if this pagetable had
+       it, otherwise it is lost. */
+    if (bad) {
+        pagepool_free_phys_page(phys);
+        return vm_get_swap_slot(pagetable, page, &current) && current == slot
+            ? -1 : 1;
+    }
+
+    _interrupt_enable();
+    ok = swap_transfer(&request, slot, phys, NULL, 0) == swap_blocks_per_page;
+    _interrupt_disable();
+
+    /* The page may have been unmapped while it was read, in which case
+       the slot may even hold some other page by now. */
+    if (!ok || !vm_swap_in(pagetable, page, slot, phys)) {
+        pagepool_free_phys_page(phys);
+        return ok ? 1 : -1;
+    }
+    swap_free_slot(slot);
+    swap_pages_in++;
+
+    pagepool_set_owner(phys, pagetable, page);
+    spinlock_acquire(&swap_slock);
+    bitmap_set(swap_referenced, phys / PAGE_SIZE, 1);
+    spinlock_release(&swap_slock);
+    tlb_write_entry(vm_get_entry_by_vaddr(pagetable, page));
+    return 1;
+}
+
+/**
+ * Prints the number of pages moved to and from swap.
+ */
+void swap_print_stats(void)
+{
+    if (swap_gbd != NULL)
+        kprintf("Swap: %d pages written, %d pages read, %d write errors\n",
+                swap_pages_out, swap_pages_in, swap_write_errors);
+}
+
+#endif /* CHANGED_5 */
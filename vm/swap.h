@@ -0,0 +1,29 @@
+/*
+ * swap.h
+ *
+ *  Paging of user pages to a swap disk.
+ */
+
+#ifndef BUENOS_VM_SWAP_H
+#define BUENOS_VM_SWAP_H
+
+#ifdef CHANGED_5
+
+#include "lib/types.h"
+#include "vm/pagetable.h"
+
+void swap_init(void);
+
+uint32_t swap_get_page(int zeroed);
+int swap_wait_for_pages(void);
+int swap_page_in(pagetable_t *pagetable, uint32_t vaddr);
+
+void swap_ref_slot(uint32_t slot);
+void swap_free_slot(uint32_t slot);
+void swap_release_pagetable(pagetable_t *pagetable);
+
+void swap_print_stats(void);
+
+#endif /* CHANGED_5 */
+
+#endif /* BUENOS_VM_SWAP_H */
@@ -46,6 +46,80 @@
 #   include "proc/syscall.h"
 #endif
 
+#ifdef CHANGED_5
+#   include "kernel/config.h"
+#   include "kernel/cswitch.h"
+#   include "kernel/spinlock.h"
+#   include "proc/process.h"
+#   include "vm/swap.h"
+#   include "drivers/device.h"
+#   include "drivers/metadev.h"
+#   include "drivers/yams.h"
+
+/* TLB refill exception vector (used when EXL is not set) */
+#define TLB_REFILL_VECTOR_ADDRESS 0x80000000
+#define TLB_REFILL_VECTOR_LENGTH  8
+
+/* Per-CPU save area of the assembler refill handler _tlb_refill in
+   vm/_tlb.S. The handler frees registers t0-t2 by storing them here
+   and counts the refills it completes. The layout (16 bytes per CPU)
+   is hard-coded in the handler. */
+typedef struct {
+    uint32_t saved_regs[3];
+    uint32_t fast_refills;
+} tlb_refill_area_t;
+
+tlb_refill_area_t tlb_refill_area[CONFIG_MAX_CPUS];
+
+/* Counters for the exceptions handled in C, indexed by CPU. */
+static tlb_stats_t tlb_stats[CONFIG_MAX_CPUS];
+
+/* Number of ASIDs in the hardware. ASID 0 is never allocated. */
+#define TLB_ASID_COUNT 256
+
+/* ASIDs are allocated in increasing order within a generation, so the
+   TLB never holds stale entries of an ASID that is allocated again.
+   When they run out, a new generation begins, and every CPU flushes its
+   TLB the next time it activates a pagetable. */
+static uint32_t tlb_asid_generation;
+static uint32_t tlb_next_asid;
+
+/* Generation whose ASIDs the TLB of each CPU may hold */
+static uint32_t tlb_cpu_generation[CONFIG_MAX_CPUS];
+static spinlock_t tlb_asid_slock;
+
+/* Number of entries that may wait to be invalidated on a CPU. When
+   more are posted, the CPU flushes its whole TLB instead. */
+#define TLB_SHOOTDOWN_ENTRIES 16
+
+/* Invalidations posted to a CPU by the other CPUs, see tlb_shootdown.
+   The CPU handles them when it activates a pagetable and, if it may be
+   using the pagetable of the entries right now, as soon as it gets
+   an inter-CPU interrupt. */
+typedef struct {
+    spinlock_t slock;
+    /* The pagetable the CPU activated last */
+    pagetable_t *current;
+    /* Entries to invalidate, or the whole TLB if flush is set */
+    int count;
+    int flush;
+    tlb_entry_t entries[TLB_SHOOTDOWN_ENTRIES];
+    /* Number of interrupts requested from the CPU and the request
+       number when it last handled the mailbox */
+    volatile uint32_t requested;
+    volatile uint32_t handled;
+} tlb_mailbox_t;
+
+static tlb_mailbox_t tlb_mailboxes[CONFIG_MAX_CPUS];
+
+/* Request that each CPU (first index) waits for each other CPU to
+   handle, 0 if none. */
+static uint32_t tlb_shootdown_waits[CONFIG_MAX_CPUS][CONFIG_MAX_CPUS];
+
+/* Status devices of the CPUs, which raise the inter-CPU interrupts */
+static device_t *tlb_cpu_devices[CONFIG_MAX_CPUS];
+#endif /* CHANGED_5 */
+
 
 #ifdef CHANGED_4
 
@@ -54,6 +128,20 @@
 #endif
 
 static void kill() {
+#ifdef CHANGED_5
+    context_t *context;
+
+    tlb_stats[_interrupt_getcpu()].faults++;
+    // a bad address given to a system call fails the copy from or to
+    // user memory instead, see proc/_user_copy.S
+    context = thread_get_current_thread_entry()->context;
+    if (!(context->status & USERLAND_ENABLE_BIT) &&
+            context->pc >= (uint32_t)_user_copy_start &&
+            context->pc < (uint32_t)_user_copy_end) {
+        context->pc = (uint32_t)_user_copy_fault;
+        return;
+    }
+#endif
     kprintf("KILL!\n");
     if (thread_get_current_thread_entry()->pagetable != NULL) {
         // process
@@ -68,6 +156,9 @@ static int try_to_fill(int check_dirty) {
     pagetable_t* pagetable;
     tlb_entry_t* entry;
     tlb_exception_state_t state;
+#ifdef CHANGED_5
+    int size;
+#endif
     _tlb_get_exception_state(&state);
 
     pagetable = thread_get_current_thread_entry()->pagetable;
@@ -81,7 +172,13 @@ static int try_to_fill(int check_dirty) {
             if (entry->V0 == 1 && (!check_dirty || entry->D0 == 1)) {
                 // address is inside active page that has D-bit enabled
                 // --> we can fill proper entry to TLB and try again
+#ifdef CHANGED_5
+                // the refill handler may already have put the entry
+                // into TLB, don't create a duplicate
+                tlb_write_entry(entry);
+#else
                 _tlb_write_random(entry);
+#endif
                 _tlb_set_asid(pagetable->ASID);
                 return 1;
             }
@@ -89,26 +186,102 @@ static int try_to_fill(int check_dirty) {
             if (entry->V1 == 1 && (!check_dirty || entry->D1 == 1)) {
                 // address is inside active page that has D-bit enabled
                 // --> we can fill proper entry to TLB and try again
+#ifdef CHANGED_5
+                tlb_write_entry(entry);
+#else
                 _tlb_write_random(entry);
+#endif
                 _tlb_set_asid(pagetable->ASID);
                 return 1;
             }
         }
+#ifdef CHANGED_5
+        // the pair is part of a large page
+        size = vm_get_large_entry(pagetable, state.badvaddr, &entry);
+        if (size > 0 && (!check_dirty || entry->D0 == 1)) {
+            tlb_write_large_entry(entry, PAGETABLE_LARGE_PAGEMASK(size),
+                                  state.badvaddr);
+            _tlb_set_asid(pagetable->ASID);
+            return 1;
+        }
+#endif
     }
     return 0;
 }
 
+#ifdef CHANGED_5
+/* Address is not mapped at all, it may still be a page of the process
+   that has not been loaded yet. */
+static int try_to_page_in(int write) {
+    tlb_exception_state_t state;
+    _tlb_get_exception_state(&state);
+
+    if (thread_get_current_thread_entry()->pagetable == NULL)
+        return 0;
+    return process_handle_page_fault(state.badvaddr, write);
+}
+
+/* Write to a read-only page, which may be shared copy-on-write or
+   write-protected to notice that it is written. */
+static int try_copy_on_write(void) {
+    thread_table_t* thread;
+    pagetable_t* pagetable;
+    tlb_exception_state_t state;
+    int ret, ok;
+    _tlb_get_exception_state(&state);
+
+    thread = thread_get_current_thread_entry();
+    pagetable = thread->pagetable;
+    if (pagetable == NULL)
+        return 0;
+    // first write to a clean page of a file mapping
+    if (vm_mark_written(pagetable, state.badvaddr)) {
+        _tlb_set_asid(pagetable->ASID);
+        return 1;
+    }
+    // out of memory for the copy, wait for pages to be swapped out
+    // if the faulting code may sleep
+    while ((ret = vm_copy_on_write(pagetable, state.badvaddr)) < 0) {
+        if (!(thread->context->status & INTERRUPT_MASK_MASTER))
+            return 0;
+        _interrupt_enable();
+        ok = swap_wait_for_pages();
+        _interrupt_disable();
+        if (!ok)
+            return 0;
+    }
+    if (ret == 0)
+        return 0;
+    _tlb_set_asid(pagetable->ASID);
+    return 1;
+}
+#endif
+
 void tlb_modified_exception(void)
 {
     // nothing to do
     //kprintf("MODIFIED\n");
+#ifdef CHANGED_5
+    tlb_stats[_interrupt_getcpu()].modified_exceptions++;
+    // another CPU may have made the page writable after this TLB got
+    // the read-only entry
+    if (try_to_fill(1) || try_copy_on_write())
+        return;
+#endif
     kill();
 }
 
 void tlb_load_exception(void)
 {
     //kprintf("LOAD\n");
+#ifdef CHANGED_5
+    tlb_stats[_interrupt_getcpu()].load_exceptions++;
+#endif
+#ifdef CHANGED_5
+    if (!try_to_fill(0) && !try_to_page_in(0)) {
+#else
     if (!try_to_fill(0)) {
+#endif
         // there is no way to correct TLB --> terminate thread / exit process
         kill();
     }
@@ -117,7 +290,14 @@ void tlb_load_exception(void)
 void tlb_store_exception(void)
 {
     //kprintf("STORE\n");
+#ifdef CHANGED_5
+    tlb_stats[_interrupt_getcpu()].store_exceptions++;
+#endif
+#ifdef CHANGED_5
+    if (!try_to_fill(1) && !try_copy_on_write() && !try_to_page_in(1)) {
+#else
     if (!try_to_fill(1)) {
+#endif
         // there is no way to correct TLB --> terminate thread / exit process
         kill();
     }
@@ -199,3 +379,426 @@ void tlb_write_if_not_exists(tlb_entry_t* entry) {
 }
 
 #endif /* CHANGED_4 */
+
+
+#ifdef CHANGED_5
+
+/**
+ * Installs the TLB refill handler. Called once from vm_init().
+ */
+void tlb_init(void)
+{
+    int i;
+
+    /* The refill handler in vm/_tlb.S indexes this table with
+       CPU number * 16. */
+    KERNEL_ASSERT(sizeof(tlb_refill_area_t) == 16);
+
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+        tlb_refill_area[i].fast_refills = 0;
+        tlb_cpu_generation[i] = 1;
+        memoryset(&tlb_mailboxes[i], 0, sizeof(tlb_mailbox_t));
+        spinlock_reset(&tlb_mailboxes[i].slock);
+        tlb_cpu_devices[i] = device_get(YAMS_TYPECODE_CPUSTATUS + i, 0);
+    }
+    memoryset(tlb_shootdown_waits, 0, sizeof(tlb_shootdown_waits));
+    tlb_reset_stats();
+
+    /* Pagetables start in generation 0 without an ASID */
+    tlb_asid_generation = 1;
+    tlb_next_asid = 1;
+    spinlock_reset(&tlb_asid_slock);
+
+    tlb_set_fast_refill(1);
+}
+
+/**
+ * Selects the code in the TLB refill exception vector. The fast
+ * handler _tlb_refill walks the pagetable of the running thread in
+ * assembler and enters the C handlers only when the page pair is not
+ * in the pagetable. Otherwise every refill goes through the generic
+ * exception path to tlb_load_exception() or tlb_store_exception().
+ *
+ * @param enabled 1 to use the fast refill handler, 0 to use the
+ * generic exception path.
+ */
+void tlb_set_fast_refill(int enabled)
+{
+    uint32_t *vector = (uint32_t *)TLB_REFILL_VECTOR_ADDRESS;
+    uint32_t *code;
+    interrupt_status_t intr_status;
+    int i;
+
+    if (enabled)
+        code = (uint32_t *)&_tlb_refill_vector_code;
+    else
+        code = (uint32_t *)&_cswitch_vector_code;
+
+    intr_status = _interrupt_disable();
+    for (i = 0; i < TLB_REFILL_VECTOR_LENGTH; i++) {
+        vector[i] = code[i];
+    }
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Invalidates all entries of the TLB of the current CPU. Each entry is
+ * given a different VPN2 in the unmapped kernel segment, so that none
+ * of them can match an address.
+ */
+void tlb_flush(void)
+{
+    tlb_entry_t entry;
+    interrupt_status_t st;
+    uint32_t i;
+
+    memoryset(&entry, 0, sizeof(tlb_entry_t));
+    st = _interrupt_disable();
+    for (i = 0; i <= _tlb_get_maxindex(); i++) {
+        entry.VPN2 = (0x80000000 >> 13) + i;
+        _tlb_write(&entry, i, 1);
+    }
+    _interrupt_set_state(st);
+}
+
+/**
+ * Invalidates the entries posted to the mailbox of a CPU, or its whole
+ * TLB if too many were posted. Must be called on that CPU with
+ * interrupts disabled.
+ *
+ * @param cpu The current CPU.
+ */
+static void tlb_handle_mailbox(int cpu)
+{
+    tlb_mailbox_t *mailbox = &tlb_mailboxes[cpu];
+    uint32_t asid;
+    int i;
+
+    spinlock_acquire(&mailbox->slock);
+    // probing and writing the TLB changes the ASID
+    asid = _tlb_get_asid();
+    if (mailbox->flush) {
+        tlb_flush();
+        // the pagetable may have been given a new ASID
+        if (mailbox->current != NULL)
+            asid = mailbox->current->ASID;
+    } else {
+        for (i = 0; i < mailbox->count; i++) {
+            tlb_invalidate_entry(&mailbox->entries[i]);
+        }
+    }
+    mailbox->count = 0;
+    mailbox->flush = 0;
+    mailbox->handled = mailbox->requested;
+    _tlb_set_asid(asid);
+    spinlock_release(&mailbox->slock);
+}
+
+/**
+ * Posts an entry to be invalidated to the mailbox of another CPU, and
+ * interrupts the CPU if it may be using the pagetable right now. Must
+ * be called with interrupts disabled and the lock of the pagetable
+ * held.
+ *
+ * @param cpu The CPU to post to.
+ *
+ * @param pagetable The pagetable of the entry.
+ *
+ * @param entry The entry to invalidate, NULL to flush the whole TLB.
+ */
+static void tlb_post(int cpu, pagetable_t *pagetable, tlb_entry_t *entry)
+{
+    tlb_mailbox_t *mailbox = &tlb_mailboxes[cpu];
+    int interrupt = 0;
+
+    spinlock_acquire(&mailbox->slock);
+    if (entry != NULL && mailbox->count < TLB_SHOOTDOWN_ENTRIES) {
+        mailbox->entries[mailbox->count++] = *entry;
+    } else {
+        mailbox->flush = 1;
+    }
+    if (mailbox->current == pagetable) {
+        // a request not handled yet has its interrupt coming
+        interrupt = mailbox->handled == mailbox->requested;
+        tlb_shootdown_waits[_interrupt_getcpu()][cpu] = ++mailbox->requested;
+    }
+    spinlock_release(&mailbox->slock);
+
+    if (interrupt)
+        cpustatus_generate_irq(tlb_cpu_devices[cpu]);
+}
+
+/**
+ * Removes an entry of a pagetable from the TLB of every CPU that may
+ * hold it. Called when a mapping is removed or loses rights, after the
+ * pagetable has been changed. The local TLB is updated right away and
+ * the other CPUs are sent the entry, but their TLB may hold the old
+ * entry until tlb_shootdown_wait returns. Must be called with
+ * interrupts disabled and the lock of the pagetable held.
+ *
+ * @param pagetable The pagetable of the entry.
+ *
+ * @param entry The entry to invalidate.
+ */
+void tlb_shootdown(pagetable_t *pagetable, tlb_entry_t *entry)
+{
+    int cpu, i;
+
+    tlb_invalidate_entry(entry);
+
+    cpu = _interrupt_getcpu();
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+        if (i != cpu && (pagetable->index->cpus & (1 << i)))
+            tlb_post(i, pagetable, entry);
+    }
+}
+
+/**
+ * Waits until the CPUs sent entries with tlb_shootdown by the current
+ * CPU have removed them from their TLB. Pages and swap slots of the
+ * removed mappings may be reused after this. Must be called with
+ * interrupts disabled and no spinlocks held. Invalidations posted to
+ * this CPU meanwhile are handled while waiting, since their sender may
+ * be waiting for this CPU in turn.
+ */
+void tlb_shootdown_wait(void)
+{
+    tlb_mailbox_t *mine;
+    uint32_t *waits;
+    int cpu, i;
+
+    cpu = _interrupt_getcpu();
+    mine = &tlb_mailboxes[cpu];
+    waits = tlb_shootdown_waits[cpu];
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+        while (waits[i] != 0 &&
+               (int)(tlb_mailboxes[i].handled - waits[i]) < 0) {
+            if (mine->handled != mine->requested)
+                tlb_handle_mailbox(cpu);
+        }
+        waits[i] = 0;
+    }
+}
+
+/**
+ * Handles the inter-CPU interrupt raised by tlb_shootdown. Called from
+ * the interrupt handler of the CPU status device.
+ */
+void tlb_shootdown_interrupt(void)
+{
+    tlb_handle_mailbox(_interrupt_getcpu());
+}
+
+/**
+ * Forgets a pagetable that is being destroyed, so that no CPU is
+ * interrupted for it later.
+ *
+ * @param pagetable The pagetable.
+ */
+void tlb_release_pagetable(pagetable_t *pagetable)
+{
+    interrupt_status_t st;
+    int i;
+
+    st = _interrupt_disable();
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+        spinlock_acquire(&tlb_mailboxes[i].slock);
+        if (tlb_mailboxes[i].current == pagetable)
+            tlb_mailboxes[i].current = NULL;
+        spinlock_release(&tlb_mailboxes[i].slock);
+    }
+    _interrupt_set_state(st);
+}
+
+/**
+ * Makes given pagetable the address space of the current CPU. A
+ * pagetable whose ASID is from an older generation is given a new
+ * ASID, and its entries are updated to match. All threads using the
+ * pagetable share its ASID, so the other CPUs that may be running the
+ * pagetable are told to flush their TLB and switch to the new ASID.
+ *
+ * When the ASIDs run out, a new generation begins. A CPU whose TLB
+ * may still hold ASIDs of an older generation flushes it here, before
+ * it uses an ASID that may have been given out again. Invalidations
+ * posted to the CPU by tlb_shootdown are handled here as well.
+ *
+ * @param pagetable The pagetable to activate.
+ */
+void tlb_activate(pagetable_t *pagetable)
+{
+    tlb_mailbox_t *mailbox;
+    interrupt_status_t st;
+    uint32_t i;
+    int cpu;
+
+    st = _interrupt_disable();
+    cpu = _interrupt_getcpu();
+    spinlock_acquire(&tlb_asid_slock);
+    spinlock_acquire(&pagetable->index->slock);
+
+    if (pagetable->asid_generation != tlb_asid_generation) {
+        if (tlb_next_asid == TLB_ASID_COUNT) {
+            tlb_asid_generation++;
+            tlb_next_asid = 1;
+            tlb_stats[cpu].asid_rollovers++;
+        }
+        pagetable->ASID = tlb_next_asid++;
+        pagetable->asid_generation = tlb_asid_generation;
+        for (i = 0; i < pagetable->valid_count; i++) {
+            pagetable->entries[i].ASID = pagetable->ASID;
+        }
+        for (i = 0; i < PAGETABLE_LARGE_ENTRIES; i++) {
+            pagetable->index->large[i].ASID = pagetable->ASID;
+        }
+        for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+            if ((int)i != cpu && (pagetable->index->cpus & (1 << i)))
+                tlb_post(i, pagetable, NULL);
+        }
+    }
+    pagetable->index->cpus |= 1 << cpu;
+    if (tlb_cpu_generation[cpu] != tlb_asid_generation) {
+        tlb_flush();
+        tlb_cpu_generation[cpu] = tlb_asid_generation;
+    }
+
+    spinlock_release(&pagetable->index->slock);
+    spinlock_release(&tlb_asid_slock);
+
+    // entries posted before this are handled below, later ones
+    // interrupt the CPU
+    mailbox = &tlb_mailboxes[cpu];
+    spinlock_acquire(&mailbox->slock);
+    mailbox->current = pagetable;
+    spinlock_release(&mailbox->slock);
+    tlb_handle_mailbox(cpu);
+
+    _tlb_set_asid(pagetable->ASID);
+    _interrupt_set_state(st);
+}
+
+void tlb_write_entry(tlb_entry_t *entry)
+{
+    int index;
+    interrupt_status_t st;
+
+    st = _interrupt_disable();
+    index = _tlb_probe(entry);
+    if (index >= 0) {
+        _tlb_write(entry, index, 1);
+    } else {
+        _tlb_write_random(entry);
+    }
+    _interrupt_set_state(st);
+}
+
+/**
+ * Writes a large page entry into TLB. The refill handler does not
+ * load the invalid 4k entries of a large page, but a row left for the
+ * missed page pair is still replaced, so that no two TLB rows match
+ * the same address.
+ *
+ * @param entry The large page entry.
+ *
+ * @param pagemask PageMask register value for the size of the pages.
+ *
+ * @param vaddr The missed address.
+ */
+void tlb_write_large_entry(tlb_entry_t *entry, uint32_t pagemask,
+                           uint32_t vaddr)
+{
+    tlb_entry_t probe;
+    int index;
+    interrupt_status_t st;
+
+    probe = *entry;
+    probe.VPN2 = vaddr >> 13;
+
+    st = _interrupt_disable();
+    index = _tlb_probe(&probe);
+    _tlb_set_pagemask(pagemask);
+    if (index >= 0) {
+        _tlb_write(entry, index, 1);
+    } else {
+        _tlb_write_random(entry);
+    }
+    _tlb_set_pagemask(0);
+    _interrupt_set_state(st);
+}
+
+/**
+ * Removes the TLB row holding given entry, if there is one. The row
+ * gets a VPN2 of its own in the unmapped kernel segment like in
+ * tlb_flush, since an invalid row with the old VPN2 could overlap a
+ * large page entry written later.
+ *
+ * @param entry The entry to remove.
+ */
+void tlb_invalidate_entry(tlb_entry_t *entry)
+{
+    tlb_entry_t dummy;
+    int index;
+    interrupt_status_t st;
+
+    memoryset(&dummy, 0, sizeof(tlb_entry_t));
+
+    st = _interrupt_disable();
+    index = _tlb_probe(entry);
+    if (index >= 0) {
+        dummy.VPN2 = (0x80000000 >> 13) + index;
+        _tlb_write(&dummy, index, 1);
+    }
+    _interrupt_set_state(st);
+}
+
+/**
+ * Collects the TLB counters of all CPUs.
+ *
+ * @param stats Where to store the sums.
+ */
+void tlb_get_stats(tlb_stats_t *stats)
+{
+    int i;
+
+    memoryset(stats, 0, sizeof(tlb_stats_t));
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+        stats->fast_refills        += tlb_refill_area[i].fast_refills;
+        stats->load_exceptions     += tlb_stats[i].load_exceptions;
+        stats->store_exceptions    += tlb_stats[i].store_exceptions;
+        stats->modified_exceptions += tlb_stats[i].modified_exceptions;
+        stats->faults              += tlb_stats[i].faults;
+        stats->asid_rollovers      += tlb_stats[i].asid_rollovers;
+    }
+}
+
+/**
+ * Zeroes the TLB counters of all CPUs.
+ */
+void tlb_reset_stats(void)
+{
+    interrupt_status_t intr_status;
+    int i;
+
+    intr_status = _interrupt_disable();
+    for (i = 0; i < CONFIG_MAX_CPUS; i++) {
+        tlb_refill_area[i].fast_refills = 0;
+        memoryset(&tlb_stats[i], 0, sizeof(tlb_stats_t));
+    }
+    _interrupt_set_state(intr_status);
+}
+
+/**
+ * Prints the TLB counters to the console.
+ */
+void tlb_print_stats(void)
+{
+    tlb_stats_t stats;
+
+    tlb_get_stats(&stats);
+    kprintf("TLB: %d fast refills, %d load, %d store and %d modified "
+            "exceptions, %d faults\n",
+            stats.fast_refills, stats.load_exceptions, stats.store_exceptions,
+            stats.modified_exceptions, stats.faults);
+    kprintf("TLB: %d ASID rollovers\n", stats.asid_rollovers);
+}
+
+#endif /* CHANGED_5 */
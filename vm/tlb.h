@@ -124,4 +124,56 @@ void tlb_write_if_not_exists(tlb_entry_t* entry);
 
 #endif /* CHANGED_4 */
 
+#ifdef CHANGED_5
+
+/* TLB miss and exception counters, summed over all CPUs. */
+typedef struct {
+    /* Refills done by the assembler refill handler without entering C */
+    uint32_t fast_refills;
+    /* TLB load and store exceptions handled in C */
+    uint32_t load_exceptions;
+    uint32_t store_exceptions;
+    /* TLB modified exceptions */
+    uint32_t modified_exceptions;
+    /* Exceptions which could not be resolved (the faulting process
+       was killed) */
+    uint32_t faults;
+    /* Times the ASIDs ran out and the TLB was flushed */
+    uint32_t asid_rollovers;
+} tlb_stats_t;
+
+struct pagetable_struct_t;
+
+void tlb_init(void);
+void tlb_set_fast_refill(int enabled);
+void tlb_activate(struct pagetable_struct_t *pagetable);
+void tlb_flush(void);
+
+void tlb_get_stats(tlb_stats_t *stats);
+void tlb_reset_stats(void);
+void tlb_print_stats(void);
+
+/**
+ * Writes given entry into TLB, replacing the TLB row already holding
+ * the same VPN2 and ASID if there is one.
+ */
+void tlb_write_entry(tlb_entry_t *entry);
+void tlb_write_large_entry(tlb_entry_t *entry, uint32_t pagemask,
+                           uint32_t vaddr);
+void tlb_invalidate_entry(tlb_entry_t *entry);
+
+void tlb_shootdown(struct pagetable_struct_t *pagetable, tlb_entry_t *entry);
+void tlb_shootdown_wait(void);
+void tlb_shootdown_interrupt(void);
+void tlb_release_pagetable(struct pagetable_struct_t *pagetable);
+
+uint32_t _tlb_get_asid(void);
+void _tlb_set_pagemask(uint32_t mask);
+uint32_t _tlb_get_pagemask(void);
+
+/* Code copied to the TLB refill exception vector */
+void _tlb_refill_vector_code(void);
+
+#endif /* CHANGED_5 */
+
 #endif /* BUENOS_VM_TLB_H */
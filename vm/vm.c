@@ -40,9 +40,14 @@
 #include "kernel/kmalloc.h"
 #include "kernel/assert.h"
 
-#ifdef CHANGED_4
+#if defined(CHANGED_4) || defined(CHANGED_5)
 #include "vm/tlb.h"
 #endif
+#ifdef CHANGED_5
+#include "kernel/config.h"
+#include "kernel/interrupt.h"
+#include "vm/swap.h"
+#endif
 
 /** @name Virtual memory system
  *
@@ -57,6 +62,244 @@
 #define ADDR_IS_ON_ODD_PAGE(addr)  ((addr) & 0x00001000)  
 #define ADDR_IS_ON_EVEN_PAGE(addr) (!((addr) & 0x00001000))  
 
+#ifdef CHANGED_5
+
+/* Slot of the pagetable index where probing for given VPN2 starts */
+#define INDEX_SLOT(vpn2) ((vpn2) & (PAGETABLE_INDEX_SLOTS - 1))
+
+/* Copy-on-write flag of the page containing given address */
+#define COW_FLAG(addr) (ADDR_IS_ON_EVEN_PAGE(addr) ? \
+                        PAGETABLE_FLAG_COW0 : PAGETABLE_FLAG_COW1)
+
+/* Swap flag of the page containing given address */
+#define SWAP_FLAG(addr) (ADDR_IS_ON_EVEN_PAGE(addr) ? \
+                         PAGETABLE_FLAG_SWAP0 : PAGETABLE_FLAG_SWAP1)
+
+/* Clean (unwritten) flag of the page containing given address */
+#define CLEAN_FLAG(addr) (ADDR_IS_ON_EVEN_PAGE(addr) ? \
+                          PAGETABLE_FLAG_CLEAN0 : PAGETABLE_FLAG_CLEAN1)
+
+/* Software flags of given pagetable entry */
+#define ENTRY_FLAGS(pagetable, entry) \
+    ((pagetable)->index->flags[(entry) - (pagetable)->entries])
+
+/**
+ * Finds the pagetable entry of the page pair containing given virtual
+ * address. Uses the lookup index of the pagetable, so the cost does
+ * not depend on the number of mappings.
+ *
+ * @param pagetable Page table to search
+ *
+ * @param vaddr Virtual address to find
+ *
+ * @return The entry, or NULL if the page pair has no entry.
+ */
+static tlb_entry_t *vm_find_entry(pagetable_t *pagetable, uint32_t vaddr)
+{
+    uint32_t vpn2 = vaddr >> 13;
+    uint32_t slot = INDEX_SLOT(vpn2);
+    uint16_t offset;
+    tlb_entry_t *entry;
+
+    while ((offset = pagetable->index->slots[slot]) != 0) {
+        entry = (tlb_entry_t *)((uint32_t)pagetable + offset);
+        if (entry->VPN2 == vpn2)
+            return entry;
+        slot = INDEX_SLOT(slot + 1);
+    }
+
+    return NULL;
+}
+
+/**
+ * Adds given pagetable entry to the lookup index of the pagetable.
+ * The index always has free slots, since it is larger than the
+ * pagetable.
+ *
+ * @param pagetable Page table owning the entry
+ *
+ * @param entry Entry to add
+ */
+static void vm_index_entry(pagetable_t *pagetable, tlb_entry_t *entry)
+{
+    uint32_t slot = INDEX_SLOT(entry->VPN2);
+
+    while (pagetable->index->slots[slot] != 0)
+        slot = INDEX_SLOT(slot + 1);
+
+    pagetable->index->slots[slot] = 
+        (uint16_t)((uint32_t)entry - (uint32_t)pagetable);
+}
+
+/* Largest large page size the hardware supports, 0 if none */
+static int vm_large_max_size;
+
+/**
+ * Finds the large page mapping containing given virtual address.
+ *
+ * @param pagetable Page table to search
+ *
+ * @param vaddr Virtual address to find
+ *
+ * @return Index of the mapping in pagetable->index->large, or -1 if
+ * the address is not in a large page.
+ */
+static int vm_find_large(pagetable_t *pagetable, uint32_t vaddr)
+{
+    pagetable_index_t *index = pagetable->index;
+    int i;
+
+    for (i = 0; i < PAGETABLE_LARGE_ENTRIES; i++) {
+        if (index->large_size[i] != 0 &&
+            (vaddr >> 13) - index->large[i].VPN2 <
+            PAGETABLE_LARGE_PAGE_SIZE(index->large_size[i]) >> 12)
+            return i;
+    }
+
+    return -1;
+}
+
+/**
+ * Returns the physical 4k page mapped to given virtual address by a
+ * large page mapping.
+ *
+ * @param large The large page entry
+ *
+ * @param size Size of the large pages
+ *
+ * @param vaddr Virtual address inside the large page pair
+ *
+ * @return Physical address of the page
+ */
+static uint32_t vm_large_phys(tlb_entry_t *large, int size, uint32_t vaddr)
+{
+    uint32_t offset = (vaddr & PAGE_SIZE_MASK) - (large->VPN2 << 13);
+    uint32_t half = PAGETABLE_LARGE_PAGE_SIZE(size);
+
+    if (offset < half)
+        return (large->PFN0 << 12) + offset;
+    return (large->PFN1 << 12) + offset - half;
+}
+
+/**
+ * Splits a large page mapping back to 4k page pairs. The pages stay
+ * where they are and become candidates for swapping again. The large
+ * entry is shot down (see tlb_shootdown), so the caller must call
+ * tlb_shootdown_wait after releasing the lock of the pagetable. Must
+ * be called with interrupts disabled and the lock held.
+ *
+ * @param pagetable Page table owning the mapping
+ *
+ * @param i Index of the mapping in pagetable->index->large
+ */
+static void vm_demote(pagetable_t *pagetable, int i)
+{
+    tlb_entry_t *large = &pagetable->index->large[i];
+    int size = pagetable->index->large_size[i];
+    uint32_t base = large->VPN2 << 13;
+    uint32_t end = base + 2 * PAGETABLE_LARGE_PAGE_SIZE(size);
+    uint32_t vaddr, phys;
+    tlb_entry_t *entry;
+
+    for (vaddr = base; vaddr < end; vaddr += 2 * PAGE_SIZE) {
+        entry = vm_find_entry(pagetable, vaddr);
+        KERNEL_ASSERT(entry != NULL &&
+                      (ENTRY_FLAGS(pagetable, entry) & PAGETABLE_FLAG_LARGE));
+        phys = vm_large_phys(large, size, vaddr);
+        entry->PFN0 = phys >> 12;
+        entry->PFN1 = (phys + PAGE_SIZE) >> 12;
+        entry->D0 = entry->D1 = large->D0;
+        entry->V0 = entry->V1 = 1;
+        ENTRY_FLAGS(pagetable, entry) &= ~PAGETABLE_FLAG_LARGE;
+        pagepool_set_owner(phys, pagetable, vaddr);
+        pagepool_set_owner(phys + PAGE_SIZE, pagetable, vaddr + PAGE_SIZE);
+    }
+
+    tlb_shootdown(pagetable, large);
+    pagetable->index->large_size[i] = 0;
+}
+
+/**
+ * Takes a new pagetable entry for the page pair containing given
+ * virtual address, with both pages of the pair invalid.
+ *
+ * @param pagetable Page table to add the entry to
+ *
+ * @param vaddr Virtual address in the page pair
+ *
+ * @return The entry, or NULL if the pagetable is full.
+ */
+static tlb_entry_t *vm_new_entry(pagetable_t *pagetable, uint32_t vaddr)
+{
+    tlb_entry_t *entry;
+
+    if (pagetable->valid_count >= PAGETABLE_ENTRIES)
+        return NULL;
+
+    entry = &pagetable->entries[pagetable->valid_count];
+    memoryset(entry, 0, sizeof(tlb_entry_t));
+    entry->VPN2 = vaddr >> 13;
+    entry->ASID = pagetable->ASID;
+    vm_index_entry(pagetable, entry);
+    pagetable->valid_count++;
+
+    return entry;
+}
+
+/**
+ * Maps a 4k page like vm_map. Must be called with interrupts disabled
+ * and the lock of the pagetable held.
+ */
+static int vm_map_page(pagetable_t *pagetable, uint32_t physaddr,
+                       uint32_t vaddr, int dirty)
+{
+    tlb_entry_t *entry;
+
+    KERNEL_ASSERT(dirty == 0 || dirty == 1);
+
+    entry = vm_find_entry(pagetable, vaddr);
+
+    if(entry == NULL) {
+        /* No previous or pairing mapping was found */
+
+        entry = vm_new_entry(pagetable, vaddr);
+
+        /* Make sure that pagetable is not full */
+        if(entry == NULL) {
+            kprintf("Thread with ASID=%d run out of pagetable mapping entries\n",
+                    pagetable->ASID);
+            kprintf("during an attempt to map vaddr 0x%8.8x => phys 0x%8.8x.\n",
+                    vaddr, physaddr);
+            return -1;
+        }
+    }
+
+    /* A page in swap or in a large page is still mapped */
+    if(ENTRY_FLAGS(pagetable, entry) & (SWAP_FLAG(vaddr) | PAGETABLE_FLAG_LARGE))
+        return -1;
+
+    /* TLB has separate mappings for even and odd virtual pages. */
+    if(ADDR_IS_ON_EVEN_PAGE(vaddr)) {
+        if(entry->V0 == 1)
+            return -1;
+        entry->PFN0 = physaddr >> 12;
+        entry->D0   = dirty;
+        entry->V0   = 1;
+        entry->G0   = 0;
+    } else {
+        if(entry->V1 == 1)
+            return -1;
+        entry->PFN1 = physaddr >> 12;
+        entry->D1   = dirty;
+        entry->V1   = 1;
+        entry->G1   = 0;
+    }
+    ENTRY_FLAGS(pagetable, entry) &= ~(COW_FLAG(vaddr) | CLEAN_FLAG(vaddr));
+
+    return 1;
+}
+#endif /* CHANGED_5 */
+
 
 /**
  * Initializes virtual memory system. Initialization consists of page
@@ -65,6 +308,10 @@
  */ 
 void vm_init(void)
 {
+#ifdef CHANGED_5
+    uint32_t mask;
+
+#endif
     /* Make sure that tlb_entry_t really is exactly 3 registers wide
        and thus probably also matches the hardware TLB registers. This
        is needed for assembler wrappers used for TLB manipulation. 
@@ -72,10 +319,53 @@ void vm_init(void)
        in this form. */
     KERNEL_ASSERT(sizeof(tlb_entry_t) == 12);
 
+#ifdef CHANGED_5
+    /* The TLB refill handler in vm/_tlb.S finds the index through
+       a fixed offset, and the index slots must fit on a page. */
+    KERNEL_ASSERT((uint32_t)&((pagetable_t *)0)->index == 4088);
+    KERNEL_ASSERT(sizeof(pagetable_index_t) <= PAGE_SIZE);
+    KERNEL_ASSERT(PAGETABLE_INDEX_SLOTS > PAGETABLE_ENTRIES);
+    KERNEL_ASSERT(sizeof(pagetable_t) <= PAGE_SIZE);
+#endif
+
     pagepool_init();
     kmalloc_disable();
+
+#ifdef CHANGED_5
+    tlb_init();
+
+    /* Bits of page sizes the hardware does not support read back as
+       zero from the PageMask register. */
+    _tlb_set_pagemask(PAGETABLE_LARGE_PAGEMASK(CONFIG_LARGE_PAGE_MAX_SIZE));
+    mask = _tlb_get_pagemask();
+    _tlb_set_pagemask(0);
+    vm_large_max_size = 0;
+    while (vm_large_max_size < CONFIG_LARGE_PAGE_MAX_SIZE &&
+           (PAGETABLE_LARGE_PAGEMASK(vm_large_max_size + 1) & ~mask) == 0)
+        vm_large_max_size++;
+    /* A block should leave most of the memory to everything else */
+    while (vm_large_max_size > 0 &&
+           2 * PAGETABLE_LARGE_PAGE_SIZE(vm_large_max_size) >
+           (uint32_t)pagepool_get_num_pages() * PAGE_SIZE / 4)
+        vm_large_max_size--;
+    if (vm_large_max_size > 0)
+        kprintf("VM: large pages up to %dk\n",
+                PAGETABLE_LARGE_PAGE_SIZE(vm_large_max_size) / 1024);
+#endif
 }
 
+#ifdef CHANGED_5
+/**
+ *  Creates a new page table. Reserves memory (one page) for the table
+ *  and another for its index. The address space identifier is
+ *  allocated when the table is first activated with tlb_activate.
+ *
+ *  @return The created page table
+ *
+ */
+
+pagetable_t *vm_create_pagetable(void)
+#else
 /**
  *  Creates a new page table. Reserves memory (one page) for the table
  *  and sets the address space identifier for the created page table.
@@ -87,6 +377,7 @@ void vm_init(void)
  */
 
 pagetable_t *vm_create_pagetable(uint32_t asid)
+#endif
 {
     pagetable_t *table;
     uint32_t addr;
@@ -102,12 +393,40 @@ pagetable_t *vm_create_pagetable(uint32_t asid)
        physical memory. */
     table = (pagetable_t *) (ADDR_PHYS_TO_KERNEL(addr));
 
+#ifdef CHANGED_5
+    table->ASID            = 0;
+    table->asid_generation = 0;
+#else
     table->ASID        = asid;
+#endif
     table->valid_count = 0;
 
+#ifdef CHANGED_5
+    addr = pagepool_get_zeroed_phys_page();
+    if(addr == 0) {
+        pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS((uint32_t) table));
+        return NULL;
+    }
+
+    table->index = (pagetable_index_t *) (ADDR_PHYS_TO_KERNEL(addr));
+    spinlock_reset(&table->index->slock);
+#endif
+
     return table;
 }
 
+#ifdef CHANGED_5
+/**
+ * Destroys given pagetable. Frees the pages and swap slots still
+ * mapped in it and the memory (two pages) allocated for the pagetable.
+ * Does not remove mappings from the TLB. The mappings are released
+ * here rather than by the callers, because the writeback thread of
+ * swap may be moving a page of the table to swap at the same time.
+ *
+ * @param pagetable Page table to destroy
+ *
+ */
+#else
 /**
  * Destroys given pagetable. Frees the memory (one page) allocated for
  * the pagetable. Does not remove mappings from the TLB.
@@ -115,9 +434,51 @@ pagetable_t *vm_create_pagetable(uint32_t asid)
  * @param pagetable Page table to destroy
  *
  */
+#endif
 
 void vm_destroy_pagetable(pagetable_t *pagetable)
 {
+#ifdef CHANGED_5
+    interrupt_status_t intr_status;
+    pagetable_index_t *index = pagetable->index;
+    tlb_entry_t *entry;
+    uint32_t i, base, end, vaddr;
+    int size;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&index->slock);
+    for (i = 0; i < pagetable->valid_count; i++) {
+        entry = &pagetable->entries[i];
+        if (index->flags[i] & PAGETABLE_FLAG_SWAP0)
+            swap_free_slot(entry->PFN0);
+        else if (entry->V0)
+            pagepool_free_phys_page(entry->PFN0 << 12);
+        if (index->flags[i] & PAGETABLE_FLAG_SWAP1)
+            swap_free_slot(entry->PFN1);
+        else if (entry->V1)
+            pagepool_free_phys_page(entry->PFN1 << 12);
+        entry->V0 = entry->V1 = 0;
+        index->flags[i] = 0;
+    }
+    for (i = 0; i < PAGETABLE_LARGE_ENTRIES; i++) {
+        size = index->large_size[i];
+        if (size == 0)
+            continue;
+        base = index->large[i].VPN2 << 13;
+        end = base + 2 * PAGETABLE_LARGE_PAGE_SIZE(size);
+        for (vaddr = base; vaddr < end; vaddr += PAGE_SIZE) {
+            pagepool_free_phys_page(vm_large_phys(&index->large[i], size, vaddr));
+        }
+        index->large_size[i] = 0;
+    }
+    spinlock_release(&index->slock);
+    _interrupt_set_state(intr_status);
+
+    // no CPU or swap may refer to the table after this
+    tlb_release_pagetable(pagetable);
+    swap_release_pagetable(pagetable);
+    pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS((uint32_t) index));
+#endif
     pagepool_free_phys_page(ADDR_KERNEL_TO_PHYS((uint32_t) pagetable));
 }
 
@@ -139,6 +500,25 @@ void vm_destroy_pagetable(pagetable_t *pagetable)
  *
  */
 
+#ifdef CHANGED_5
+int vm_map(pagetable_t *pagetable,
+	    uint32_t physaddr, 
+	    uint32_t vaddr,
+            int dirty)
+{
+    interrupt_status_t intr_status;
+    int ret;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagetable->index->slock);
+    ret = vm_map_page(pagetable, physaddr, vaddr, dirty);
+    spinlock_release(&pagetable->index->slock);
+    _interrupt_set_state(intr_status);
+
+    return ret;
+}
+#else /* CHANGED_5 */
+
 #ifdef CHANGED_2
 int vm_map(pagetable_t *pagetable,
 	    uint32_t physaddr, 
@@ -241,8 +621,42 @@ void vm_map(pagetable_t *pagetable,
 #endif
 }
 
+#endif /* CHANGED_5 */
 
-#ifdef CHANGED_2
+
+#ifdef CHANGED_5
+int vm_get_vaddr_page_offsets(pagetable_t *pagetable, uint32_t vaddr,
+        uint32_t* p_physpageoff, uint32_t* p_virtpageoff) {
+    tlb_entry_t *entry;
+    int i;
+
+    *p_physpageoff = 0;
+    *p_virtpageoff = 0;
+
+    entry = vm_get_entry_by_vaddr(pagetable, vaddr);
+    if (entry == NULL) {
+        return 0;
+    }
+
+    if (ENTRY_FLAGS(pagetable, entry) & PAGETABLE_FLAG_LARGE) {
+        i = vm_find_large(pagetable, vaddr);
+        KERNEL_ASSERT(i >= 0);
+        *p_physpageoff = vm_large_phys(&pagetable->index->large[i],
+                                       pagetable->index->large_size[i],
+                                       vaddr) >> 12;
+    } else if (ADDR_IS_ON_EVEN_PAGE(vaddr)) {
+        if (!entry->V0)
+            return 0;
+        *p_physpageoff = entry->PFN0;
+    } else {
+        if (!entry->V1)
+            return 0;
+        *p_physpageoff = entry->PFN1;
+    }
+    *p_virtpageoff = vaddr & PAGE_SIZE_MASK;
+    return 1;
+}
+#elif defined(CHANGED_2)
 int vm_get_vaddr_page_offsets(pagetable_t *pagetable, uint32_t vaddr,
         uint32_t* p_physpageoff, uint32_t* p_virtpageoff) {
     uint32_t i;
@@ -285,12 +699,19 @@ int vm_get_vaddr_page_offsets(pagetable_t *pagetable, uint32_t vaddr,
 #ifdef CHANGED_4
 
 tlb_entry_t* vm_get_entry_by_vaddr(pagetable_t *pagetable, uint32_t vaddr) {
+#ifndef CHANGED_5
     uint32_t i;
+#endif
 
     if (vaddr < 0x00001000) {
         // no vaddresses allowed < 4096 (=tlb page size)
         return NULL;
     }
+#ifdef CHANGED_5
+    if (pagetable) {
+        return vm_find_entry(pagetable, vaddr);
+    }
+#else
     if (pagetable) {
         for(i = 0 ; i < pagetable->valid_count ; i++) {
             if(pagetable->entries[i].VPN2 == (vaddr >> 13)) {
@@ -298,6 +719,7 @@ tlb_entry_t* vm_get_entry_by_vaddr(pagetable_t *pagetable, uint32_t vaddr) {
             }
         }
     }
+#endif /* CHANGED_5 */
     return NULL;
 }
 
@@ -314,7 +736,46 @@ tlb_entry_t* vm_get_entry_by_vaddr(pagetable_t *pagetable, uint32_t vaddr) {
 
 void vm_unmap(pagetable_t *pagetable, uint32_t vaddr)
 {
-#ifdef CHANGED_4
+#if defined(CHANGED_5)
+    interrupt_status_t intr_status;
+    tlb_entry_t *entry;
+    uint32_t phys = 0;
+    int slot = -1;
+
+    entry = vm_get_entry_by_vaddr(pagetable, vaddr);
+    if (entry == NULL) return;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagetable->index->slock);
+    if (ENTRY_FLAGS(pagetable, entry) & PAGETABLE_FLAG_LARGE)
+        vm_demote(pagetable, vm_find_large(pagetable, vaddr));
+    ENTRY_FLAGS(pagetable, entry) &= ~(COW_FLAG(vaddr) | CLEAN_FLAG(vaddr));
+    if (ENTRY_FLAGS(pagetable, entry) & SWAP_FLAG(vaddr)) {
+        ENTRY_FLAGS(pagetable, entry) &= ~SWAP_FLAG(vaddr);
+        slot = ADDR_IS_ON_EVEN_PAGE(vaddr) ? entry->PFN0 : entry->PFN1;
+    } else if(ADDR_IS_ON_EVEN_PAGE(vaddr)) {
+        if (entry->V0) {
+            phys = entry->PFN0 << 12;
+            entry->V0 = 0;
+        }
+    } else {
+        if (entry->V1) {
+            phys = entry->PFN1 << 12;
+            entry->V1 = 0;
+        }
+    }
+    if (phys != 0)
+        tlb_shootdown(pagetable, entry);
+    spinlock_release(&pagetable->index->slock);
+
+    /* the page may be reused once no TLB holds it */
+    tlb_shootdown_wait();
+    _interrupt_set_state(intr_status);
+    if (slot >= 0)
+        swap_free_slot(slot);
+    if (phys != 0)
+        pagepool_free_phys_page(phys);
+#elif defined(CHANGED_4)
     uint32_t i;
     tlb_entry_t *entry;
     if (!pagetable) return;
@@ -352,6 +813,36 @@ void vm_unmap(pagetable_t *pagetable, uint32_t vaddr)
  */
 void vm_set_dirty(pagetable_t *pagetable, uint32_t vaddr, int dirty)
 {
+#ifdef CHANGED_5
+    interrupt_status_t intr_status;
+    tlb_entry_t *entry;
+    int found = 0;
+
+    KERNEL_ASSERT(dirty == 0 || dirty == 1);
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagetable->index->slock);
+    entry = vm_find_entry(pagetable, vaddr);
+    if(entry != NULL) {
+        if(ENTRY_FLAGS(pagetable, entry) & PAGETABLE_FLAG_LARGE)
+            vm_demote(pagetable, vm_find_large(pagetable, vaddr));
+        if(ADDR_IS_ON_EVEN_PAGE(vaddr) && entry->V0 == 1) {
+            entry->D0 = dirty;
+            found = 1;
+        } else if(!ADDR_IS_ON_EVEN_PAGE(vaddr) && entry->V1 == 1) {
+            entry->D1 = dirty;
+            found = 1;
+        }
+        /* a page made read-only must not stay writable in any TLB */
+        if(found && dirty == 0)
+            tlb_shootdown(pagetable, entry);
+    }
+    spinlock_release(&pagetable->index->slock);
+    tlb_shootdown_wait();
+    _interrupt_set_state(intr_status);
+    if(found)
+        return;
+#else
     unsigned int i;
 
     KERNEL_ASSERT(dirty == 0 || dirty == 1);
@@ -378,9 +869,532 @@ void vm_set_dirty(pagetable_t *pagetable, uint32_t vaddr, int dirty)
 	    }
 	}
     }
+#endif /* CHANGED_5 */
     /* No mapping was found */
 
     KERNEL_PANIC("Tried to set dirty bit of an unmapped entry");
 }
 
+#ifdef CHANGED_5
+/**
+ * Copies all mappings of a pagetable to another, empty pagetable.
+ * The pages are not copied but shared: writable pages are turned
+ * read-only copy-on-write in both tables and every shared page gets
+ * an additional reference in the page pool. Possible TLB entries of
+ * the source table are shot down on all CPUs. The source table is
+ * locked while it is copied, so other threads of the process may keep
+ * running.
+ *
+ * @param from Page table to copy
+ *
+ * @param to Empty page table receiving the mappings
+ *
+ * @return 1 on success, -1 if the page table could not be copied.
+ */
+int vm_copy_pagetable(pagetable_t *from, pagetable_t *to)
+{
+    interrupt_status_t intr_status;
+    tlb_entry_t *entry, *copy;
+    uint32_t i;
+    int changed;
+    uint8_t flags;
+
+    if (to->valid_count != 0)
+        return -1;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&from->index->slock);
+    /* Large pages are shared copy-on-write as 4k pages */
+    for (i = 0; i < PAGETABLE_LARGE_ENTRIES; i++) {
+        if (from->index->large_size[i] != 0)
+            vm_demote(from, i);
+    }
+    for (i = 0; i < from->valid_count; i++) {
+        entry = &from->entries[i];
+        flags = from->index->flags[i];
+        if (!entry->V0 && !entry->V1 &&
+            !(flags & (PAGETABLE_FLAG_SWAP0 | PAGETABLE_FLAG_SWAP1)))
+            continue;
+
+        // swapped pages are never written, both tables share the slot
+        if (flags & PAGETABLE_FLAG_SWAP0)
+            swap_ref_slot(entry->PFN0);
+        if (flags & PAGETABLE_FLAG_SWAP1)
+            swap_ref_slot(entry->PFN1);
+
+        changed = 0;
+        if (entry->V0) {
+            pagepool_ref_phys_page(entry->PFN0 << 12);
+            if (entry->D0 || (flags & PAGETABLE_FLAG_CLEAN0)) {
+                entry->D0 = 0;
+                from->index->flags[i] |= PAGETABLE_FLAG_COW0;
+                changed = 1;
+            }
+        }
+        if (entry->V1) {
+            pagepool_ref_phys_page(entry->PFN1 << 12);
+            if (entry->D1 || (flags & PAGETABLE_FLAG_CLEAN1)) {
+                entry->D1 = 0;
+                from->index->flags[i] |= PAGETABLE_FLAG_COW1;
+                changed = 1;
+            }
+        }
+        if (changed)
+            tlb_shootdown(from, entry);
+
+        copy = &to->entries[to->valid_count];
+        *copy = *entry;
+        copy->ASID = to->ASID;
+        if (!entry->V0 && !(flags & PAGETABLE_FLAG_SWAP0))
+            copy->PFN0 = 0;
+        if (!entry->V1 && !(flags & PAGETABLE_FLAG_SWAP1))
+            copy->PFN1 = 0;
+        vm_index_entry(to, copy);
+        ENTRY_FLAGS(to, copy) = from->index->flags[i];
+        to->valid_count++;
+    }
+    spinlock_release(&from->index->slock);
+    tlb_shootdown_wait();
+    _interrupt_set_state(intr_status);
+
+    return 1;
+}
+
+/**
+ * Makes a copy-on-write page writable. The page is copied unless this
+ * pagetable holds the last reference to it. The new mapping is written
+ * to the local TLB, and the old one is shot down on the other CPUs if
+ * the page was copied. Must be called with interrupts disabled.
+ *
+ * @param pagetable The pagetable where the mapping resides.
+ *
+ * @param vaddr Written virtual address.
+ *
+ * @return 1 if the page is now writable, 0 if it was not a copy-on-write
+ * page, -1 if no memory was available for the copy.
+ */
+int vm_copy_on_write(pagetable_t *pagetable, uint32_t vaddr)
+{
+    tlb_entry_t *entry;
+    uint32_t phys, copy, old = 0;
+
+    spinlock_acquire(&pagetable->index->slock);
+    entry = vm_find_entry(pagetable, vaddr);
+    if (entry == NULL || !(ENTRY_FLAGS(pagetable, entry) & COW_FLAG(vaddr))) {
+        spinlock_release(&pagetable->index->slock);
+        return 0;
+    }
+
+    phys = (ADDR_IS_ON_EVEN_PAGE(vaddr) ? entry->PFN0 : entry->PFN1) << 12;
+    if (pagepool_get_refcount(phys) > 1) {
+        copy = pagepool_get_phys_page();
+        if (copy == 0) {
+            spinlock_release(&pagetable->index->slock);
+            return -1;
+        }
+        memcopy(PAGE_SIZE, (void *) ADDR_PHYS_TO_KERNEL(copy),
+                (void *) ADDR_PHYS_TO_KERNEL(phys));
+        old = phys;
+        phys = copy;
+    }
+    // the page belongs only to this pagetable now and may be swapped
+    pagepool_set_owner(phys, pagetable, vaddr & PAGE_SIZE_MASK);
+
+    if (ADDR_IS_ON_EVEN_PAGE(vaddr)) {
+        entry->PFN0 = phys >> 12;
+        entry->D0 = 1;
+    } else {
+        entry->PFN1 = phys >> 12;
+        entry->D1 = 1;
+    }
+    ENTRY_FLAGS(pagetable, entry) &= ~(COW_FLAG(vaddr) | CLEAN_FLAG(vaddr));
+
+    /* other CPUs may still read the old page */
+    if (old != 0)
+        tlb_shootdown(pagetable, entry);
+    tlb_write_entry(entry);
+    spinlock_release(&pagetable->index->slock);
+
+    tlb_shootdown_wait();
+    if (old != 0)
+        pagepool_free_phys_page(old);
+    return 1;
+}
+
+/**
+ * Maps a writable page write-protected until it is written for the
+ * first time, so that pages which have been written can be told apart
+ * from pages which still match their backing file. The page is never
+ * writable before it is marked clean, so no write can go unnoticed.
+ *
+ * @param pagetable The pagetable where to do the mapping.
+ *
+ * @param physaddr Physical address of the page.
+ *
+ * @param vaddr Virtual address of the page.
+ *
+ * @return 1 on success, -1 if the address is already mapped or the
+ * pagetable is full (see vm_map).
+ */
+int vm_map_clean(pagetable_t *pagetable, uint32_t physaddr, uint32_t vaddr)
+{
+    interrupt_status_t intr_status;
+    tlb_entry_t *entry;
+    int ret;
+
+    intr_status = _interrupt_disable();
+    spinlock_acquire(&pagetable->index->slock);
+    ret = vm_map_page(pagetable, physaddr, vaddr, 0);
+    if (ret > 0) {
+        entry = vm_find_entry(pagetable, vaddr);
+        ENTRY_FLAGS(pagetable, entry) |= CLEAN_FLAG(vaddr);
+    }
+    spinlock_release(&pagetable->index->slock);
+    _interrupt_set_state(intr_status);
+
+    return ret;
+}
+
+/**
+ * Makes a clean page writable on its first write (see
+ * vm_map_clean). Must be called with interrupts disabled.
+ *
+ * @param pagetable The pagetable where the mapping resides.
+ *
+ * @param vaddr Written virtual address.
+ *
+ * @return 1 if the page is now writable, 0 if it was not a clean page
+ * or must be copied first (see vm_copy_on_write).
+ */
+int vm_mark_written(pagetable_t *pagetable, uint32_t vaddr)
+{
+    tlb_entry_t *entry;
+    int ret = 0;
+
+    spinlock_acquire(&pagetable->index->slock);
+    entry = vm_find_entry(pagetable, vaddr);
+    if (entry != NULL &&
+        (ENTRY_FLAGS(pagetable, entry) & (CLEAN_FLAG(vaddr) | COW_FLAG(vaddr)))
+        == CLEAN_FLAG(vaddr)) {
+        if (ADDR_IS_ON_EVEN_PAGE(vaddr) && entry->V0) {
+            entry->D0 = 1;
+            ret = 1;
+        } else if (!ADDR_IS_ON_EVEN_PAGE(vaddr) && entry->V1) {
+            entry->D1 = 1;
+            ret = 1;
+        }
+    }
+    if (ret) {
+        ENTRY_FLAGS(pagetable, entry) &= ~CLEAN_FLAG(vaddr);
+        tlb_write_entry(entry);
+    }
+    spinlock_release(&pagetable->index->slock);
+
+    return ret;
+}
+
+/**
+ * Checks whether a page is still clean, see vm_map_clean.
+ *
+ * @param pagetable The pagetable where the mapping resides.
+ *
+ * @param vaddr Virtual address of the page.
+ *
+ * @return 1 if the page has not been written, 0 otherwise.
+ */
+int vm_is_clean(pagetable_t *pagetable, uint32_t vaddr)
+{
+    tlb_entry_t *entry;
+
+    entry = vm_get_entry_by_vaddr(pagetable, vaddr);
+    return entry != NULL &&
+        (ENTRY_FLAGS(pagetable, entry) & CLEAN_FLAG(vaddr)) != 0;
+}
+
+/**
+ * Checks whether a page of the pagetable is mapped writable, so that
+ * a write to it needs neither a copy nor marking it written.
+ *
+ * @param pagetable The pagetable where the mapping resides.
+ *
+ * @param vaddr Virtual address of the page.
+ *
+ * @return 1 if the page is writable, 0 otherwise.
+ */
+int vm_is_writable(pagetable_t *pagetable, uint32_t vaddr)
+{
+    tlb_entry_t *entry;
+    int size;
+
+    size = vm_get_large_entry(pagetable, vaddr, &entry);
+    if (size > 0) {
+        if ((vaddr & PAGE_SIZE_MASK) - (entry->VPN2 << 13)
+            < PAGETABLE_LARGE_PAGE_SIZE(size))
+            return entry->V0 && entry->D0;
+        return entry->V1 && entry->D1;
+    }
+
+    entry = vm_get_entry_by_vaddr(pagetable, vaddr);
+    if (entry == NULL)
+        return 0;
+    if (ADDR_IS_ON_EVEN_PAGE(vaddr))
+        return entry->V0 && entry->D0;
+    return entry->V1 && entry->D1;
+}
+
+/**
+ * Moves a page to swap in the pagetable. The page is made invalid and
+ * its entry is shot down (see tlb_shootdown), the contents of the
+ * physical page are not touched. The caller must call
+ * tlb_shootdown_wait before it writes the page. Must be called with
+ * interrupts disabled.
+ *
+ * @param pagetable The pagetable where the mapping resides.
+ *
+ * @param vaddr Virtual address of the page.
+ *
+ * @param phys The physical page the mapping is expected to refer to.
+ *
+ * @param slot Swap slot receiving the page.
+ *
+ * @return 1 if the page was moved, 0 if the mapping does not refer to
+ * the physical page or the page is shared copy-on-write.
+ */
+int vm_swap_out(pagetable_t *pagetable, uint32_t vaddr, uint32_t phys,
+                uint32_t slot)
+{
+    tlb_entry_t *entry;
+    int ret = 0;
+
+    spinlock_acquire(&pagetable->index->slock);
+    entry = vm_find_entry(pagetable, vaddr);
+    if (entry != NULL &&
+        !(ENTRY_FLAGS(pagetable, entry) & (COW_FLAG(vaddr) | SWAP_FLAG(vaddr)))) {
+        if (ADDR_IS_ON_EVEN_PAGE(vaddr)) {
+            if (entry->V0 && entry->PFN0 == phys >> 12) {
+                entry->V0 = 0;
+                entry->PFN0 = slot;
+                ret = 1;
+            }
+        } else {
+            if (entry->V1 && entry->PFN1 == phys >> 12) {
+                entry->V1 = 0;
+                entry->PFN1 = slot;
+                ret = 1;
+            }
+        }
+    }
+    if (ret) {
+        ENTRY_FLAGS(pagetable, entry) |= SWAP_FLAG(vaddr);
+        tlb_shootdown(pagetable, entry);
+    }
+    spinlock_release(&pagetable->index->slock);
+
+    return ret;
+}
+
+/**
+ * Checks whether a page of the pagetable is in swap.
+ *
+ * @param pagetable The pagetable where the mapping resides.
+ *
+ * @param vaddr Virtual address of the page.
+ *
+ * @param slot Returns the swap slot of the page.
+ *
+ * @return 1 if the page is in swap, 0 otherwise.
+ */
+int vm_get_swap_slot(pagetable_t *pagetable, uint32_t vaddr, uint32_t *slot)
+{
+    tlb_entry_t *entry;
+
+    entry = vm_get_entry_by_vaddr(pagetable, vaddr);
+    if (entry == NULL || !(ENTRY_FLAGS(pagetable, entry) & SWAP_FLAG(vaddr)))
+        return 0;
+
+    *slot = ADDR_IS_ON_EVEN_PAGE(vaddr) ? entry->PFN0 : entry->PFN1;
+    return 1;
+}
+
+/**
+ * Maps a page back from swap. Must be called with interrupts disabled.
+ *
+ * @param pagetable The pagetable where the mapping resides.
+ *
+ * @param vaddr Virtual address of the page.
+ *
+ * @param slot Swap slot the page is expected to be in.
+ *
+ * @param phys Physical page holding the contents read from the slot.
+ *
+ * @return 1 if the page was mapped, 0 if it is no longer in that slot.
+ */
+int vm_swap_in(pagetable_t *pagetable, uint32_t vaddr, uint32_t slot,
+               uint32_t phys)
+{
+    tlb_entry_t *entry;
+    uint32_t current;
+
+    spinlock_acquire(&pagetable->index->slock);
+    if (!vm_get_swap_slot(pagetable, vaddr, &current) || current != slot) {
+        spinlock_release(&pagetable->index->slock);
+        return 0;
+    }
+
+    entry = vm_find_entry(pagetable, vaddr);
+    if (ADDR_IS_ON_EVEN_PAGE(vaddr)) {
+        entry->PFN0 = phys >> 12;
+        entry->V0 = 1;
+    } else {
+        entry->PFN1 = phys >> 12;
+        entry->V1 = 1;
+    }
+    ENTRY_FLAGS(pagetable, entry) &= ~SWAP_FLAG(vaddr);
+    spinlock_release(&pagetable->index->slock);
+
+    return 1;
+}
+
+/**
+ * Finds the large page mapping containing given virtual address.
+ *
+ * @param pagetable The pagetable where the mapping resides.
+ *
+ * @param vaddr The virtual address.
+ *
+ * @param large Returns the entry of the mapping.
+ *
+ * @return Size of the large pages (see vm/pagetable.h), 0 if the
+ * address is not in a large page.
+ */
+int vm_get_large_entry(pagetable_t *pagetable, uint32_t vaddr,
+                       tlb_entry_t **large)
+{
+    int i;
+
+    i = vm_find_large(pagetable, vaddr);
+    if (i < 0)
+        return 0;
+
+    *large = &pagetable->index->large[i];
+    return pagetable->index->large_size[i];
+}
+
+/**
+ * Finds the largest block that may be mapped with a single large page
+ * pair around given virtual address: the block must be aligned to its
+ * size and lie within the memory region [start, end).
+ *
+ * @param vaddr A virtual address in the region.
+ *
+ * @param start First address of the region.
+ *
+ * @param end End of the region.
+ *
+ * @param base Returns the first address of the block.
+ *
+ * @return Size of the large pages (see vm/pagetable.h), 0 if no block
+ * fits or large pages are not available.
+ */
+int vm_large_block(uint32_t vaddr, uint32_t start, uint32_t end,
+                   uint32_t *base)
+{
+    uint32_t span;
+    int size;
+
+    for (size = vm_large_max_size; size >= 1; size--) {
+        span = 2 * PAGETABLE_LARGE_PAGE_SIZE(size);
+        *base = vaddr & ~(span - 1);
+        if (*base >= start && *base + span <= end && *base + span > *base)
+            return size;
+    }
+
+    return 0;
+}
+
+/**
+ * Maps an aligned block of virtual memory with a single large page
+ * pair. None of the pages of the block may be mapped or in swap. The
+ * 4k entries of the block are marked as part of the large page, so
+ * that the block is reserved in the pagetable. Large pages are not
+ * swapped; they are split back to 4k pages when a page is unmapped or
+ * the pagetable is copied. Must be called with interrupts disabled.
+ *
+ * @param pagetable The pagetable where to do the mapping.
+ *
+ * @param physaddr Physical address of the block, aligned to the size
+ * of the large pages. The block must be physically contiguous.
+ *
+ * @param vaddr First address of the block, aligned to the size of the
+ * large page pair.
+ *
+ * @param size Size of the large pages, see vm_large_block.
+ *
+ * @param dirty 1 if the pages are writable, 0 otherwise.
+ *
+ * @return 1 on success, -1 if some page of the block is already mapped
+ * or the pagetable has no room for the mapping.
+ */
+int vm_map_large(pagetable_t *pagetable, uint32_t physaddr, uint32_t vaddr,
+                 int size, int dirty)
+{
+    pagetable_index_t *index = pagetable->index;
+    uint32_t span = 2 * PAGETABLE_LARGE_PAGE_SIZE(size);
+    uint32_t page, needed;
+    tlb_entry_t *entry, *large;
+    int i, slot, ok;
+
+    KERNEL_ASSERT(size >= 1 && size <= vm_large_max_size);
+    KERNEL_ASSERT(dirty == 0 || dirty == 1);
+    KERNEL_ASSERT((vaddr & (span - 1)) == 0);
+    KERNEL_ASSERT((physaddr & (PAGETABLE_LARGE_PAGE_SIZE(size) - 1)) == 0);
+
+    spinlock_acquire(&index->slock);
+    needed = 0;
+    ok = 1;
+    for (page = vaddr; page < vaddr + span; page += 2 * PAGE_SIZE) {
+        entry = vm_find_entry(pagetable, page);
+        if (entry == NULL)
+            needed++;
+        else if (entry->V0 || entry->V1 || ENTRY_FLAGS(pagetable, entry))
+            ok = 0;
+    }
+    if (pagetable->valid_count + needed > PAGETABLE_ENTRIES)
+        ok = 0;
+
+    slot = -1;
+    for (i = 0; i < PAGETABLE_LARGE_ENTRIES && slot < 0 && ok; i++) {
+        if (index->large_size[i] == 0)
+            slot = i;
+    }
+    if (slot < 0) {
+        spinlock_release(&index->slock);
+        return -1;
+    }
+
+    /* The large entry is complete before any 4k entry refers to it */
+    large = &index->large[slot];
+    memoryset(large, 0, sizeof(tlb_entry_t));
+    large->VPN2 = vaddr >> 13;
+    large->ASID = pagetable->ASID;
+    large->PFN0 = physaddr >> 12;
+    large->PFN1 = (physaddr + PAGETABLE_LARGE_PAGE_SIZE(size)) >> 12;
+    large->D0 = large->D1 = dirty;
+    large->V0 = large->V1 = 1;
+    index->large_size[slot] = size;
+
+    for (page = vaddr; page < vaddr + span; page += 2 * PAGE_SIZE) {
+        entry = vm_find_entry(pagetable, page);
+        if (entry == NULL)
+            entry = vm_new_entry(pagetable, page);
+        ENTRY_FLAGS(pagetable, entry) |= PAGETABLE_FLAG_LARGE;
+        /* A row of the empty pair may be left in the local TLB */
+        tlb_invalidate_entry(entry);
+    }
+    spinlock_release(&index->slock);
+
+    return 1;
+}
+#endif /* CHANGED_5 */
+
 /** @} */
@@ -41,7 +41,11 @@
 
 void vm_init(void);
 
+#ifdef CHANGED_5
+pagetable_t *vm_create_pagetable(void);
+#else
 pagetable_t *vm_create_pagetable(uint32_t asid);
+#endif
 void vm_destroy_pagetable(pagetable_t *pagetable);
 
 #ifdef CHANGED_2
@@ -89,4 +93,24 @@ int vm_get_vaddr_page_offsets(pagetable_t *pagetable, uint32_t vaddr,
 tlb_entry_t* vm_get_entry_by_vaddr(pagetable_t *pagetable, uint32_t vaddr);
 #endif /* CHANGED_4 */
 
+#ifdef CHANGED_5
+int vm_copy_pagetable(pagetable_t *from, pagetable_t *to);
+int vm_copy_on_write(pagetable_t *pagetable, uint32_t vaddr);
+int vm_swap_out(pagetable_t *pagetable, uint32_t vaddr, uint32_t phys,
+                uint32_t slot);
+int vm_get_swap_slot(pagetable_t *pagetable, uint32_t vaddr, uint32_t *slot);
+int vm_swap_in(pagetable_t *pagetable, uint32_t vaddr, uint32_t slot,
+               uint32_t phys);
+int vm_get_large_entry(pagetable_t *pagetable, uint32_t vaddr,
+                       tlb_entry_t **large);
+int vm_large_block(uint32_t vaddr, uint32_t start, uint32_t end,
+                   uint32_t *base);
+int vm_map_large(pagetable_t *pagetable, uint32_t physaddr, uint32_t vaddr,
+                 int size, int dirty);
+int vm_map_clean(pagetable_t *pagetable, uint32_t physaddr, uint32_t vaddr);
+int vm_mark_written(pagetable_t *pagetable, uint32_t vaddr);
+int vm_is_clean(pagetable_t *pagetable, uint32_t vaddr);
+int vm_is_writable(pagetable_t *pagetable, uint32_t vaddr);
+#endif /* CHANGED_5 */
+
 #endif /* BUENOS_VM_VM_H */